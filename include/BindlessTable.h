@@ -0,0 +1,104 @@
+#pragma once
+
+#include "RenderGraph.h"
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <array>
+#include <cstdint>
+#include <mutex>
+#include <vector>
+
+// ----- CONSTANTS
+constexpr uint32_t BINDLESS_NONE = ~0u;
+constexpr uint32_t BINDLESS_MAX_IMAGES = 16384;
+constexpr uint32_t BINDLESS_MAX_SAMPLERS = 64;
+constexpr uint32_t BINDLESS_MAX_BUFFERS = 4096;
+// left in the per stage limits for the pushed set 0 layouts, which reach
+// six storage buffers (mesh stage) and two images (Hi-Z pass), plus the
+// color attachments that count as fragment resources
+constexpr uint32_t BINDLESS_RESERVED_BUFFERS = 8;
+constexpr uint32_t BINDLESS_RESERVED_IMAGES = 4;
+constexpr uint32_t BINDLESS_RESERVED_RESOURCES = 16;
+
+// the binding each kind lives at, see scene.slang
+enum class BindlessKind : uint32_t {
+    eImage   = 0,
+    eSampler = 1,
+    eBuffer  = 2
+};
+
+// One global, update-after-bind descriptor set holding every sampled image,
+// sampler and storage buffer the shaders index by handle. It is bound once
+// per pipeline layout and never reallocated, so adding a texture costs a
+// single descriptor write instead of a new set.
+//
+// Slots are never rewritten while command buffers may still read them: a
+// released slot goes through the deletion queue before it is handed out
+// again, and updates only ever touch slots no pending work uses.
+class BindlessTable {
+public:
+    BindlessTable(
+        vk::raii::Device const &device,
+        vk::PhysicalDeviceVulkan12Properties const &properties,
+        RetireCallback retire
+    );
+
+    BindlessTable(BindlessTable const &) = delete;
+    BindlessTable &operator=(BindlessTable const &) = delete;
+
+    // any thread, BINDLESS_NONE once the table is full
+    uint32_t addImage(vk::ImageView view, vk::ImageLayout layout = vk::ImageLayout::eShaderReadOnlyOptimal);
+    uint32_t addSampler(vk::Sampler sampler);
+    uint32_t addBuffer(vk::Buffer buffer, vk::DeviceSize offset = 0, vk::DeviceSize range = vk::WholeSize);
+
+    // any thread, the slot is reused once the frames recorded so far finish
+    void release(BindlessKind kind, uint32_t index);
+
+    // render thread, before recording. Hands the slots released since the
+    // last frame to the deletion queue
+    void beginFrame();
+
+    void bind(
+        vk::raii::CommandBuffer const &cmd,
+        vk::PipelineBindPoint bind_point,
+        vk::PipelineLayout layout,
+        uint32_t set_index
+    ) const;
+
+    vk::DescriptorSetLayout setLayout() const { return *set_layout; }
+    uint32_t capacity(BindlessKind kind) const { return slots[static_cast<uint32_t>(kind)].capacity; }
+
+private:
+    struct Slots {
+        uint32_t capacity = 0;
+        uint32_t next = 0;
+        std::vector<uint32_t> free;
+    };
+
+    // returns the retired slots to their free lists when destroyed
+    struct Released {
+        BindlessTable *table;
+        std::vector<std::pair<BindlessKind, uint32_t>> slots;
+
+        ~Released();
+    };
+
+    uint32_t allocate(BindlessKind kind);
+
+    vk::raii::Device const &device;
+    RetireCallback retire;
+
+    vk::raii::DescriptorSetLayout set_layout = nullptr;
+    vk::raii::DescriptorPool pool = nullptr;
+    vk::raii::DescriptorSet set = nullptr;
+
+    // guards the slot lists and descriptor writes, the set is externally
+    // synchronized for updates
+    std::mutex mutex;
+    std::array<Slots, 3> slots;
+    std::vector<std::pair<BindlessKind, uint32_t>> released;
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "TaskScheduler.h"
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <cstdint>
+#include <functional>
+#include <span>
+#include <vector>
+
+// Records part of a pass into a secondary command buffer. Nothing but the
+// attachments is inherited, so jobs bind their own pipeline and dynamic state
+using RecordJob = std::function<void(vk::raii::CommandBuffer const &cmd)>;
+
+// The dynamic rendering pass the secondaries continue, has to match the
+// primary's beginRendering
+struct SecondaryTarget {
+    std::vector<vk::Format> color_formats;
+    vk::Format depth_format = vk::Format::eUndefined;
+    vk::Format stencil_format = vk::Format::eUndefined;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+};
+
+// Records secondary command buffers as high priority scheduler tasks.
+// Command pools are externally synchronized, so every scheduler thread (plus
+// the render thread, which helps while it waits) owns one pool per frame in
+// flight and the whole pool is reset when its frame comes back around
+// instead of freeing buffers one by one.
+class CommandRecorder {
+public:
+    CommandRecorder(
+        vk::raii::Device const &device,
+        uint32_t queue_family,
+        uint32_t frame_count,
+        TaskScheduler &scheduler
+    );
+
+    CommandRecorder(CommandRecorder const &) = delete;
+    CommandRecorder &operator=(CommandRecorder const &) = delete;
+
+    // only call once the GPU has finished the frame that last used `frame`
+    void beginFrame(uint32_t frame);
+
+    // records every job into its own secondary buffer and blocks until all
+    // are done. The buffers come back in job order for executeCommands and
+    // stay valid until this frame slot is begun again. Render thread only
+    std::vector<vk::CommandBuffer> record(SecondaryTarget const &target, std::span<const RecordJob> jobs);
+
+private:
+    struct ThreadFrame {
+        vk::raii::CommandPool pool = nullptr;
+        std::vector<vk::raii::CommandBuffer> buffers;
+        uint32_t used = 0;
+    };
+
+    vk::raii::CommandBuffer const &nextBuffer(ThreadFrame &frame);
+
+    vk::raii::Device const &device;
+    TaskScheduler &scheduler;
+    uint32_t current_frame = 0;
+
+    // indexed [thread][frame] by the scheduler's worker index, only touched
+    // by that thread during a batch and by the render thread between batches.
+    // The extra slot is the thread calling record(), never another non-worker
+    std::vector<std::vector<ThreadFrame>> thread_frames;
+};
@@ -0,0 +1,88 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <filesystem>
+
+// ----- CONSTANTS
+// events kept per thread, older ones are overwritten
+constexpr uint32_t CPU_TRACE_CAPACITY = 1u << 14;
+
+struct CpuEvent {
+    const char *name = nullptr;
+    uint64_t begin_ns = 0;
+    uint64_t end_ns = 0;
+    uint64_t frame = 0;
+};
+
+// Fixed size event ring owned by one thread. Only the owner writes, readers
+// copy what they can see and drop anything the writer may have lapped while
+// they were copying, so recording never takes a lock or allocates. Slot
+// fields are relaxed atomics so a lapped copy is stale rather than a race,
+// the head re-check after the copy is what throws it away.
+class CpuTraceRing {
+public:
+    void push(CpuEvent const &event) {
+        const auto head = write_head.load(std::memory_order_relaxed);
+        // a reader that sees any of the stores below also sees the previous
+        // head, so it knows this slot is being rewritten
+        std::atomic_thread_fence(std::memory_order_release);
+        auto &slot = events[head % CPU_TRACE_CAPACITY];
+        slot.name.store(event.name, std::memory_order_relaxed);
+        slot.begin_ns.store(event.begin_ns, std::memory_order_relaxed);
+        slot.end_ns.store(event.end_ns, std::memory_order_relaxed);
+        slot.frame.store(event.frame, std::memory_order_relaxed);
+        write_head.store(head + 1, std::memory_order_release);
+    }
+
+    // copies up to CPU_TRACE_CAPACITY of the newest events in order,
+    // returns how many were written to `out`
+    uint32_t snapshot(CpuEvent *out) const;
+
+    // set by the owner, read by whoever dumps the trace
+    std::atomic<const char *> name = "thread";
+    uint32_t thread_id = 0;
+
+private:
+    struct Slot {
+        std::atomic<const char *> name = nullptr;
+        std::atomic<uint64_t> begin_ns = 0;
+        std::atomic<uint64_t> end_ns = 0;
+        std::atomic<uint64_t> frame = 0;
+    };
+
+    std::array<Slot, CPU_TRACE_CAPACITY> events;
+    std::atomic<uint64_t> write_head = 0;
+};
+
+// first call on a thread registers its ring, later calls are a TLS lookup
+CpuTraceRing &cpuTraceRing();
+
+// label the calling thread in exported traces, `name` must outlive the trace
+void cpuTraceThreadName(const char *name);
+
+// frame number stamped on events, set by the render thread
+void cpuTraceFrame(uint64_t frame);
+
+uint64_t cpuTraceNow();
+
+// Chrome trace / Perfetto JSON with every thread's retained events
+void writeChromeTrace(std::filesystem::path const &path);
+
+// Times its own lifetime, `name` has to be a string literal or otherwise
+// outlive the trace
+class CpuScope {
+public:
+    explicit CpuScope(const char *name) : name(name), begin_ns(cpuTraceNow()) {}
+
+    ~CpuScope();
+
+    CpuScope(CpuScope const &) = delete;
+    CpuScope &operator=(CpuScope const &) = delete;
+
+private:
+    const char *name;
+    uint64_t begin_ns;
+};
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// Optional capabilities the renderer turns on when a device has them
+enum class DeviceCapability : uint32_t {
+    eMeshShading       = 1u << 0, // VK_EXT_mesh_shader, task and mesh stages
+    ePresentWait       = 1u << 1, // VK_KHR_present_id + VK_KHR_present_wait
+    eSamplerAnisotropy = 1u << 2,
+    eTextureBC         = 1u << 3,
+    eTextureETC2       = 1u << 4,
+    eTextureASTC       = 1u << 5
+};
+
+// What the renderer needs and would like, decides suitability and score
+struct DeviceRequirements {
+    // null when headless, otherwise the graphics family has to present to it
+    vk::SurfaceKHR surface;
+    std::vector<const char *> extensions;
+    // looked up and reported through DeviceProfile::optional_extensions,
+    // bit i for optional_extensions[i]
+    std::vector<const char *> optional_extensions;
+    bool prefer_mesh_shading = false;
+    bool prefer_present_wait = false;
+};
+
+// Everything device selection learns about a GPU. Trivially copyable, the
+// chosen device's profile is written to disk as is so the next launch can
+// skip querying every device and go straight to device creation.
+struct DeviceProfile {
+    uint8_t device_uuid[vk::UuidSize] = {};
+    uint32_t driver_version = 0;
+    // 0 when the device lacks something the renderer needs
+    uint32_t score = 0;
+    vk::DeviceSize dedicated_memory = 0;
+
+    // graphics presents too, transfer and compute are the graphics family
+    // when there is no dedicated one
+    uint32_t queue_family = 0;
+    uint32_t transfer_family = 0;
+    uint32_t compute_family = 0;
+
+    uint32_t capabilities = 0;
+    uint32_t optional_extensions = 0;
+
+    bool has(DeviceCapability capability) const {
+        return (capabilities & static_cast<uint32_t>(capability)) != 0;
+    }
+    bool hasOptionalExtension(uint32_t index) const {
+        return (optional_extensions & (1u << index)) != 0;
+    }
+};
+
+// queries everything once and scores it, a score of 0 is unsuitable
+DeviceProfile profileDevice(vk::raii::PhysicalDevice const &device, DeviceRequirements const &requirements);
+
+// cheap check that a cached profile still describes `device` and that the
+// extensions it enables are still there under the same bits
+bool profileMatchesDevice(
+    DeviceProfile const &profile,
+    vk::raii::PhysicalDevice const &device,
+    DeviceRequirements const &requirements
+);
+
+// `selection_key` covers whatever changes which device wins, including the
+// number of devices, a stale key means selection starts over
+std::optional<DeviceProfile> loadDeviceProfile(std::filesystem::path const &path, uint64_t selection_key);
+
+void saveDeviceProfile(
+    std::filesystem::path const &path,
+    uint64_t selection_key,
+    DeviceProfile const &profile
+);
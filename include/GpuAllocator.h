@@ -0,0 +1,185 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <vector>
+
+// ----- CONSTANTS
+constexpr vk::DeviceSize GPU_BLOCK_SIZE = 256ull << 20;
+constexpr vk::DeviceSize GPU_HOST_BLOCK_SIZE = 64ull << 20;
+
+enum class MemoryUsage {
+    eGpuOnly,   // device local, never touched by the CPU
+    eUpload,    // host visible and coherent, written by the CPU
+    eReadback   // host visible, cached where possible, read by the CPU
+};
+
+class GpuAllocator;
+
+// Range inside one of the allocator's vk::DeviceMemory blocks
+struct GpuAllocation {
+    vk::DeviceMemory memory;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+
+    // host visible blocks stay mapped for their whole lifetime
+    void *mapped = nullptr;
+
+    uint32_t memory_type = 0;
+    uint32_t block_id = 0;
+};
+
+// Reported per memory heap, budget and usage come from VK_EXT_memory_budget
+// when it is enabled and are estimated from our own blocks otherwise
+struct HeapBudget {
+    vk::DeviceSize heap_size = 0;
+    vk::DeviceSize budget = 0;
+    vk::DeviceSize usage = 0;
+    vk::DeviceSize block_bytes = 0;
+    vk::DeviceSize allocated_bytes = 0;
+};
+
+// Buffer bound to allocator memory, returns it to the allocator when destroyed
+class GpuBuffer {
+public:
+    GpuBuffer(std::nullptr_t) {}
+    GpuBuffer(GpuBuffer &&other) noexcept;
+    GpuBuffer &operator=(GpuBuffer &&other) noexcept;
+    ~GpuBuffer();
+
+    vk::Buffer operator*() const { return *buffer; }
+
+    vk::raii::Buffer buffer = nullptr;
+    GpuAllocation allocation;
+
+private:
+    friend class GpuAllocator;
+
+    GpuAllocator *allocator = nullptr;
+};
+
+class GpuImage {
+public:
+    GpuImage(std::nullptr_t) {}
+    GpuImage(GpuImage &&other) noexcept;
+    GpuImage &operator=(GpuImage &&other) noexcept;
+    ~GpuImage();
+
+    vk::Image operator*() const { return *image; }
+
+    vk::raii::Image image = nullptr;
+    GpuAllocation allocation;
+
+private:
+    friend class GpuAllocator;
+
+    GpuAllocator *allocator = nullptr;
+};
+
+// Sub-allocates large per memory type blocks so resources never call
+// allocateMemory themselves. Buffers and optimal tiled images live in
+// separate blocks, which sidesteps bufferImageGranularity.
+class GpuAllocator {
+public:
+    GpuAllocator(
+        vk::raii::PhysicalDevice const &physical_device,
+        vk::raii::Device const &device,
+        bool memory_budget
+    );
+
+    GpuAllocator(GpuAllocator const &) = delete;
+    GpuAllocator &operator=(GpuAllocator const &) = delete;
+
+    GpuAllocation allocate(
+        vk::MemoryRequirements const &requirements,
+        MemoryUsage usage,
+        bool linear = true
+    );
+    void free(GpuAllocation const &allocation);
+
+    // makes GPU writes visible to mapped reads, a no-op on coherent memory
+    void invalidate(GpuAllocation const &allocation) const;
+
+    GpuBuffer createBuffer(vk::BufferCreateInfo const &info, MemoryUsage usage);
+    GpuImage createImage(vk::ImageCreateInfo const &info, MemoryUsage usage);
+
+    uint32_t findMemoryType(uint32_t type_bits, MemoryUsage usage) const;
+    std::vector<HeapBudget> getBudgets() const;
+
+private:
+    struct MemoryBlock {
+        vk::raii::DeviceMemory memory = nullptr;
+        vk::DeviceSize size = 0;
+        void *mapped = nullptr;
+        uint32_t memory_type = 0;
+        bool linear = true;
+        bool dedicated = false;
+
+        // offset -> size, kept coalesced
+        std::map<vk::DeviceSize, vk::DeviceSize> free_ranges;
+        vk::DeviceSize allocated = 0;
+    };
+
+    uint32_t createBlock(uint32_t memory_type, vk::DeviceSize size, bool linear, bool dedicated);
+    std::optional<vk::DeviceSize> suballocate(
+        MemoryBlock &block,
+        vk::DeviceSize size,
+        vk::DeviceSize alignment
+    );
+    vk::DeviceSize blockSizeFor(uint32_t memory_type) const;
+
+    vk::raii::PhysicalDevice const &physical_device;
+    vk::raii::Device const &device;
+    vk::PhysicalDeviceMemoryProperties memory_properties;
+    uint32_t max_allocations = 0;
+    vk::DeviceSize non_coherent_atom = 1;
+    bool memory_budget = false;
+
+    mutable std::mutex mutex;
+    // indexed by block_id, released dedicated blocks leave a null slot
+    std::vector<std::unique_ptr<MemoryBlock>> blocks;
+    uint32_t live_blocks = 0;
+};
+
+// Linear allocator over one host visible buffer, for transient data that is
+// thrown away all at once. Reset it only after the GPU is done reading.
+struct GpuBufferSlice {
+    vk::Buffer buffer;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = 0;
+    void *mapped = nullptr;
+};
+
+class GpuArena {
+public:
+    GpuArena(std::nullptr_t) {}
+    GpuArena(
+        GpuAllocator &allocator,
+        vk::DeviceSize capacity,
+        vk::BufferUsageFlags usage,
+        MemoryUsage memory_usage = MemoryUsage::eUpload
+    );
+
+    // empty when the arena is full
+    std::optional<GpuBufferSlice> allocate(vk::DeviceSize size, vk::DeviceSize alignment);
+    void reset();
+
+    vk::Buffer buffer() const { return *storage; }
+    vk::DeviceSize capacity() const { return size; }
+    vk::DeviceSize used() const { return head; }
+
+private:
+    GpuBuffer storage = nullptr;
+    vk::DeviceSize size = 0;
+    vk::DeviceSize head = 0;
+};
@@ -0,0 +1,119 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <array>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+// ----- CONSTANTS
+constexpr uint32_t GPU_PROFILER_MAX_SCOPES = 64;
+constexpr uint32_t GPU_PROFILER_HISTORY = 256;
+constexpr uint32_t GPU_PROFILER_NO_SCOPE = ~0u;
+
+// `sequence` counts every sample of the pass so far, it tells a new sample
+// from one already seen
+struct GpuSample {
+    double ms = 0.0;
+    uint64_t sequence = 0;
+};
+
+struct GpuPassStats {
+    std::string name;
+    double min_ms = 0.0;
+    double avg_ms = 0.0;
+    double p99_ms = 0.0;
+};
+
+// Brackets passes with timestamp queries, one query range per frame in
+// flight. A frame's results are read when its slot comes around again, by
+// which point the timeline wait has already proven they are written, so
+// reading never stalls and the numbers lag by frames_in_flight frames.
+class GpuProfiler {
+public:
+    GpuProfiler(std::nullptr_t) {}
+    GpuProfiler(
+        vk::raii::Device const &device,
+        vk::PhysicalDeviceLimits const &limits,
+        uint32_t timestamp_valid_bits,
+        uint32_t frame_count
+    );
+
+    // only call once the GPU has finished the frame that last used `frame`,
+    // collects its results and resets its queries into `cmd`
+    void beginFrame(vk::raii::CommandBuffer const &cmd, uint32_t frame);
+
+    // `name` has to outlive the frame, string literals are the intent
+    uint32_t begin(
+        vk::raii::CommandBuffer const &cmd,
+        const char *name,
+        vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eAllCommands
+    );
+    void end(
+        vk::raii::CommandBuffer const &cmd,
+        uint32_t scope,
+        vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eAllCommands
+    );
+
+    bool enabled() const { return static_cast<bool>(*pool); }
+
+    // rolling statistics in first seen order
+    std::vector<GpuPassStats> stats() const;
+    // newest sample of the pass, empty before its first one
+    std::optional<GpuSample> latest(const char *name) const;
+
+private:
+    struct FrameScopes {
+        std::vector<const char *> names;
+        uint32_t count = 0;
+    };
+
+    struct PassHistory {
+        std::string name;
+        std::array<double, GPU_PROFILER_HISTORY> samples_ms;
+        uint32_t count = 0;
+        uint32_t next = 0;
+        uint64_t total = 0;
+    };
+
+    void collect(uint32_t frame);
+    PassHistory &history(const char *name);
+
+    vk::raii::QueryPool pool = nullptr;
+    double period_ns = 1.0;
+    uint64_t valid_mask = ~0ull;
+
+    uint32_t current_frame = 0;
+    std::vector<FrameScopes> frames;
+    std::vector<PassHistory> passes;
+};
+
+// Records a scope for the lifetime of the object
+class GpuScope {
+public:
+    GpuScope(
+        GpuProfiler &profiler,
+        vk::raii::CommandBuffer const &cmd,
+        const char *name,
+        vk::PipelineStageFlags2 stage = vk::PipelineStageFlagBits2::eAllCommands
+    ) : profiler(profiler), cmd(cmd), stage(stage), scope(profiler.begin(cmd, name, stage)) {}
+
+    ~GpuScope() {
+        profiler.end(cmd, scope, stage);
+    }
+
+    GpuScope(GpuScope const &) = delete;
+    GpuScope &operator=(GpuScope const &) = delete;
+
+private:
+    GpuProfiler &profiler;
+    vk::raii::CommandBuffer const &cmd;
+    vk::PipelineStageFlags2 stage;
+    uint32_t scope;
+};
@@ -0,0 +1,282 @@
+#pragma once
+
+#include "BindlessTable.h"
+#include "GpuAllocator.h"
+#include "InstanceStore.h"
+#include "Mesh.h"
+#include "PipelineBuilder.h"
+#include "RenderGraph.h"
+#include "RingBuffer.h"
+#include "TaskScheduler.h"
+#include "TextureLoader.h"
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// ----- CONSTANTS
+constexpr vk::Format HIZ_FORMAT = vk::Format::eR32Sfloat;
+constexpr vk::Format SCENE_DEPTH_FORMAT = vk::Format::eD32Sfloat;
+// CULL and TASK group sizes are mirrored in shaders/scene.slang
+constexpr uint32_t CULL_GROUP_SIZE = 64;
+constexpr uint32_t HIZ_GROUP_SIZE = 8;
+constexpr uint32_t TASK_GROUP_SIZE = 32;
+constexpr uint32_t NO_SCENE_TEXTURE = ~0u;
+constexpr const char *SCENE_SHADER_PATH = "shaders/main.spv";
+constexpr const char *SCENE_MESH_SHADER_PATH = "shaders/main_mesh.spv";
+
+// Layouts shared with main.slang, std430
+struct GpuInstance {
+    glm::mat4 transform;
+    uint32_t mesh;
+    // bindless slots, BINDLESS_NONE draws the normals instead
+    uint32_t texture = BINDLESS_NONE;
+    uint32_t sampler = BINDLESS_NONE;
+    uint32_t pad;
+};
+static_assert(sizeof(GpuInstance) == 80);
+
+// bounds dequantize the packed positions and give the culling sphere, an
+// index count of zero marks a mesh that is still loading
+struct GpuMeshDraw {
+    glm::vec4 bounds_min;
+    glm::vec4 bounds_max;
+    uint32_t index_count;
+    // start of this mesh's region in the draw buffer, one slot per instance
+    uint32_t first_draw;
+    uint32_t meshlet_count;
+    uint32_t pad;
+};
+static_assert(sizeof(GpuMeshDraw) == 48);
+
+struct GpuCullConstants {
+    // the pyramid was built from the previous frame's depth, so occlusion
+    // is tested where the object was on screen back then
+    glm::mat4 prev_view_proj;
+    glm::vec4 planes[6];
+    glm::vec2 hiz_size;
+    uint32_t instance_count;
+    uint32_t hiz_levels;
+    uint32_t occlusion;
+    // write GpuTaskCommands for the mesh shading path instead
+    uint32_t task_draws;
+    uint32_t pad[2];
+};
+
+// what the cull pass writes per visible instance on the mesh shading path,
+// one task group per TASK_GROUP_SIZE meshlets
+struct GpuTaskCommand {
+    vk::DrawMeshTasksIndirectCommandEXT command;
+    uint32_t instance;
+};
+static_assert(sizeof(GpuTaskCommand) == 16);
+
+// task shaders cull meshlets against the same frustum, plus their normal cone
+struct GpuMeshletConstants {
+    glm::mat4 view_proj;
+    glm::vec4 planes[6];
+    glm::vec4 eye;
+};
+
+// Instances of streamed meshes, culled and drawn entirely on the GPU. A
+// compute pass tests every instance against the frustum and the previous
+// frame's Hi-Z pyramid and appends an indirect draw for each survivor into
+// its mesh's region, the main pass then issues one drawIndexedIndirectCount
+// per mesh, so CPU cost does not grow with the instance count.
+//
+// With mesh shading the survivors launch task shaders instead, which cull
+// each meshlet by its bounding sphere and normal cone before any vertex work.
+//
+// Given a scheduler the instances are culled on the CPU instead, from an
+// InstanceStore the workers update and test in SIMD chunks. Survivors are
+// packed by mesh into the frame ring with their draw commands, which suits
+// many instances that move every frame, at the cost of occlusion culling.
+//
+// The render graph only tracks images, the buffer barriers between the
+// cull, draw and upload work are recorded here.
+class GpuScene {
+public:
+    GpuScene(
+        vk::raii::Device const &device,
+        GpuAllocator &allocator,
+        PipelineBuilder &pipeline_builder,
+        RetireCallback retire,
+        bool mesh_shading,
+        TaskScheduler *cull_scheduler = nullptr
+    );
+
+    GpuScene(GpuScene const &) = delete;
+    GpuScene &operator=(GpuScene const &) = delete;
+
+    uint32_t addMesh(MeshHandle mesh);
+    // sampled through the bindless table once its first mips are resident
+    uint32_t addTexture(TextureHandle texture, uint32_t sampler);
+    // uniform scale only when culling on the CPU, a transform's largest
+    // axis scale is used
+    uint32_t addInstance(uint32_t mesh, glm::mat4 const &transform, uint32_t texture = NO_SCENE_TEXTURE);
+    // cheap when culling on the CPU, the GPU path copies the instance's row
+    // into its table with the next cull pass
+    void setTransform(uint32_t instance, glm::vec3 position, glm::quat rotation, float scale);
+
+    // sizes the pyramid for a depth buffer of `extent`, it is rebuilt
+    // before occlusion culling is used again
+    void resize(vk::Extent2D extent);
+
+    // once per frame before recording, picks up meshes that finished
+    // loading. False while there is nothing to cull yet
+    bool update();
+    // true once every mesh and every texture mip has finished streaming, or
+    // failed, and update() has built the tables that draw them
+    bool resident() const;
+
+    // graph image for the pyramid, read by the cull pass and written by the
+    // Hi-Z pass
+    RenderImage importHiZ(RenderGraph &graph);
+
+    // CPU culling only, nothing otherwise. After update() and before the
+    // draws are recorded, writes this frame's survivors into the frame ring
+    void cullOnCpu(FrameRingBuffer &frame_ring, glm::mat4 const &view_proj, bool task_draws);
+    // frame ring space the scene needs on top of everything else, for the
+    // table rows cull copies and the survivors cullOnCpu writes
+    vk::DeviceSize frameRingBytes() const;
+
+    // the three pass bodies, in frame order. `task_draws` picks which draw
+    // path the cull pass writes commands for. The draws cover meshes
+    // [first_mesh, end_mesh), so a pass can be split across secondaries
+    void cull(
+        vk::raii::CommandBuffer const &cmd,
+        FrameRingBuffer &frame_ring,
+        glm::mat4 const &view_proj,
+        bool task_draws
+    );
+    void draw(vk::raii::CommandBuffer const &cmd, vk::PipelineLayout layout, uint32_t first_mesh, uint32_t end_mesh) const;
+    void drawMeshlets(
+        vk::raii::CommandBuffer const &cmd,
+        vk::PipelineLayout layout,
+        GpuBufferSlice const &camera,
+        uint32_t first_mesh,
+        uint32_t end_mesh
+    ) const;
+    void buildHiZ(vk::raii::CommandBuffer const &cmd, vk::ImageView depth);
+
+    // hot reload, compiles replacements while the current pipelines keep
+    // running. Done once every replacement finished, good or not, or when
+    // nothing is reloading
+    void reloadPipelines(PipelineBuilder &pipeline_builder);
+    bool reloadDone() const;
+    // switches to the replacements and retires the old pipelines, nothing
+    // if none are pending. Rethrows a failed compile and keeps the old ones,
+    // either way the reload ends
+    void swapPipelines();
+
+    // written on the render thread, the meshlet draws record on workers
+    static GpuBufferSlice meshletConstants(FrameRingBuffer &frame_ring, glm::mat4 const &view_proj, glm::vec3 eye);
+
+    // set layouts the draw pipelines push the scene tables into, the mesh
+    // one only exists with mesh shading
+    vk::DescriptorSetLayout drawSetLayout() const { return *draw_set_layout; }
+    vk::DescriptorSetLayout meshSetLayout() const { return *mesh_set_layout; }
+
+    uint32_t instanceCount() const { return static_cast<uint32_t>(instances.size()); }
+    uint32_t meshCount() const { return static_cast<uint32_t>(meshes.size()); }
+
+private:
+    // GPU copies of the scene, only reallocated when an instance or mesh is
+    // added. Everything else copies the rows that changed
+    struct Tables {
+        GpuBuffer instances = nullptr;
+        GpuBuffer meshes = nullptr;
+        GpuBuffer draws = nullptr;
+        GpuBuffer counts = nullptr;
+    };
+
+    struct HiZ {
+        GpuImage image = nullptr;
+        vk::raii::ImageView view = nullptr;
+        std::vector<vk::raii::ImageView> levels;
+        std::vector<vk::Extent2D> extents;
+        vk::Extent2D depth_extent;
+    };
+
+    // survivors of the last cullOnCpu, in each mesh's draw range
+    struct CpuDraws {
+        GpuBufferSlice instances;
+        GpuBufferSlice draws;
+        std::vector<uint32_t> counts;
+    };
+
+    // [first, end) of a table's rows that changed since the last copy
+    struct DirtyRange {
+        uint32_t first = ~0u;
+        uint32_t end = 0;
+
+        void add(uint32_t row) {
+            first = std::min(first, row);
+            end = std::max(end, row + 1);
+        }
+        bool empty() const { return first >= end; }
+    };
+
+    void rebuildTables();
+    // applies meshes and mips that arrived since the last frame to the rows
+    // they affect
+    void refreshTables();
+
+    vk::raii::Device const &device;
+    GpuAllocator &allocator;
+    RetireCallback retire;
+    // shader stages that read the scene tables while drawing
+    vk::PipelineStageFlags2 draw_stages = vk::PipelineStageFlagBits2::eVertexShader;
+
+    vk::raii::DescriptorSetLayout cull_set_layout = nullptr;
+    vk::raii::DescriptorSetLayout hiz_set_layout = nullptr;
+    vk::raii::DescriptorSetLayout draw_set_layout = nullptr;
+    vk::raii::DescriptorSetLayout mesh_set_layout = nullptr;
+    vk::raii::PipelineLayout cull_layout = nullptr;
+    vk::raii::PipelineLayout hiz_layout = nullptr;
+    PipelineHandle cull_pipeline;
+    PipelineHandle hiz_pipeline;
+    // empty unless a reload is compiling
+    PipelineHandle next_cull_pipeline;
+    PipelineHandle next_hiz_pipeline;
+
+    std::vector<MeshHandle> meshes;
+    // meshes that were ready when the tables were last built
+    std::vector<bool> drawable;
+    std::vector<GpuMeshDraw> mesh_draws;
+    std::vector<GpuInstance> instances;
+    std::vector<uint32_t> mesh_instances;
+
+    struct SceneTexture {
+        TextureHandle texture;
+        uint32_t sampler;
+        // slot the tables were built with, moves as finer mips arrive
+        uint32_t slot = BINDLESS_NONE;
+        // the instances sampling it, their rows follow the slot
+        std::vector<uint32_t> instances;
+    };
+    std::vector<SceneTexture> textures;
+    std::vector<uint32_t> instance_textures;
+
+    std::shared_ptr<Tables> tables;
+    // an instance or mesh was added since the tables were allocated
+    bool resized = false;
+    // rows the next cull pass copies into the tables through the frame ring
+    DirtyRange dirty_instances;
+    DirtyRange dirty_meshes;
+
+    // set when culling on the CPU
+    TaskScheduler *cull_scheduler = nullptr;
+    std::unique_ptr<InstanceStore> cpu_instances;
+    CpuDraws cpu_draws;
+    // where each chunk writes its next survivor of every mesh
+    std::vector<uint32_t> chunk_offsets;
+
+    std::shared_ptr<HiZ> hiz;
+    // the pyramid holds last frame's depth once the Hi-Z pass has run
+    bool hiz_valid = false;
+    glm::mat4 frame_view_proj = glm::mat4(1.0f);
+    glm::mat4 hiz_view_proj = glm::mat4(1.0f);
+};
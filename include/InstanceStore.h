@@ -0,0 +1,76 @@
+#pragma once
+
+#include "TaskScheduler.h"
+#include <cstdint>
+#include <span>
+#include <vector>
+#include <glm/glm.hpp>
+#include <glm/gtc/quaternion.hpp>
+
+// ----- CONSTANTS
+constexpr uint32_t INSTANCE_SIMD_WIDTH = 4;
+// instances per scheduler task, a multiple of the SIMD width
+constexpr uint32_t INSTANCE_CHUNK_SIZE = 1024;
+
+// Transforms and bounds of many instances as structure of arrays, so the
+// world matrix update and the frustum test run four instances per SIMD
+// instruction (SSE2 or NEON, scalar elsewhere) in chunks spread over the
+// scheduler's workers.
+//
+// Every instance belongs to a group, the cull counts survivors per group and
+// chunk so callers can compact them into per group ranges in parallel.
+// Scale is uniform, the same assumption the shaders make for normals.
+class InstanceStore {
+public:
+    explicit InstanceStore(TaskScheduler &scheduler) : scheduler(scheduler) {}
+
+    InstanceStore(InstanceStore const &) = delete;
+    InstanceStore &operator=(InstanceStore const &) = delete;
+
+    // `sphere` is the local bounding sphere, xyz center and w radius
+    uint32_t add(uint32_t group, glm::vec3 position, glm::quat rotation, float scale, glm::vec4 sphere);
+    void setTransform(uint32_t index, glm::vec3 position, glm::quat rotation, float scale);
+    void setSphere(uint32_t index, glm::vec4 sphere);
+
+    // world matrices and spheres of every instance, skipped when nothing
+    // moved since the last call
+    void update();
+    // tests the world spheres from the last update against the planes, a
+    // point is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+    void cull(glm::vec4 const (&planes)[6]);
+
+    uint32_t size() const { return count; }
+    uint32_t groupCount() const { return group_count; }
+    uint32_t chunkCount() const { return (count + INSTANCE_CHUNK_SIZE - 1) / INSTANCE_CHUNK_SIZE; }
+
+    uint32_t group(uint32_t index) const { return groups[index]; }
+    glm::mat4 const &world(uint32_t index) const { return worlds[index]; }
+    bool visible(uint32_t index) const { return visibility[index] != 0; }
+    // survivors of the last cull among the chunk's instances, one per group
+    std::span<const uint32_t> chunkVisible(uint32_t chunk) const {
+        return {chunk_visible.data() + size_t(chunk) * group_count, group_count};
+    }
+
+private:
+    void updateRange(uint32_t begin, uint32_t end);
+    void cullRange(uint32_t begin, uint32_t end, glm::vec4 const (&planes)[6]);
+
+    TaskScheduler &scheduler;
+    uint32_t count = 0;
+    uint32_t group_count = 0;
+    bool moved = false;
+
+    // inputs, padded to the SIMD width. Padding lanes have zero scale and
+    // radius and are never reported
+    std::vector<float> position_x, position_y, position_z;
+    std::vector<float> rotation_x, rotation_y, rotation_z, rotation_w;
+    std::vector<float> scale;
+    std::vector<float> sphere_x, sphere_y, sphere_z, sphere_radius;
+    std::vector<uint32_t> groups;
+
+    // outputs
+    std::vector<glm::mat4> worlds;
+    std::vector<float> world_x, world_y, world_z, world_radius;
+    std::vector<uint8_t> visibility;
+    std::vector<uint32_t> chunk_visible;
+};
@@ -0,0 +1,64 @@
+#pragma once
+
+#include "GpuAllocator.h"
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+struct Vertex {
+    glm::vec3 position;
+    glm::vec3 normal;
+    glm::vec2 uv;
+
+    bool operator==(Vertex const &other) const = default;
+
+    static vk::VertexInputBindingDescription getBindingDescription();
+    static std::array<vk::VertexInputAttributeDescription, 3> getAttributeDescriptions();
+};
+
+struct VertexHash {
+    size_t operator()(Vertex const &vertex) const;
+};
+
+// CPU side geometry, as produced by the importers
+struct MeshData {
+    std::vector<Vertex> vertices;
+    std::vector<uint32_t> indices;
+};
+
+enum class MeshState {
+    eLoading,   // being parsed on a worker
+    eUploading, // copies submitted on the transfer queue
+    eReady,     // acquired by the graphics queue, safe to draw
+    eFailed
+};
+
+// Device local mesh in the packed cache layout, only touch the buffers once
+// the state is eReady
+struct Mesh {
+    std::filesystem::path path;
+
+    // PackedVertex stream, positions are quantized inside the bounds
+    GpuBuffer vertex_buffer = nullptr;
+    GpuBuffer index_buffer = nullptr;
+    uint32_t index_count = 0;
+    vk::IndexType index_type = vk::IndexType::eUint32;
+    glm::vec3 bounds_min = glm::vec3(0.0f);
+    glm::vec3 bounds_max = glm::vec3(0.0f);
+
+    GpuBuffer meshlet_buffer = nullptr;
+    GpuBuffer meshlet_vertex_buffer = nullptr;
+    GpuBuffer meshlet_triangle_buffer = nullptr;
+    uint32_t meshlet_count = 0;
+
+    std::atomic<MeshState> state = MeshState::eLoading;
+    std::string error;
+};
+
+using MeshHandle = std::shared_ptr<Mesh>;
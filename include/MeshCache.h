@@ -0,0 +1,122 @@
+#pragma once
+
+#include "Mesh.h"
+#include <cstddef>
+#include <cstdint>
+#include <filesystem>
+#include <optional>
+#include <vector>
+
+// ----- CONSTANTS
+constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+constexpr const char *MESH_CACHE_EXTENSION = ".meshbin";
+
+// 16 byte vertex stored in the cache. Positions are unorm16 inside the mesh
+// bounds, normals are octahedral snorm16 and uvs are half floats. Shaders
+// rebuild the position with bounds_min + position * (bounds_max - bounds_min)
+struct PackedVertex {
+    uint16_t position[4];
+    int16_t normal[2];
+    uint16_t uv[2];
+
+    static vk::VertexInputBindingDescription getBindingDescription();
+    static std::array<vk::VertexInputAttributeDescription, 3> getAttributeDescriptions();
+};
+static_assert(sizeof(PackedVertex) == 16);
+
+// Cluster of at most 64 vertices and 124 triangles, laid out for std430.
+// Triangles are local 8 bit indices into the meshlet's vertex list.
+struct Meshlet {
+    uint32_t vertex_offset;
+    uint32_t triangle_offset;
+    uint32_t vertex_count;
+    uint32_t triangle_count;
+
+    // bounding sphere, xyz center and w radius
+    glm::vec4 sphere;
+    // backface cone, the meshlet is hidden when
+    // dot(normalize(apex - eye), axis) >= cutoff
+    glm::vec4 cone_apex;
+    glm::vec4 cone_axis_cutoff;
+};
+static_assert(sizeof(Meshlet) == 64);
+
+// Every section offset is from the start of the file and 16 byte aligned
+struct MeshCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t source_hash;
+    uint64_t source_size;
+    uint64_t file_size;
+
+    float bounds_min[4];
+    float bounds_max[4];
+
+    uint32_t vertex_count;
+    uint32_t index_count;
+    uint32_t index_size;
+    uint32_t meshlet_count;
+    uint32_t meshlet_vertex_count;
+    uint32_t meshlet_triangle_bytes;
+
+    uint64_t vertex_offset;
+    uint64_t index_offset;
+    uint64_t meshlet_offset;
+    uint64_t meshlet_vertex_offset;
+    uint64_t meshlet_triangle_offset;
+};
+
+// Read only memory mapping of a whole file
+class MappedFile {
+public:
+    MappedFile() = default;
+    explicit MappedFile(std::filesystem::path const &path);
+    ~MappedFile();
+
+    MappedFile(MappedFile &&other) noexcept;
+    MappedFile &operator=(MappedFile &&other) noexcept;
+
+    const std::byte *data() const { return bytes; }
+    size_t size() const { return length; }
+    explicit operator bool() const { return bytes != nullptr; }
+
+private:
+    void close();
+
+    const std::byte *bytes = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void *file_handle = nullptr;
+    void *mapping_handle = nullptr;
+#endif
+};
+
+// Validated view into a cache blob, does not own the memory
+struct MeshCacheView {
+    const std::byte *base = nullptr;
+    MeshCacheHeader header;
+
+    const std::byte *section(uint64_t offset) const { return base + offset; }
+};
+
+uint64_t hashBytes(const std::byte *data, size_t size);
+
+// reads a file into the OS page cache so mapping it later doesn't wait on
+// the disk, a missing file is ignored
+void prefetchFile(std::filesystem::path const &path);
+
+std::filesystem::path meshCachePath(std::filesystem::path const &source);
+
+std::vector<std::byte> encodeMeshCache(MeshData const &data, uint64_t source_hash, uint64_t source_size);
+
+// written to a temp file first, then renamed over the old cache
+void writeMeshCache(std::filesystem::path const &path, std::vector<std::byte> const &blob);
+
+// empty if the blob is truncated, from an older version or a different source
+std::optional<MeshCacheView> viewMeshCache(
+    const std::byte *data,
+    size_t size,
+    uint64_t source_hash,
+    uint64_t source_size
+);
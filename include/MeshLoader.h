@@ -0,0 +1,50 @@
+#pragma once
+
+#include "GpuAllocator.h"
+#include "Mesh.h"
+#include "MeshCache.h"
+#include "TaskScheduler.h"
+#include "UploadQueue.h"
+#include <atomic>
+#include <filesystem>
+
+// Parses OBJ or glTF/GLB into deduplicated, indexed geometry
+MeshData parseMesh(std::filesystem::path const &path);
+
+// Imports meshes as low priority scheduler tasks and streams them into device local
+// buffers through the upload queue. Parsed sources are stored next to the
+// source as a binary cache, later loads map it and copy it straight into
+// staging memory. load() returns straight away, the mesh becomes drawable
+// once the render thread has acquired it.
+class MeshLoader {
+public:
+    MeshLoader(
+        vk::raii::Device const &device,
+        GpuAllocator &allocator,
+        UploadQueue &upload_queue,
+        TaskScheduler &scheduler,
+        vk::PipelineStageFlags2 shader_stages
+    );
+    ~MeshLoader();
+
+    MeshLoader(MeshLoader const &) = delete;
+    MeshLoader &operator=(MeshLoader const &) = delete;
+
+    MeshHandle load(std::filesystem::path path);
+
+private:
+    void loadMesh(MeshHandle const &mesh);
+    void upload(MeshHandle const &mesh, MeshCacheView const &view, UploadContext &context);
+
+    vk::raii::Device const &device;
+    GpuAllocator &allocator;
+    UploadQueue &upload_queue;
+    TaskScheduler &scheduler;
+    // every shader stage that reads mesh buffers, the acquire waits for them
+    vk::PipelineStageFlags2 shader_stages;
+    UploadContextPool contexts;
+
+    // loads that have not started yet are failed instead
+    std::atomic<bool> stopping = false;
+    TaskCounterPtr outstanding = std::make_shared<TaskCounter>();
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include "TaskScheduler.h"
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+std::vector<char> readFile(const std::string &filename);
+vk::raii::ShaderModule createShaderModule(vk::raii::Device const &device, std::vector<char> const &code);
+
+using ShaderCode = std::shared_ptr<const std::vector<char>>;
+
+// SPIR-V files read once and shared by every recipe that uses them, so
+// pipelines compiling side by side don't each go to the disk. Any thread
+class ShaderLibrary {
+public:
+    explicit ShaderLibrary(TaskScheduler &scheduler);
+
+    ShaderLibrary(ShaderLibrary const &) = delete;
+    ShaderLibrary &operator=(ShaderLibrary const &) = delete;
+
+    // starts reading on a worker, before the device exists if need be
+    void prefetch(std::string const &path);
+
+    // waits for a prefetch still reading `path`, reads it here on a miss.
+    // Throws if the file can't be read
+    ShaderCode get(std::string const &path);
+
+    // hot reload, later get() calls see `code`. Pipelines already built
+    // keep the modules they were made from
+    void replace(std::string const &path, ShaderCode code);
+
+private:
+    struct Entry {
+        TaskCounterPtr loaded = std::make_shared<TaskCounter>();
+        ShaderCode code;
+        std::exception_ptr error;
+    };
+
+    TaskScheduler &scheduler;
+
+    std::mutex mutex;
+    std::map<std::string, std::shared_ptr<Entry>> entries;
+};
+
+// Builds a pipeline on a scheduler worker. Everything the create info points at
+// must be owned by the recipe, since the caller's stack is long gone.
+using PipelineRecipe = std::function<vk::raii::Pipeline(
+    vk::raii::Device const &device,
+    vk::raii::PipelineCache const &cache
+)>;
+
+struct PipelineJob {
+    PipelineRecipe recipe;
+    vk::raii::Pipeline pipeline = nullptr;
+    std::exception_ptr error;
+    std::atomic<bool> done = false;
+};
+
+// Render thread side of a pipeline compile, cheap to poll every frame
+class PipelineHandle {
+public:
+    // nothing was ever built into this handle
+    bool empty() const { return !job; }
+    bool ready() const;
+    // finished, but with an error get() would rethrow
+    bool failed() const;
+
+    // null until compilation finishes, rethrows if compilation failed
+    vk::Pipeline get() const;
+
+private:
+    friend class PipelineBuilder;
+
+    std::shared_ptr<PipelineJob> job;
+};
+
+// Compiles pipelines as low priority scheduler tasks
+class PipelineBuilder {
+public:
+    PipelineBuilder(
+        vk::raii::Device const &device,
+        vk::raii::PipelineCache const &cache,
+        TaskScheduler &scheduler,
+        ShaderLibrary &shaders
+    );
+    ~PipelineBuilder();
+
+    PipelineBuilder(PipelineBuilder const &) = delete;
+    PipelineBuilder &operator=(PipelineBuilder const &) = delete;
+
+    PipelineHandle build(PipelineRecipe recipe);
+
+    // block until every queued pipeline has been compiled
+    void waitIdle();
+
+    // where recipes get their SPIR-V, it outlives the builder
+    ShaderLibrary &shaders() const { return shader_library; }
+
+private:
+    void compile(PipelineJob &job);
+
+    vk::raii::Device const &device;
+    vk::raii::PipelineCache const &cache;
+    TaskScheduler &scheduler;
+    ShaderLibrary &shader_library;
+
+    // queued jobs that start after this is set fail instead of compiling
+    std::atomic<bool> stopping = false;
+    TaskCounterPtr outstanding = std::make_shared<TaskCounter>();
+};
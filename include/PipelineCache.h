@@ -0,0 +1,47 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <cstdint>
+#include <filesystem>
+#include <vector>
+
+// Written in front of the driver blob. A blob is only handed back to the
+// driver when every field matches the device it is being loaded on.
+struct PipelineCacheHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t vendor_id;
+    uint32_t device_id;
+    uint32_t driver_version;
+    uint8_t  cache_uuid[vk::UuidSize];
+    uint64_t data_size;
+    uint64_t data_hash;
+};
+
+// Whole file as stored, empty if it is missing. Needs no device, so it can
+// be read while the device is still being created
+std::vector<uint8_t> readPipelineCacheFile(std::filesystem::path const &path);
+
+// Returns the blob inside a file read by readPipelineCacheFile, or an empty
+// blob if it is stale
+std::vector<uint8_t> parsePipelineCache(
+    std::vector<uint8_t> const &file,
+    vk::PhysicalDeviceProperties const &properties
+);
+
+// Returns the stored blob, or an empty blob if it is missing or stale
+std::vector<uint8_t> loadPipelineCache(
+    std::filesystem::path const &path,
+    vk::PhysicalDeviceProperties const &properties
+);
+
+void savePipelineCache(
+    std::filesystem::path const &path,
+    vk::PhysicalDeviceProperties const &properties,
+    vk::raii::PipelineCache const &cache
+);
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+
+// Moves a resource between queue families. The release half is recorded on
+// the source queue and the acquire half on the destination queue, with a
+// semaphore ordering the two submissions. When both families match the
+// release is a no-op and the acquire records a plain barrier.
+struct BufferOwnershipTransfer {
+    vk::Buffer buffer;
+    vk::DeviceSize offset = 0;
+    vk::DeviceSize size = vk::WholeSize;
+    uint32_t src_family = vk::QueueFamilyIgnored;
+    uint32_t dst_family = vk::QueueFamilyIgnored;
+    vk::PipelineStageFlags2 src_stage;
+    vk::AccessFlags2 src_access;
+    vk::PipelineStageFlags2 dst_stage;
+    vk::AccessFlags2 dst_access;
+};
+
+struct ImageOwnershipTransfer {
+    vk::Image image;
+    vk::ImageSubresourceRange range = {vk::ImageAspectFlagBits::eColor, 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers};
+    vk::ImageLayout old_layout = vk::ImageLayout::eUndefined;
+    vk::ImageLayout new_layout = vk::ImageLayout::eUndefined;
+    uint32_t src_family = vk::QueueFamilyIgnored;
+    uint32_t dst_family = vk::QueueFamilyIgnored;
+    vk::PipelineStageFlags2 src_stage;
+    vk::AccessFlags2 src_access;
+    vk::PipelineStageFlags2 dst_stage;
+    vk::AccessFlags2 dst_access;
+};
+
+void releaseOwnership(vk::raii::CommandBuffer const &cmd, BufferOwnershipTransfer const &transfer);
+void acquireOwnership(vk::raii::CommandBuffer const &cmd, BufferOwnershipTransfer const &transfer);
+
+void releaseOwnership(vk::raii::CommandBuffer const &cmd, ImageOwnershipTransfer const &transfer);
+void acquireOwnership(vk::raii::CommandBuffer const &cmd, ImageOwnershipTransfer const &transfer);
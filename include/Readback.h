@@ -0,0 +1,109 @@
+#pragma once
+
+#include "GpuAllocator.h"
+#include <cstdint>
+#include <functional>
+#include <utility>
+#include <vector>
+
+enum class ReadbackTarget {
+    eHostMemory, // mapped buffer, the sink reads `data`
+    eOpaqueFd,   // exported device memory, importable by other Vulkan/GL devices
+    eDmaBuf      // exported device memory as a dma-buf, for VA-API, V4L2 or DRM
+};
+
+// Finished frame, only valid for the duration of the sink call. Exported
+// frames have no `data`, the sink imports `fd` instead and has to dup() it
+// if the consumer takes ownership. Either way the slot is reused
+// frames_in_flight frames later, so consumers must be done with it by then.
+struct ReadbackFrame {
+    const void *data = nullptr;
+    int fd = -1;
+    vk::DeviceSize size = 0;
+    vk::Extent2D extent;
+    vk::Format format = vk::Format::eUndefined;
+    uint32_t row_pitch = 0;
+    uint64_t frame = 0;
+};
+
+using ReadbackSink = std::function<void(ReadbackFrame const &)>;
+
+// whether the readback buffers can be exported as `target`. Having the
+// extensions enabled is not enough, the driver has to report the handle
+// type exportable for a transfer dst buffer
+bool canExportReadback(vk::raii::PhysicalDevice const &physical_device, ReadbackTarget target);
+
+// One linear buffer per frame in flight. The copy for a frame is recorded
+// into its own command buffer and handed to the sink when the frame slot
+// comes around again, so the consumer works on frame N while N+1 renders
+// and never waits on a copy that was just submitted. Exported slots never
+// touch the CPU, the GPU copy is the only one.
+class ReadbackPool {
+public:
+    ReadbackPool(std::nullptr_t) {}
+    ReadbackPool(
+        GpuAllocator &allocator,
+        vk::raii::Device const &device,
+        vk::Extent2D extent,
+        vk::Format format,
+        uint32_t texel_size,
+        uint32_t frame_count,
+        ReadbackTarget target = ReadbackTarget::eHostMemory
+    );
+
+    // only call once the GPU has finished the frame that last used `frame`
+    void collect(uint32_t frame, ReadbackSink const &sink);
+
+    // `image` has to be in TransferSrcOptimal with its writes made visible
+    // to the copy stage
+    void record(
+        vk::raii::CommandBuffer const &cmd,
+        uint32_t frame,
+        vk::Image image,
+        uint64_t frame_number
+    );
+
+    // hands over every pending frame, call after the device is idle
+    void drain(ReadbackSink const &sink);
+
+    ReadbackTarget target() const { return readback_target; }
+
+private:
+    // closes the exported handle together with the pool
+    struct ExportedFd {
+        int fd = -1;
+
+        ExportedFd() = default;
+        explicit ExportedFd(int fd) : fd(fd) {}
+        ExportedFd(ExportedFd &&other) noexcept : fd(std::exchange(other.fd, -1)) {}
+        ExportedFd &operator=(ExportedFd &&other) noexcept;
+        ~ExportedFd() { reset(); }
+
+        void reset();
+    };
+
+    struct Slot {
+        GpuBuffer buffer = nullptr;
+
+        // exported slots own a dedicated allocation so the consumer imports
+        // exactly one resource at offset 0
+        vk::raii::Buffer exported_buffer = nullptr;
+        vk::raii::DeviceMemory exported_memory = nullptr;
+        vk::DeviceSize exported_size = 0;
+        ExportedFd fd;
+
+        uint64_t frame = 0;
+        bool pending = false;
+
+        vk::Buffer handle() const { return *exported_buffer ? *exported_buffer : *buffer; }
+    };
+
+    void createExported(Slot &slot, vk::raii::Device const &device, vk::DeviceSize size);
+
+    GpuAllocator *allocator = nullptr;
+    ReadbackTarget readback_target = ReadbackTarget::eHostMemory;
+    vk::Extent2D extent;
+    vk::Format format = vk::Format::eUndefined;
+    uint32_t row_pitch = 0;
+    std::vector<Slot> slots;
+};
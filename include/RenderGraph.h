@@ -0,0 +1,177 @@
+#pragma once
+
+#include "GpuAllocator.h"
+#include "GpuProfiler.h"
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+using RenderImage = uint32_t;
+
+// How a pass touches an image, each maps to one layout, stage and access
+enum class ImageUsage {
+    eColorAttachment,
+    eDepthAttachment,
+    eDepthRead,
+    eSampled,
+    eStorageRead,
+    eStorageWrite,
+    eTransferSrc,
+    eTransferDst
+};
+
+struct ImageState {
+    vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+    vk::PipelineStageFlags2 stage;
+    vk::AccessFlags2 access;
+};
+
+struct TransientImageDesc {
+    vk::Format format = vk::Format::eUndefined;
+    vk::Extent2D extent;
+    vk::ImageUsageFlags usage;
+    vk::SampleCountFlagBits samples = vk::SampleCountFlagBits::e1;
+
+    bool operator==(TransientImageDesc const &) const = default;
+};
+
+struct ImageAccess {
+    RenderImage image;
+    ImageUsage usage;
+};
+
+using PassExecute = std::function<void(vk::raii::CommandBuffer const &cmd)>;
+
+// receives resources the GPU may still be using, to be destroyed later
+using RetireCallback = std::function<void(std::shared_ptr<void>)>;
+
+// Rebuilt every frame. Passes declare the images they read and write, the
+// graph drops passes that do not lead to an output, places the barriers and
+// layout transitions between them, and backs transient images with memory
+// shared between images whose lifetimes do not overlap.
+class RenderGraph {
+public:
+    RenderGraph(vk::raii::Device const &device, GpuAllocator &allocator, RetireCallback retire);
+
+    RenderGraph(RenderGraph const &) = delete;
+    RenderGraph &operator=(RenderGraph const &) = delete;
+
+    // starts describing the next frame, the previous frame's passes and
+    // imports are dropped but transient memory is kept while it still fits
+    void reset();
+
+    // `initial` is what happened to the image before the graph. A final
+    // layout other than undefined makes it an output, which is what keeps
+    // passes alive
+    RenderImage importImage(
+        const char *name,
+        vk::Image image,
+        vk::ImageView view,
+        vk::Format format,
+        vk::Extent2D extent,
+        ImageState initial,
+        vk::ImageLayout final_layout = vk::ImageLayout::eUndefined
+    );
+    RenderImage createImage(const char *name, TransientImageDesc const &desc);
+
+    // `name` has to outlive the frame, it labels the pass's GPU timings.
+    // Passes with side effects outside the graph, like a readback, are
+    // never culled
+    void addPass(
+        const char *name,
+        std::vector<ImageAccess> accesses,
+        PassExecute execute,
+        bool side_effects = false
+    );
+
+    // culls, allocates transients and records every live pass into `cmd`
+    void execute(vk::raii::CommandBuffer const &cmd, GpuProfiler *profiler = nullptr);
+
+    // only valid for transients once execute has started
+    vk::Image image(RenderImage image) const { return images[image].image; }
+    vk::ImageView view(RenderImage image) const { return images[image].view; }
+    vk::Extent2D extent(RenderImage image) const { return images[image].extent; }
+
+    uint32_t culledPasses() const { return culled_passes; }
+    uint32_t barrierCount() const { return barrier_count; }
+
+private:
+    static constexpr uint32_t NO_PASS = ~0u;
+
+    struct ImageNode {
+        const char *name = nullptr;
+        vk::Image image;
+        vk::ImageView view;
+        vk::Format format = vk::Format::eUndefined;
+        vk::Extent2D extent;
+        ImageState initial;
+        vk::ImageLayout final_layout = vk::ImageLayout::eUndefined;
+
+        bool transient = false;
+        uint32_t transient_index = 0;
+        TransientImageDesc desc;
+        uint32_t first_pass = NO_PASS;
+        uint32_t last_pass = NO_PASS;
+    };
+
+    struct Pass {
+        const char *name = nullptr;
+        std::vector<ImageAccess> accesses;
+        PassExecute execute;
+        bool side_effects = false;
+        bool alive = false;
+    };
+
+    struct TransientImage {
+        vk::raii::Image image = nullptr;
+        vk::raii::ImageView view = nullptr;
+        uint32_t slot = 0;
+    };
+
+    // one allocation shared by every transient image placed in it
+    struct MemorySlot {
+        GpuAllocation allocation;
+        vk::MemoryRequirements requirements;
+        uint32_t last_pass = 0;
+        // stages of the last image placed here, the next frame's first
+        // image in the slot waits on them before it reuses the memory
+        vk::PipelineStageFlags2 tail_stage;
+        // and the writes they made, flushed by that same barrier
+        vk::AccessFlags2 tail_write;
+    };
+
+    // everything backing one transient layout, retired as a whole
+    struct TransientSet {
+        GpuAllocator *allocator = nullptr;
+        std::vector<MemorySlot> slots;
+        std::vector<TransientImage> images;
+
+        ~TransientSet();
+    };
+
+    struct Signature {
+        TransientImageDesc desc;
+        uint32_t first_pass;
+        uint32_t last_pass;
+
+        bool operator==(Signature const &) const = default;
+    };
+
+    void cull();
+    void allocateTransients();
+    void recordBarriers(vk::raii::CommandBuffer const &cmd, std::vector<vk::ImageMemoryBarrier2> &barriers);
+
+    vk::raii::Device const &device;
+    GpuAllocator &allocator;
+    RetireCallback retire;
+
+    std::vector<ImageNode> images;
+    std::vector<Pass> passes;
+
+    std::vector<Signature> signature;
+    std::shared_ptr<TransientSet> transients;
+
+    uint32_t culled_passes = 0;
+    uint32_t barrier_count = 0;
+};
@@ -1,5 +1,23 @@
 #pragma once
 
+#include "BindlessTable.h"
+#include "CommandRecorder.h"
+#include "CpuProfiler.h"
+#include "DeviceProfile.h"
+#include "GpuAllocator.h"
+#include "GpuProfiler.h"
+#include "GpuScene.h"
+#include "MeshLoader.h"
+#include "PipelineBuilder.h"
+#include "Readback.h"
+#include "ResolutionScaler.h"
+#include "RenderGraph.h"
+#include "RingBuffer.h"
+#include "ShaderPermutation.h"
+#include "ShaderReloader.h"
+#include "TaskScheduler.h"
+#include "TextureLoader.h"
+#include "UploadQueue.h"
 #include "vulkan/vulkan.hpp"
 #if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
 #include <vulkan/vulkan_raii.hpp>
@@ -8,44 +26,284 @@ import vulkan_hpp;
 #endif
 #define GLFW_INCLUDE_VULKAN
 #include <GLFW/glfw3.h>
+#include <deque>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include <glm/glm.hpp>
 
 // ----- CONSTANTS
 constexpr uint32_t HEIGHT = 1000;
 constexpr uint32_t WIDTH = 1000;
+constexpr uint32_t DEFAULT_FRAMES_IN_FLIGHT = 2;
+constexpr vk::DeviceSize FRAME_RING_SIZE = 4ull << 20;
+constexpr double PROFILER_REPORT_INTERVAL = 1.0; // seconds
+constexpr const char *PIPELINE_CACHE_PATH = "pipeline_cache.bin";
+constexpr const char *DEVICE_PROFILE_PATH = "device_profile.bin";
+constexpr vk::Format OFFSCREEN_FORMAT = vk::Format::eR8G8B8A8Srgb;
+constexpr float CAMERA_FOV_Y = 60.0f; // degrees
+constexpr float CAMERA_NEAR = 0.1f;
+constexpr float CAMERA_FAR = 1000.0f;
+// fewest meshes worth a secondary of their own in the main pass
+constexpr uint32_t RECORD_JOB_MIN_MESHES = 8;
+// low latency mode, presents still queued when the next frame starts
+constexpr uint64_t LOW_LATENCY_QUEUED_PRESENTS = 1;
+constexpr uint64_t PRESENT_WAIT_TIMEOUT = 100'000'000; // ns
 #ifdef NDEBUG
     constexpr bool ENABLE_VALIDATION = false;
 #else
     constexpr bool ENABLE_VALIDATION = true;
 #endif
 
+// Resources owned by one frame in flight, reused once the timeline reaches
+// the value the frame was last submitted with
+struct FrameData {
+    vk::raii::CommandBuffer command_buffer = nullptr;
+    vk::raii::Semaphore image_available = nullptr;
+    uint64_t timeline_value = 0;
+};
+
+struct SceneObject {
+    std::filesystem::path mesh;
+    glm::mat4 transform = glm::mat4(1.0f);
+    // optional KTX2 texture, sampled with the mesh uvs
+    std::filesystem::path texture;
+};
+
+// moves the camera before frame `frame` is recorded, a fixed path makes
+// runs comparable. Frames count from the first one with the scene resident
+using CameraPath = std::function<void(uint64_t frame, glm::vec3 &eye, glm::vec3 &target)>;
+
+// what a run measured, kept when RendererOptions::collect_stats is set
+struct RunStats {
+    std::string device;
+    // until the renderer was initialized, until the first frame that drew
+    // the scene and until the first that drew all of it resident
+    double startup_ms = 0.0;
+    double first_frame_ms = 0.0;
+    double resident_ms = 0.0;
+    // one entry per frame once the scene is resident, CPU is the main loop
+    // iteration and GPU the frame's timestamps, which arrive frames in
+    // flight late
+    std::vector<double> cpu_frame_ms;
+    std::vector<double> gpu_frame_ms;
+    // device memory once the last frame was recorded
+    std::vector<HeapBudget> heaps;
+};
+
+enum class LightingModel {
+    eUnlit,  // texture or normal colors as they are
+    eLambert // one fixed directional light plus ambient
+};
+
+struct RendererOptions {
+    uint32_t frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+    vk::Extent2D extent = {WIDTH, HEIGHT};
+
+    // no window, surface or swap chain, frames render into offscreen images
+    // and go to the readback sink
+    bool headless = false;
+    // frames rendered before run() returns, 0 never stops. Only frames that
+    // draw the fully loaded scene count, and only those reach the sink. A
+    // window still ends the run early when it is closed
+    uint64_t frame_count = 0;
+    ReadbackSink readback_sink;
+    // exported targets fall back to host memory when the device can't
+    ReadbackTarget readback_target = ReadbackTarget::eHostMemory;
+    // headless only, frame n this renderer produces is numbered
+    // frame_offset + n * frame_stride, see RendererGroup
+    uint64_t frame_offset = 0;
+    uint64_t frame_stride = 1;
+
+    // which suitable device to use, 0 is the best scoring one
+    uint32_t device_rank = 0;
+    // shared by renderers running side by side so they don't each spawn a
+    // worker per core, created by the renderer when empty
+    std::shared_ptr<TaskScheduler> scheduler;
+
+    // every object is drawn on the GPU, objects sharing a mesh path share
+    // the mesh. At least one is required, the constructor throws otherwise
+    std::vector<SceneObject> scene;
+    glm::vec3 camera_eye = glm::vec3(0.0f, 2.0f, 5.0f);
+    glm::vec3 camera_target = glm::vec3(0.0f);
+    CameraPath camera_path;
+
+    // draw meshlets through task and mesh shaders when the device has
+    // VK_EXT_mesh_shader, devices that do are preferred
+    bool mesh_shaders = false;
+    // cull on the workers instead of in a compute pass, for scenes where many
+    // instances move every frame. Frustum only, no occlusion
+    bool cpu_culling = false;
+
+    // falls back toward FIFO when the surface lacks it, P cycles through the
+    // modes at runtime. The swap image count follows the mode
+    vk::PresentModeKHR present_mode = vk::PresentModeKHR::eMailbox;
+    // hold each frame back until the previous one is on screen so input is
+    // sampled as late as possible, needs VK_KHR_present_wait. Costs GPU
+    // throughput since the CPU and GPU no longer run ahead
+    bool low_latency = false;
+
+    // scene pipelines are specialized on these, L toggles the lighting
+    LightingModel lighting = LightingModel::eUnlit;
+    // textures with alpha below one half are cut out
+    bool alpha_test = false;
+
+    // render the scene below the output resolution when the GPU frame time
+    // goes over this, upscaled bilinearly into the output image. 0 always
+    // renders at full resolution, needs timestamp queries
+    double target_gpu_ms = 0.0;
+    // smallest fraction of the output resolution the scene drops to
+    float min_render_scale = 0.5f;
+
+    // print how long each startup step took and the time to the first frame
+    // that draws the scene, always on in debug builds
+    bool report_startup = false;
+
+    // keep every frame's timings for stats(), for benchmarks
+    bool collect_stats = false;
+
+    // recompile the Slang sources when they change and swap the pipelines
+    // between frames, needs a build that found slangc
+    bool hot_reload_shaders = false;
+};
+
 class Renderer {
 public:
+    explicit Renderer(RendererOptions options = {});
+    ~Renderer();
+
     void run();
 
+    // filled in by run() when options.collect_stats is set
+    RunStats const &stats() const { return run_stats; }
+
+    // takes effect when the swap chain is next recreated, normally the
+    // following frame
+    void setPresentMode(vk::PresentModeKHR mode);
+
+    // switches pipeline variant, compiled the first time each is used and
+    // swapped in once ready
+    void setLighting(LightingModel lighting);
+
 private:
+    void initGlfw();
     void initWindow();
 
     void initVulkan();
+    void startPrefetch();
     void createInstance();
     void setupDebugMessenger();
     void createSurface();
     void pickPhysicalDevice();
     void createLogicalDevice();
+    void createScheduler();
+    void createAllocator();
+    void createBindless();
+    void createStreaming();
+    bool isDeviceExtensionEnabled(const char *name) const;
+    std::vector<const char *> requiredDeviceExtensions() const;
     void createSwapChain();
+    void createOffscreenTargets();
     void createImageView();
+    bool recreateSwapChain();
+    void waitForPresent();
+    void createPipelineCache();
+    void createPipelineBuilder();
+    void createScene();
+    void createGraphicsPipeline();
+    void buildScenePipelines();
+    void createShaderReloader();
+    void reloadPipelines();
+    void swapPendingPipelines();
+    ShaderPermutation scenePermutation(bool meshlets) const;
+    void switchScenePermutation();
+    void createCommandPool();
+    void createCommandBuffers();
+    void createCommandRecorder();
+    void createSyncObjects();
+    void createRenderFinished();
+    void createFrameRing();
+    void createProfiler();
+    void createResolutionScaler();
+    void createRenderGraph();
 
     void mainLoop();
-    
+    void drawFrame();
+    void drawOffscreenFrame();
+    void waitTimeline(uint64_t value);
+    void collectGarbage();
+    void reportGpuTimings();
+    void reportStartup();
+    void updateRenderScale();
+    glm::mat4 viewProjection() const;
+
+    // runs one step of startup, timed for the startup report and the trace.
+    // Any thread
+    template <typename F>
+    void startupStage(const char *name, F &&step) {
+        CpuScope scope(name);
+        const auto begin_ns = cpuTraceNow();
+
+        step();
+
+        std::lock_guard lock(startup_mutex);
+        startup_stages.emplace_back(name, cpuTraceNow() - begin_ns);
+    }
+
+    // keep a resource alive until every submission made so far has finished
+    template <typename T>
+    void deferDestroy(T &&resource) {
+        deletion_queue.emplace_back(
+            timeline_value,
+            std::make_shared<std::decay_t<T>>(std::forward<T>(resource))
+        );
+    }
+
+    // for what a queued present may still use after its frame's timeline
+    // value signals, the wait semaphore and the old swap chain. Presents run
+    // in queue order, so once frames in flight more images have been
+    // presented the older presents have consumed their semaphores, and the
+    // resource then goes through the deletion queue like anything else
+    template <typename T>
+    void deferUntilPresented(T &&resource) {
+        present_deletion_queue.emplace_back(
+            present_id + frames.size(),
+            std::make_shared<std::decay_t<T>>(std::forward<T>(resource))
+        );
+    }
+
+    void recordCommandBuffer(vk::raii::CommandBuffer const &cmd, uint32_t image_idx);
+
     void cleanup();
 
+    RendererOptions options;
+
     const std::vector<char const*> validation_layers = {
         "VK_LAYER_KHRONOS_validation"
     };
+    // only required when presenting to a window
     const std::vector<const char *> device_extensions = {
         vk::KHRSwapchainExtensionName
     };
+    // enabled when the device supports them
+    const std::vector<const char *> optional_device_extensions = {
+        vk::EXTMemoryBudgetExtensionName,
+        vk::KHRExternalMemoryFdExtensionName,
+        vk::EXTExternalMemoryDmaBufExtensionName
+    };
+    std::vector<const char *> enabled_device_extensions;
+    vk::PhysicalDeviceFeatures enabled_features;
+    bool mesh_shading = false;
+    bool present_wait = false;
 
     GLFWwindow* window = nullptr;
+    // set by the framebuffer size callback, or when present reports the
+    // swap chain no longer matches the surface
+    bool swap_chain_stale = false;
 
     vk::raii::Context context;
     vk::raii::Instance instance = nullptr;
@@ -55,13 +313,141 @@ private:
     vk::raii::SurfaceKHR surface = nullptr;
 
     vk::raii::PhysicalDevice physical_device = nullptr;
+    vk::PhysicalDeviceProperties device_properties;
+    // families and optional capabilities, the device is created from this
+    // rather than querying again
+    DeviceProfile device_profile;
     vk::raii::Device logical_device = nullptr;
 
+    // transfer and compute alias the graphics queue when the device has no
+    // dedicated family, use the QueueOwnership helpers when they differ
+    uint32_t queue_family = 0;
+    uint32_t transfer_family = 0;
+    uint32_t compute_family = 0;
     vk::raii::Queue queue = nullptr;
+    vk::raii::Queue transfer_queue = nullptr;
+    vk::raii::Queue compute_queue = nullptr;
+
+    // queues are externally synchronized and may be shared with loader
+    // threads, the transfer mutex is only used when its family is dedicated
+    std::mutex queue_mutex;
+    std::mutex transfer_mutex;
+
+    // every background and parallel job runs on these threads, it outlives
+    // all the subsystems below that submit to it
+    std::shared_ptr<TaskScheduler> scheduler;
+
+    // SPIR-V is read while the device is created, pipelines share the blobs
+    std::unique_ptr<ShaderLibrary> shader_library;
+    std::unique_ptr<ShaderReloader> shader_reloader;
+    // reads started before the device exists, see startPrefetch
+    TaskCounterPtr pipeline_cache_read = std::make_shared<TaskCounter>();
+    TaskCounterPtr assets_prefetched = std::make_shared<TaskCounter>();
+    std::vector<uint8_t> pipeline_cache_file;
+
+    // steps in the order they finished, overlapping ones run side by side
+    uint64_t startup_begin_ns = 0;
+    uint64_t startup_ready_ns = 0;
+    std::mutex startup_mutex;
+    std::vector<std::pair<const char *, uint64_t>> startup_stages;
+    bool startup_reported = false;
+
+    RunStats run_stats;
+    // the last frame timing added to run_stats
+    uint64_t stats_gpu_sample = 0;
+
+    std::unique_ptr<GpuAllocator> allocator;
+
+    // every texture, sampler and buffer shaders index by handle, bound as
+    // set 1 of the draw pipelines
+    std::unique_ptr<BindlessTable> bindless;
+    vk::raii::Sampler default_sampler = nullptr;
+    uint32_t default_sampler_slot = BINDLESS_NONE;
+
+    std::unique_ptr<UploadQueue> upload_queue;
+    std::unique_ptr<MeshLoader> mesh_loader;
+    std::unique_ptr<TextureLoader> texture_loader;
+    uint64_t upload_wait_value = 0;
 
     vk::raii::SwapchainKHR swap_chain = nullptr;
     vk::Extent2D swap_extent;
     vk::SurfaceFormatKHR swap_format;
+    vk::PresentModeKHR swap_present_mode = vk::PresentModeKHR::eFifo;
+    // present ids only count up, the first one of the current chain bounds
+    // what can be waited on
+    uint64_t present_id = 0;
+    uint64_t swap_chain_first_present = 1;
+    // headless mode renders into these and lists them as the swap images
+    std::vector<GpuImage> offscreen_images;
     std::vector<vk::Image> swap_images;
     std::vector<vk::raii::ImageView> swap_image_views;
+    // the swap images take a blit from a lower resolution scene, and the
+    // filter it uses
+    bool can_upscale = false;
+    vk::Filter upscale_filter = vk::Filter::eLinear;
+
+    vk::raii::PipelineCache pipeline_cache = nullptr;
+    vk::raii::PipelineLayout pipeline_layout = nullptr;
+    std::unique_ptr<PipelineBuilder> pipeline_builder;
+    PipelineHandle graphics_pipeline;
+    vk::raii::PipelineLayout mesh_pipeline_layout = nullptr;
+    PipelineHandle mesh_pipeline;
+    // every scene pipeline variant built so far, graphics and mesh are the
+    // ones in use
+    std::unique_ptr<PermutationCache> permutations;
+    bool scene_textured = false;
+    // replacements after a reload or option change, empty unless one is
+    // compiling
+    bool pipelines_pending = false;
+    PipelineHandle next_graphics_pipeline;
+    PipelineHandle next_mesh_pipeline;
+
+    vk::raii::CommandPool command_pool = nullptr;
+
+    // secondary buffers for the passes, recorded on worker threads
+    std::unique_ptr<CommandRecorder> command_recorder;
+
+    // presentation may still read a render finished semaphore after the
+    // frame's timeline value signals, so these are owned per swap image and
+    // retired with deferUntilPresented
+    std::vector<vk::raii::Semaphore> render_finished;
+
+    // single counter tracking GPU progress, signaled once per submission
+    vk::raii::Semaphore timeline = nullptr;
+    uint64_t timeline_value = 0;
+    uint64_t completed_value = 0;
+
+    uint32_t frame_idx = 0;
+    std::vector<FrameData> frames;
+
+    // per draw constants and dynamic geometry, valid for the current frame
+    FrameRingBuffer frame_ring = nullptr;
+
+    // timestamps for each pass, read back once the frame slot comes around
+    GpuProfiler gpu_profiler = nullptr;
+
+    // what the scene renders at, swap_extent unless the scaler lowered it
+    // to hold options.target_gpu_ms
+    std::unique_ptr<ResolutionScaler> resolution_scaler;
+    vk::Extent2D render_extent;
+    // the last frame timing the scaler was fed
+    uint64_t render_scale_sample = 0;
+
+    // rebuilt each frame, owns the transient attachments between frames
+    std::unique_ptr<RenderGraph> render_graph;
+
+    std::unique_ptr<GpuScene> scene;
+
+    // headless only, one readback buffer per frame in flight
+    ReadbackPool readback = nullptr;
+    // submitted frames that drew the whole scene, options.frame_count ends
+    // the run at this. Frames before that draw whatever has streamed in
+    uint64_t frames_rendered = 0;
+    // latched by the first frame recorded with the scene pipelines built and
+    // every mesh and texture resident
+    bool scene_resident = false;
+
+    std::deque<std::pair<uint64_t, std::shared_ptr<void>>> deletion_queue;
+    // keyed by present id instead of timeline value
+    std::deque<std::pair<uint64_t, std::shared_ptr<void>>> present_deletion_queue;
 };
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "Renderer.h"
+#include <cstdint>
+
+// Alternate frame rendering of one headless sequence across several GPUs.
+// Renderer i runs on the i-th best suitable device and renders frames i,
+// i + n, i + 2n, ... with its own logical device, so nothing is shared
+// between GPUs but the scheduler and the readback sink. Frames reach the
+// sink one at a time but not in order, ReadbackFrame::frame says which is
+// which.
+//
+// Only headless: presenting would need every frame copied over to the GPU
+// that owns the surface.
+class RendererGroup {
+public:
+    RendererGroup(RendererOptions options, uint32_t device_count);
+
+    // returns once every renderer has finished, rethrows the first error
+    void run();
+
+private:
+    RendererOptions options;
+    uint32_t device_count;
+};
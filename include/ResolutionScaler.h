@@ -0,0 +1,46 @@
+#pragma once
+
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <cstdint>
+
+// ----- CONSTANTS
+// scales are whole steps so the render targets and the Hi-Z pyramid are
+// not reallocated for every small change
+constexpr float RENDER_SCALE_STEP = 0.05f;
+constexpr double RENDER_SCALE_SMOOTHING = 0.2;
+// the GPU has to be this far under the target before the scale goes back up
+constexpr double RENDER_SCALE_RAISE_HEADROOM = 0.85;
+
+// Picks the fraction of the output resolution the scene renders at so the
+// GPU frame time holds a target. GPU time is taken to follow the pixel
+// count, the square of the scale: over budget it drops straight to the scale
+// that should fit, under budget it climbs back one step at a time, so
+// frames keep coming and the image only softens.
+class ResolutionScaler {
+public:
+    // `settle_frames` samples are skipped after every change, timings arrive
+    // frames in flight late and the first ones still show the old scale
+    ResolutionScaler(double target_ms, float min_scale, uint32_t settle_frames);
+
+    // one GPU frame time, each sample once. True when the scale changed
+    bool update(double gpu_ms);
+
+    float scale() const { return current; }
+    // `full` scaled, never below one pixel
+    vk::Extent2D apply(vk::Extent2D full) const;
+
+private:
+    double target_ms;
+    float min_scale;
+    uint32_t settle_frames;
+
+    float current = 1.0f;
+    double filtered_ms = 0.0;
+    bool filtered_valid = false;
+    uint32_t skip = 0;
+};
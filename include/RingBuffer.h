@@ -0,0 +1,43 @@
+#pragma once
+
+#include "GpuAllocator.h"
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+// Persistently mapped host visible buffer split into one region per frame in
+// flight. Allocation bumps a pointer inside the current frame's region and
+// the whole region is reclaimed once that frame's timeline value signals.
+class FrameRingBuffer {
+public:
+    FrameRingBuffer(std::nullptr_t) {}
+    FrameRingBuffer(
+        GpuAllocator &allocator,
+        vk::PhysicalDeviceLimits const &limits,
+        uint32_t frame_count,
+        vk::DeviceSize frame_size
+    );
+
+    // only call once the GPU has finished the frame that last used `frame`
+    void beginFrame(uint32_t frame);
+
+    // empty when the frame's region is full
+    std::optional<GpuBufferSlice> allocate(vk::DeviceSize size, vk::DeviceSize alignment = 0);
+    std::optional<GpuBufferSlice> write(const void *data, vk::DeviceSize size, vk::DeviceSize alignment = 0);
+
+    template <typename T>
+    std::optional<GpuBufferSlice> push(T const &value) {
+        return write(&value, sizeof(T));
+    }
+
+    vk::Buffer buffer() const { return *storage; }
+    vk::DeviceSize used() const { return head - frame_begin; }
+    vk::DeviceSize frameSize() const { return frame_size; }
+
+private:
+    GpuBuffer storage = nullptr;
+    vk::DeviceSize frame_size = 0;
+    vk::DeviceSize min_alignment = 1;
+    vk::DeviceSize frame_begin = 0;
+    vk::DeviceSize head = 0;
+};
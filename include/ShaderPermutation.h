@@ -0,0 +1,92 @@
+#pragma once
+
+#include "PipelineBuilder.h"
+#include "vulkan/vulkan.hpp"
+#if defined(__INTELLISENSE__) || !defined(USE_CPP20_MODULES)
+#include <vulkan/vulkan_raii.hpp>
+#else
+import vulkan_hpp;
+#endif
+#include <array>
+#include <cstdint>
+#include <functional>
+#include <unordered_map>
+#include <vector>
+
+// Feature bits a scene pipeline is specialized on. Meshlets picks the
+// geometry path, and with it the stages and vertex input, the rest are
+// specialization constants the driver folds away, see main.slang
+enum class ShaderFeature : uint32_t {
+    eMeshlets  = 1u << 0,
+    eTextured  = 1u << 1, // samples the instance's bindless texture
+    eAlphaTest = 1u << 2, // discards texels below the cutoff
+    eLit       = 1u << 3  // lambert with a fixed light, otherwise unlit
+};
+
+// constant_id of each specialized feature in main.slang
+enum class ShaderConstant : uint32_t {
+    eTextured  = 0,
+    eAlphaTest = 1,
+    eLit       = 2
+};
+
+// Everything that makes one scene pipeline differ from another
+struct ShaderPermutation {
+    uint32_t features = 0;
+    vk::Format color_format = vk::Format::eUndefined;
+
+    bool has(ShaderFeature feature) const {
+        return (features & static_cast<uint32_t>(feature)) != 0;
+    }
+    ShaderPermutation &set(ShaderFeature feature, bool enabled);
+
+    uint64_t hash() const;
+
+    bool operator==(ShaderPermutation const &) const = default;
+};
+
+// VkBool32 per specialized feature. `info` points into the object, so it
+// stays where it was made, build it inside the recipe next to the stages
+struct SpecializationConstants {
+    explicit SpecializationConstants(ShaderPermutation const &permutation);
+
+    SpecializationConstants(SpecializationConstants const &) = delete;
+    SpecializationConstants &operator=(SpecializationConstants const &) = delete;
+
+    std::array<vk::SpecializationMapEntry, 3> entries;
+    std::array<vk::Bool32, 3> values;
+    vk::SpecializationInfo info;
+};
+
+using PermutationRecipe = std::function<PipelineRecipe(ShaderPermutation const &permutation)>;
+
+// Pipelines keyed by the hash of their permutation, each variant compiles
+// once however often it is asked for, so switching back to one is
+// immediate. Render thread only.
+class PermutationCache {
+public:
+    PermutationCache(PipelineBuilder &pipeline_builder, PermutationRecipe make_recipe);
+
+    PermutationCache(PermutationCache const &) = delete;
+    PermutationCache &operator=(PermutationCache const &) = delete;
+
+    // compiles on first use, a variant that failed to compile is retried
+    PipelineHandle get(ShaderPermutation const &permutation);
+
+    // forgets every variant, e.g. once the SPIR-V changed. Frames in flight
+    // may still use them, so they go back to the caller to retire
+    std::vector<PipelineHandle> clear();
+
+    size_t size() const { return variants.size(); }
+
+private:
+    struct Variant {
+        ShaderPermutation permutation;
+        PipelineHandle pipeline;
+    };
+
+    PipelineBuilder &pipeline_builder;
+    PermutationRecipe make_recipe;
+
+    std::unordered_map<uint64_t, Variant> variants;
+};
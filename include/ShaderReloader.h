@@ -0,0 +1,62 @@
+#pragma once
+
+#include "PipelineBuilder.h"
+#include <atomic>
+#include <chrono>
+#include <filesystem>
+#include <string>
+#include <thread>
+#include <vector>
+
+// ----- CONSTANTS
+constexpr double SHADER_RELOAD_INTERVAL = 0.25; // seconds between source scans
+
+// Watches the Slang sources and recompiles them with slangc on a thread of
+// its own when one changes, the same way the build does. slangc is spawned
+// directly with an argument vector, no shell, and the compile never holds
+// up a scheduler worker. Every source that defines an
+// entry point becomes <name>.spv, the others are includes and only trigger a
+// rebuild. A change is all or nothing: the shader library only sees the new
+// SPIR-V once every module compiled, a broken edit leaves the old set.
+class ShaderReloader {
+public:
+    ShaderReloader(
+        ShaderLibrary &library,
+        std::filesystem::path source_dir,
+        std::filesystem::path output_dir,
+        std::string compiler
+    );
+    // waits for a compile in flight
+    ~ShaderReloader();
+
+    ShaderReloader(ShaderReloader const &) = delete;
+    ShaderReloader &operator=(ShaderReloader const &) = delete;
+
+    // render thread, once per frame. True once when new SPIR-V is in the
+    // library, pipelines built from then on use it
+    bool poll();
+
+private:
+    struct Module {
+        std::filesystem::path source;
+        std::filesystem::path output;
+        std::vector<std::string> entry_points;
+    };
+
+    std::filesystem::file_time_type newestSource() const;
+    std::vector<Module> findModules() const;
+    void compile();
+
+    ShaderLibrary &library;
+    std::filesystem::path source_dir;
+    std::filesystem::path output_dir;
+    std::string compiler;
+
+    std::chrono::steady_clock::time_point last_scan;
+    // newest source the current SPIR-V was compiled from
+    std::filesystem::file_time_type compiled_from;
+
+    std::thread compile_thread;
+    std::atomic<bool> compiling = false;
+    std::atomic<bool> reloaded = false;
+};
@@ -0,0 +1,109 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <thread>
+#include <vector>
+
+// tasks report their own errors, an exception escaping one terminates
+using Task = std::function<void()>;
+
+enum class TaskPriority {
+    eHigh, // frame work, the render thread helps with these while it waits
+    eLow   // background work such as asset loads and pipeline compiles
+};
+
+// Counts unfinished tasks. Tasks can be made to start only once another
+// counter reaches zero, which is how dependencies are expressed
+class TaskCounter {
+public:
+    bool done() const { return pending.load(std::memory_order_acquire) == 0; }
+
+private:
+    friend class TaskScheduler;
+
+    struct Continuation {
+        Task task;
+        std::shared_ptr<TaskCounter> signal;
+        TaskPriority priority;
+    };
+
+    std::atomic<uint32_t> pending = 0;
+    std::mutex mutex;
+    std::vector<Continuation> continuations;
+};
+
+using TaskCounterPtr = std::shared_ptr<TaskCounter>;
+
+// One worker per core with a deque each. Submissions from a worker go to its
+// own deque, idle workers steal from the others, so every subsystem shares
+// the same threads instead of spawning its own. A waiting thread runs queued
+// tasks until its counter finishes, threads other than the workers sleep
+// once there is nothing left they can take.
+class TaskScheduler {
+public:
+    // thread_count of 0 uses every core but the render thread's
+    explicit TaskScheduler(uint32_t thread_count = 0);
+    ~TaskScheduler();
+
+    TaskScheduler(TaskScheduler const &) = delete;
+    TaskScheduler &operator=(TaskScheduler const &) = delete;
+
+    // `signal` counts the task until it has finished, `after` holds it back
+    // until that counter is done
+    void submit(
+        Task task,
+        TaskCounterPtr signal = nullptr,
+        TaskPriority priority = TaskPriority::eLow,
+        TaskCounterPtr after = nullptr
+    );
+
+    // runs tasks on the calling thread until `counter` is done. Threads other
+    // than the workers only pick up high priority tasks, so a frame never
+    // ends up waiting on an asset load it happened to grab
+    void wait(TaskCounterPtr const &counter);
+
+    // splits [0, count) into ranges of `grain` and runs `body(begin, end)`
+    // on each as high priority tasks, the caller helps and returns once all
+    // are done. `body` must not throw
+    void parallelFor(uint32_t count, uint32_t grain, std::function<void(uint32_t, uint32_t)> const &body);
+
+    uint32_t threadCount() const { return static_cast<uint32_t>(threads.size()); }
+
+    // index of the calling worker, threadCount() on any other thread
+    uint32_t workerIndex() const;
+
+private:
+    struct Job {
+        Task task;
+        TaskCounterPtr signal;
+        TaskPriority priority = TaskPriority::eLow;
+    };
+
+    struct Queue {
+        std::mutex mutex;
+        std::deque<Job> high;
+        std::deque<Job> low;
+    };
+
+    void push(Job job);
+    std::optional<Job> pop(uint32_t self, bool take_low);
+    void run(Job &job);
+    void workerLoop(uint32_t index);
+
+    // one per worker plus a shared one for submissions from other threads
+    std::vector<std::unique_ptr<Queue>> queues;
+
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    std::atomic<uint32_t> queued = 0;
+    bool stopping = false;
+
+    std::vector<std::thread> threads;
+};
@@ -0,0 +1,125 @@
+#pragma once
+
+#include "BindlessTable.h"
+#include "GpuAllocator.h"
+#include "TaskScheduler.h"
+#include "UploadQueue.h"
+#include <atomic>
+#include <deque>
+#include <filesystem>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+// ----- CONSTANTS
+// mips at or below this size stream in together as the first step
+constexpr uint32_t TEXTURE_TAIL_SIZE = 64;
+constexpr uint32_t TEXTURE_NOT_RESIDENT = ~0u;
+
+enum class TextureState {
+    eLoading,   // being read and transcoded on a worker
+    eStreaming, // some mips are resident, finer ones are still on the way
+    eReady,     // every mip is resident
+    eFailed
+};
+
+// Compressed transcode target picked once from what the device samples
+enum class TextureTarget {
+    eBC7,
+    eASTC4x4,
+    eETC2,
+    eRGBA8
+};
+
+struct Texture {
+    ~Texture();
+
+    std::filesystem::path path;
+
+    GpuImage image = nullptr;
+    vk::Format format = vk::Format::eUndefined;
+    vk::Extent3D extent;
+    uint32_t mip_levels = 0;
+    uint32_t layers = 0;
+
+    // views[i] covers mips i..mip_levels-1, created before the first upload
+    std::vector<vk::raii::ImageView> views;
+    // bindless slot of every view, written once so a slot never changes
+    // while frames may be reading it
+    BindlessTable *bindless = nullptr;
+    std::vector<uint32_t> bindless_slots;
+
+    // most detailed mip whose data is on the GPU, only moved by the render
+    // thread once the graphics queue owns it
+    std::atomic<uint32_t> resident_mip = TEXTURE_NOT_RESIDENT;
+    std::atomic<TextureState> state = TextureState::eLoading;
+    std::string error;
+
+    // view over the resident mips, null until the coarsest ones arrive.
+    // Render thread only, it is what acquires the mips
+    vk::ImageView view() const;
+    // bindless slot of that view, BINDLESS_NONE until then. Render thread only
+    uint32_t bindlessIndex() const;
+};
+
+using TextureHandle = std::shared_ptr<Texture>;
+
+// Loads KTX2 files as low priority scheduler tasks, transcodes Basis payloads to a
+// block format the device supports and streams mips coarsest first through
+// the upload queue. Textures take turns, so every queued texture gets its
+// coarse mips before any of them gets full detail.
+class TextureLoader {
+public:
+    TextureLoader(
+        vk::raii::PhysicalDevice const &physical_device,
+        vk::PhysicalDeviceFeatures const &enabled_features,
+        vk::raii::Device const &device,
+        GpuAllocator &allocator,
+        UploadQueue &upload_queue,
+        TaskScheduler &scheduler,
+        BindlessTable &bindless
+    );
+    ~TextureLoader();
+
+    TextureLoader(TextureLoader const &) = delete;
+    TextureLoader &operator=(TextureLoader const &) = delete;
+
+    TextureHandle load(std::filesystem::path path);
+
+    TextureTarget target() const { return transcode_target; }
+
+private:
+    struct MipRegion {
+        vk::DeviceSize offset;
+        vk::Extent3D extent;
+    };
+
+    // one texture's streaming progress, requeued after every step
+    struct StreamJob {
+        TextureHandle texture;
+        std::shared_ptr<GpuBuffer> staging;
+        std::vector<MipRegion> mips;
+        uint32_t next_mip = 0; // exclusive bound, counts down toward 0
+    };
+
+    // one task per unit of work, each picks whatever is most urgent
+    void runStep();
+    StreamJob prepare(TextureHandle const &texture);
+    void streamStep(StreamJob &job, UploadContext &context);
+
+    vk::raii::Device const &device;
+    GpuAllocator &allocator;
+    UploadQueue &upload_queue;
+    TaskScheduler &scheduler;
+    BindlessTable &bindless;
+    UploadContextPool contexts;
+    TextureTarget transcode_target = TextureTarget::eRGBA8;
+
+    std::mutex mutex;
+    std::deque<TextureHandle> pending;
+    std::deque<StreamJob> streaming;
+
+    std::atomic<bool> stopping = false;
+    TaskCounterPtr outstanding = std::make_shared<TaskCounter>();
+};
@@ -0,0 +1,107 @@
+#pragma once
+
+#include "QueueOwnership.h"
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// Resources released by the transfer queue that the graphics queue still
+// has to acquire
+struct UploadRelease {
+    std::vector<BufferOwnershipTransfer> buffers;
+    std::vector<ImageOwnershipTransfer> images;
+
+    // runs on the render thread once the acquire half has been recorded
+    std::function<void()> on_acquired;
+};
+
+// Transfer queue submissions shared by every streaming subsystem. Uploads
+// signal one timeline, the render thread acquires whatever has been released
+// and waits on the newest value in its next submit.
+class UploadQueue {
+public:
+    UploadQueue(
+        vk::raii::Device const &device,
+        vk::raii::Queue const &queue,
+        uint32_t family,
+        uint32_t graphics_family,
+        std::mutex &queue_mutex
+    );
+
+    uint32_t family() const { return transfer_family; }
+    uint32_t graphicsFamily() const { return graphics_family; }
+    vk::Semaphore timeline() const { return *upload_timeline; }
+
+    // records the release barriers, ends `cmd` and submits it. Returns the
+    // timeline value that signals once the copies have finished
+    uint64_t submit(vk::raii::CommandBuffer const &cmd, UploadRelease release);
+
+    // render thread only, records the acquire barriers into `cmd` and
+    // returns the value its submission has to wait on, 0 if nothing
+    uint64_t acquire(vk::raii::CommandBuffer const &cmd);
+
+    uint64_t completedValue() const;
+    void wait(uint64_t value) const;
+
+private:
+    struct Released {
+        uint64_t value;
+        UploadRelease release;
+    };
+
+    vk::raii::Device const &device;
+    vk::raii::Queue const &queue;
+    uint32_t transfer_family;
+    uint32_t graphics_family;
+
+    // shared with every other user of the queues, they may alias
+    std::mutex &queue_mutex;
+    vk::raii::Semaphore upload_timeline = nullptr;
+    uint64_t timeline_value = 0;
+
+    std::mutex released_mutex;
+    std::vector<Released> released;
+};
+
+// Command pool plus the copies still using it. Pools are externally
+// synchronized, so a loader task checks one out for its whole upload
+struct UploadContext {
+    // kept until the upload timeline passes `value`
+    struct InFlight {
+        vk::raii::CommandBuffer cmd = nullptr;
+        std::shared_ptr<void> staging;
+        uint64_t value = 0;
+    };
+
+    vk::raii::CommandPool pool = nullptr;
+    std::deque<InFlight> in_flight;
+
+    // allocated from the pool and begun for one time submit
+    vk::raii::CommandBuffer begin(vk::raii::Device const &device) const;
+};
+
+// Upload contexts shared by the tasks of one loader, grows to however many
+// of its tasks run at once
+class UploadContextPool {
+public:
+    UploadContextPool(vk::raii::Device const &device, UploadQueue &upload_queue);
+    // the pools and staging buffers must outlive the copies that use them
+    ~UploadContextPool();
+
+    UploadContextPool(UploadContextPool const &) = delete;
+    UploadContextPool &operator=(UploadContextPool const &) = delete;
+
+    // frees whatever the context's finished copies were holding on to
+    std::unique_ptr<UploadContext> acquire();
+    void release(std::unique_ptr<UploadContext> context);
+
+private:
+    vk::raii::Device const &device;
+    UploadQueue &upload_queue;
+
+    std::mutex mutex;
+    std::vector<std::unique_ptr<UploadContext>> contexts;
+};
@@ -0,0 +1,234 @@
+#include "BindlessTable.h"
+#include <algorithm>
+#include <stdexcept>
+
+// ----- HELPER FUNCTIONS
+// what is left of `limit` once `reserved` is taken off, never below zero
+uint32_t remaining(uint32_t limit, uint32_t reserved) {
+    return limit > reserved ? limit - reserved : 0;
+}
+
+// takes up to `excess` off `capacity`, and what it took off `excess`
+void shrink(uint32_t &capacity, uint32_t &excess) {
+    const auto taken = std::min(capacity, excess);
+    capacity -= taken;
+    excess -= taken;
+}
+
+
+// ----- PUBLIC
+BindlessTable::BindlessTable(
+    vk::raii::Device const &device,
+    vk::PhysicalDeviceVulkan12Properties const &properties,
+    RetireCallback retire
+) : device(device), retire(std::move(retire)) {
+    auto &images = slots[static_cast<uint32_t>(BindlessKind::eImage)];
+    auto &samplers = slots[static_cast<uint32_t>(BindlessKind::eSampler)];
+    auto &buffers = slots[static_cast<uint32_t>(BindlessKind::eBuffer)];
+
+    // every stage sees the whole table, so the per stage limits apply too.
+    // They count every set in the pipeline layout, set 0's descriptors
+    // come out of the same budget
+    images.capacity = std::min({
+        BINDLESS_MAX_IMAGES,
+        remaining(properties.maxDescriptorSetUpdateAfterBindSampledImages, BINDLESS_RESERVED_IMAGES),
+        remaining(properties.maxPerStageDescriptorUpdateAfterBindSampledImages, BINDLESS_RESERVED_IMAGES)
+    });
+    samplers.capacity = std::min({
+        BINDLESS_MAX_SAMPLERS,
+        properties.maxDescriptorSetUpdateAfterBindSamplers,
+        properties.maxPerStageDescriptorUpdateAfterBindSamplers
+    });
+    buffers.capacity = std::min({
+        BINDLESS_MAX_BUFFERS,
+        remaining(properties.maxDescriptorSetUpdateAfterBindStorageBuffers, BINDLESS_RESERVED_BUFFERS),
+        remaining(properties.maxPerStageDescriptorUpdateAfterBindStorageBuffers, BINDLESS_RESERVED_BUFFERS)
+    });
+
+    // all kinds together also have to fit the per stage resource limit,
+    // images give way first since there are the most of them
+    const auto resources = remaining(properties.maxPerStageUpdateAfterBindResources, BINDLESS_RESERVED_RESOURCES);
+    const auto total = images.capacity + samplers.capacity + buffers.capacity;
+    auto excess = total > resources ? total - resources : 0;
+    shrink(images.capacity, excess);
+    shrink(buffers.capacity, excess);
+    shrink(samplers.capacity, excess);
+
+    const std::array<vk::DescriptorSetLayoutBinding, 3> bindings = {{
+        {
+            .binding         = static_cast<uint32_t>(BindlessKind::eImage),
+            .descriptorType  = vk::DescriptorType::eSampledImage,
+            .descriptorCount = images.capacity,
+            .stageFlags      = vk::ShaderStageFlagBits::eAll
+        },
+        {
+            .binding         = static_cast<uint32_t>(BindlessKind::eSampler),
+            .descriptorType  = vk::DescriptorType::eSampler,
+            .descriptorCount = samplers.capacity,
+            .stageFlags      = vk::ShaderStageFlagBits::eAll
+        },
+        {
+            .binding         = static_cast<uint32_t>(BindlessKind::eBuffer),
+            .descriptorType  = vk::DescriptorType::eStorageBuffer,
+            .descriptorCount = buffers.capacity,
+            .stageFlags      = vk::ShaderStageFlagBits::eAll
+        }
+    }};
+
+    // unwritten slots are fine as long as nothing reads them, and slots can
+    // be filled while the set is bound in pending command buffers
+    constexpr auto binding_flags =
+        vk::DescriptorBindingFlagBits::ePartiallyBound |
+        vk::DescriptorBindingFlagBits::eUpdateAfterBind |
+        vk::DescriptorBindingFlagBits::eUpdateUnusedWhilePending;
+    const std::array<vk::DescriptorBindingFlags, 3> flags = {binding_flags, binding_flags, binding_flags};
+
+    const vk::DescriptorSetLayoutBindingFlagsCreateInfo flags_info = {
+        .bindingCount  = static_cast<uint32_t>(flags.size()),
+        .pBindingFlags = flags.data()
+    };
+
+    set_layout = vk::raii::DescriptorSetLayout(device, {
+        .pNext        = &flags_info,
+        .flags        = vk::DescriptorSetLayoutCreateFlagBits::eUpdateAfterBindPool,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings    = bindings.data()
+    });
+
+    const std::array<vk::DescriptorPoolSize, 3> pool_sizes = {{
+        {.type = vk::DescriptorType::eSampledImage,  .descriptorCount = images.capacity},
+        {.type = vk::DescriptorType::eSampler,       .descriptorCount = samplers.capacity},
+        {.type = vk::DescriptorType::eStorageBuffer, .descriptorCount = buffers.capacity}
+    }};
+
+    pool = vk::raii::DescriptorPool(device, {
+        .flags         = vk::DescriptorPoolCreateFlagBits::eUpdateAfterBind,
+        .maxSets       = 1,
+        .poolSizeCount = static_cast<uint32_t>(pool_sizes.size()),
+        .pPoolSizes    = pool_sizes.data()
+    });
+
+    const auto layout = *set_layout;
+    auto sets = vk::raii::DescriptorSets(device, {
+        .descriptorPool     = *pool,
+        .descriptorSetCount = 1,
+        .pSetLayouts        = &layout
+    });
+    set = std::move(sets.front());
+}
+
+uint32_t BindlessTable::addImage(vk::ImageView view, vk::ImageLayout layout) {
+    const vk::DescriptorImageInfo image_info = {.imageView = view, .imageLayout = layout};
+
+    std::lock_guard lock(mutex);
+
+    const auto index = allocate(BindlessKind::eImage);
+    if (index == BINDLESS_NONE) return index;
+
+    device.updateDescriptorSets(vk::WriteDescriptorSet{
+        .dstSet          = *set,
+        .dstBinding      = static_cast<uint32_t>(BindlessKind::eImage),
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType  = vk::DescriptorType::eSampledImage,
+        .pImageInfo      = &image_info
+    }, {});
+
+    return index;
+}
+
+uint32_t BindlessTable::addSampler(vk::Sampler sampler) {
+    const vk::DescriptorImageInfo sampler_info = {.sampler = sampler};
+
+    std::lock_guard lock(mutex);
+
+    const auto index = allocate(BindlessKind::eSampler);
+    if (index == BINDLESS_NONE) return index;
+
+    device.updateDescriptorSets(vk::WriteDescriptorSet{
+        .dstSet          = *set,
+        .dstBinding      = static_cast<uint32_t>(BindlessKind::eSampler),
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType  = vk::DescriptorType::eSampler,
+        .pImageInfo      = &sampler_info
+    }, {});
+
+    return index;
+}
+
+uint32_t BindlessTable::addBuffer(vk::Buffer buffer, vk::DeviceSize offset, vk::DeviceSize range) {
+    const vk::DescriptorBufferInfo buffer_info = {.buffer = buffer, .offset = offset, .range = range};
+
+    std::lock_guard lock(mutex);
+
+    const auto index = allocate(BindlessKind::eBuffer);
+    if (index == BINDLESS_NONE) return index;
+
+    device.updateDescriptorSets(vk::WriteDescriptorSet{
+        .dstSet          = *set,
+        .dstBinding      = static_cast<uint32_t>(BindlessKind::eBuffer),
+        .dstArrayElement = index,
+        .descriptorCount = 1,
+        .descriptorType  = vk::DescriptorType::eStorageBuffer,
+        .pBufferInfo     = &buffer_info
+    }, {});
+
+    return index;
+}
+
+void BindlessTable::release(BindlessKind kind, uint32_t index) {
+    if (index == BINDLESS_NONE) return;
+
+    std::lock_guard lock(mutex);
+    released.emplace_back(kind, index);
+}
+
+void BindlessTable::beginFrame() {
+    // most frames release nothing, those allocate nothing either
+    std::vector<std::pair<BindlessKind, uint32_t>> slots;
+    {
+        std::lock_guard lock(mutex);
+        if (released.empty()) return;
+
+        slots.swap(released);
+    }
+
+    auto retired = std::make_shared<Released>();
+    retired->table = this;
+    retired->slots = std::move(slots);
+
+    retire(std::move(retired));
+}
+
+void BindlessTable::bind(
+    vk::raii::CommandBuffer const &cmd,
+    vk::PipelineBindPoint bind_point,
+    vk::PipelineLayout layout,
+    uint32_t set_index
+) const {
+    cmd.bindDescriptorSets(bind_point, layout, set_index, *set, {});
+}
+
+
+// ----- PRIVATE
+BindlessTable::Released::~Released() {
+    std::lock_guard lock(table->mutex);
+
+    for (auto [kind, index] : slots) {
+        table->slots[static_cast<uint32_t>(kind)].free.push_back(index);
+    }
+}
+
+uint32_t BindlessTable::allocate(BindlessKind kind) {
+    auto &list = slots[static_cast<uint32_t>(kind)];
+
+    if (!list.free.empty()) {
+        const auto index = list.free.back();
+        list.free.pop_back();
+        return index;
+    }
+    if (list.next == list.capacity) return BINDLESS_NONE;
+
+    return list.next++;
+}
@@ -0,0 +1,133 @@
+#include "CommandRecorder.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+#include <mutex>
+#include <thread>
+
+// ----- PUBLIC
+CommandRecorder::CommandRecorder(
+    vk::raii::Device const &device,
+    uint32_t queue_family,
+    uint32_t frame_count,
+    TaskScheduler &scheduler
+) : device(device), scheduler(scheduler) {
+    // the extra slot belongs to the render thread
+    thread_frames.resize(scheduler.threadCount() + 1);
+
+    for (auto &frames : thread_frames) {
+        for (uint32_t i = 0; i < frame_count; i++) {
+            frames.push_back({
+                .pool = vk::raii::CommandPool(device, {
+                    .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+                    .queueFamilyIndex = queue_family
+                })
+            });
+        }
+    }
+}
+
+void CommandRecorder::beginFrame(uint32_t frame) {
+    current_frame = frame;
+
+    // no batch is running between frames, so every pool is free to touch
+    for (auto &frames : thread_frames) {
+        auto &thread_frame = frames[frame];
+        thread_frame.pool.reset();
+        thread_frame.used = 0;
+    }
+}
+
+std::vector<vk::CommandBuffer> CommandRecorder::record(
+    SecondaryTarget const &target,
+    std::span<const RecordJob> jobs
+) {
+    if (jobs.empty()) return {};
+
+    const vk::CommandBufferInheritanceRenderingInfo rendering_info = {
+        .colorAttachmentCount    = static_cast<uint32_t>(target.color_formats.size()),
+        .pColorAttachmentFormats = target.color_formats.data(),
+        .depthAttachmentFormat   = target.depth_format,
+        .stencilAttachmentFormat = target.stencil_format,
+        .rasterizationSamples    = target.samples
+    };
+    const vk::CommandBufferInheritanceInfo inheritance = {
+        .pNext = &rendering_info
+    };
+
+    // everything below lives on this stack until wait() returns
+    std::vector<vk::CommandBuffer> results(jobs.size());
+    std::atomic<uint32_t> next_job = 0;
+    std::mutex error_mutex;
+    std::exception_ptr error;
+
+    // the scheduler may be shared with other renderers, whose render
+    // threads also land on the extra slot while they wait. That slot's pools
+    // are this thread's, so other non-workers leave the jobs to the rest
+    const auto render_thread = std::this_thread::get_id();
+
+    auto record_jobs = [&] {
+        const auto slot = scheduler.workerIndex();
+        if (slot == scheduler.threadCount() && std::this_thread::get_id() != render_thread) return;
+
+        auto &frame = thread_frames[slot][current_frame];
+
+        try {
+            CpuScope scope("record secondary");
+
+            for (auto job = next_job.fetch_add(1); job < jobs.size(); job = next_job.fetch_add(1)) {
+                auto const &cmd = nextBuffer(frame);
+
+                cmd.begin({
+                    .flags            = vk::CommandBufferUsageFlagBits::eOneTimeSubmit |
+                                        vk::CommandBufferUsageFlagBits::eRenderPassContinue,
+                    .pInheritanceInfo = &inheritance
+                });
+                jobs[job](cmd);
+                cmd.end();
+
+                results[job] = *cmd;
+            }
+        } catch (...) {
+            std::lock_guard lock(error_mutex);
+            if (!error) error = std::current_exception();
+        }
+    };
+
+    // one task per thread that can help at most, each drains the shared
+    // counter so uneven jobs balance out
+    const auto task_count = std::min<size_t>(jobs.size(), thread_frames.size());
+    auto done = std::make_shared<TaskCounter>();
+    for (size_t i = 0; i < task_count; i++) {
+        scheduler.submit(record_jobs, done, TaskPriority::eHigh);
+    }
+
+    // drains whatever the tasks skipped or have not reached yet
+    record_jobs();
+    scheduler.wait(done);
+
+    if (error) {
+        std::rethrow_exception(error);
+    }
+
+    return results;
+}
+
+
+// ----- PRIVATE
+vk::raii::CommandBuffer const &CommandRecorder::nextBuffer(ThreadFrame &frame) {
+    // buffers survive pool resets, so they are only allocated as draw
+    // counts grow
+    if (frame.used == frame.buffers.size()) {
+        auto allocated = device.allocateCommandBuffers({
+            .commandPool        = *frame.pool,
+            .level              = vk::CommandBufferLevel::eSecondary,
+            .commandBufferCount = 1
+        });
+        frame.buffers.push_back(std::move(allocated.front()));
+    }
+
+    return frame.buffers[frame.used++];
+}
@@ -0,0 +1,148 @@
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <fstream>
+#include <memory>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+#include <nlohmann/json.hpp>
+
+// ----- HELPER FUNCTIONS
+// rings stay alive after their thread exits so late dumps still see them
+struct CpuTraceRegistry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<CpuTraceRing>> rings;
+};
+
+CpuTraceRegistry &cpuTraceRegistry() {
+    static CpuTraceRegistry registry;
+    return registry;
+}
+
+std::atomic<uint64_t> trace_frame = 0;
+
+
+// ----- RING
+uint32_t CpuTraceRing::snapshot(CpuEvent *out) const {
+    const auto head = write_head.load(std::memory_order_acquire);
+    const auto first = head > CPU_TRACE_CAPACITY ? head - CPU_TRACE_CAPACITY : 0;
+
+    for (auto i = first; i < head; i++) {
+        auto const &slot = events[i % CPU_TRACE_CAPACITY];
+        out[i - first] = {
+            .name     = slot.name.load(std::memory_order_relaxed),
+            .begin_ns = slot.begin_ns.load(std::memory_order_relaxed),
+            .end_ns   = slot.end_ns.load(std::memory_order_relaxed),
+            .frame    = slot.frame.load(std::memory_order_relaxed)
+        };
+    }
+
+    // anything the writer reached while we copied may be torn, including
+    // the slot of a push still in flight. The fence pairs with the one in
+    // push so seeing its stores means seeing the head it started from
+    std::atomic_thread_fence(std::memory_order_acquire);
+    const auto after = write_head.load(std::memory_order_relaxed) + 1;
+    const auto overwritten = after > CPU_TRACE_CAPACITY ? after - CPU_TRACE_CAPACITY : 0;
+    const auto valid_first = std::max(first, overwritten);
+
+    if (valid_first >= head) return 0;
+
+    const auto skip = valid_first - first;
+    const auto count = head - valid_first;
+    for (uint64_t i = 0; i < count; i++) {
+        out[i] = out[i + skip];
+    }
+
+    return static_cast<uint32_t>(count);
+}
+
+
+// ----- PUBLIC
+CpuTraceRing &cpuTraceRing() {
+    thread_local CpuTraceRing *ring = [] {
+        auto &registry = cpuTraceRegistry();
+        std::lock_guard lock(registry.mutex);
+
+        auto &created = registry.rings.emplace_back(std::make_unique<CpuTraceRing>());
+        created->thread_id = static_cast<uint32_t>(registry.rings.size());
+
+        return created.get();
+    }();
+
+    return *ring;
+}
+
+void cpuTraceThreadName(const char *name) {
+    cpuTraceRing().name.store(name, std::memory_order_release);
+}
+
+void cpuTraceFrame(uint64_t frame) {
+    trace_frame.store(frame, std::memory_order_relaxed);
+}
+
+uint64_t cpuTraceNow() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()
+    ).count();
+}
+
+void writeChromeTrace(std::filesystem::path const &path) {
+    auto &registry = cpuTraceRegistry();
+    auto trace_events = nlohmann::json::array();
+
+    // the snapshot buffer is too big for the stack, the dump is off the hot path
+    std::vector<CpuEvent> events(CPU_TRACE_CAPACITY);
+
+    {
+        std::lock_guard lock(registry.mutex);
+
+        for (auto const &ring : registry.rings) {
+            trace_events.push_back({
+                {"name", "thread_name"},
+                {"ph",   "M"},
+                {"pid",  0},
+                {"tid",  ring->thread_id},
+                {"args", {{"name", ring->name.load(std::memory_order_acquire)}}}
+            });
+
+            const auto count = ring->snapshot(events.data());
+
+            for (uint32_t i = 0; i < count; i++) {
+                auto const &event = events[i];
+
+                // complete events, timestamps are in microseconds
+                trace_events.push_back({
+                    {"name", event.name},
+                    {"cat",  "cpu"},
+                    {"ph",   "X"},
+                    {"pid",  0},
+                    {"tid",  ring->thread_id},
+                    {"ts",   event.begin_ns / 1000.0},
+                    {"dur",  (event.end_ns - event.begin_ns) / 1000.0},
+                    {"args", {{"frame", event.frame}}}
+                });
+            }
+        }
+    }
+
+    const nlohmann::json trace = {
+        {"traceEvents",     std::move(trace_events)},
+        {"displayTimeUnit", "ms"}
+    };
+
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Failed to open trace file: " + path.string());
+    }
+
+    file << trace;
+}
+
+CpuScope::~CpuScope() {
+    cpuTraceRing().push({
+        .name     = name,
+        .begin_ns = begin_ns,
+        .end_ns   = cpuTraceNow(),
+        .frame    = trace_frame.load(std::memory_order_relaxed)
+    });
+}
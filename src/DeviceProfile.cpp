@@ -0,0 +1,287 @@
+#include "DeviceProfile.h"
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <type_traits>
+
+constexpr uint32_t DEVICE_PROFILE_MAGIC = 0x46505644; // "DVPF"
+constexpr uint32_t DEVICE_PROFILE_VERSION = 1;
+
+static_assert(std::is_trivially_copyable_v<DeviceProfile>);
+
+struct DeviceProfileHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t selection_key;
+    uint64_t profile_size;
+};
+
+// ----- HELPER FUNCTIONS
+bool hasExtension(std::vector<vk::ExtensionProperties> const &extensions, const char *name) {
+    return std::ranges::any_of(extensions, [name](auto const &extension) {
+        return strcmp(extension.extensionName, name) == 0;
+    });
+}
+
+// first family with every required flag and none of the excluded ones
+uint32_t findFamily(
+    std::vector<vk::QueueFamilyProperties> const &families,
+    vk::QueueFlags required,
+    vk::QueueFlags excluded
+) {
+    const uint32_t max_idx = families.size();
+
+    for (uint32_t i = 0; i < max_idx; i++) {
+        auto flags = families[i].queueFlags;
+
+        if ((flags & required) == required && !(flags & excluded)) {
+            return i;
+        }
+    }
+
+    return max_idx;
+}
+
+// descriptor indexing as the bindless table uses it, see BindlessTable.h
+bool supportsBindless(vk::PhysicalDeviceVulkan12Features const &features) {
+    return features.descriptorIndexing &&
+        features.shaderSampledImageArrayNonUniformIndexing &&
+        features.shaderStorageBufferArrayNonUniformIndexing &&
+        features.descriptorBindingSampledImageUpdateAfterBind &&
+        features.descriptorBindingStorageBufferUpdateAfterBind &&
+        features.descriptorBindingUpdateUnusedWhilePending &&
+        features.descriptorBindingPartiallyBound &&
+        features.runtimeDescriptorArray;
+}
+
+// VK_EXT_mesh_shader with both task and mesh stages
+bool supportsMeshShading(vk::raii::PhysicalDevice const &device, std::vector<vk::ExtensionProperties> const &extensions) {
+    if (!hasExtension(extensions, vk::EXTMeshShaderExtensionName)) return false;
+
+    const auto features = device.getFeatures2<
+        vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceMeshShaderFeaturesEXT>().get<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+
+    return features.taskShader && features.meshShader;
+}
+
+// VK_KHR_present_id and VK_KHR_present_wait, both are needed to wait on a
+// specific present
+bool supportsPresentWait(vk::raii::PhysicalDevice const &device, std::vector<vk::ExtensionProperties> const &extensions) {
+    if (!hasExtension(extensions, vk::KHRPresentIdExtensionName) ||
+        !hasExtension(extensions, vk::KHRPresentWaitExtensionName)) {
+        return false;
+    }
+
+    const auto features = device.getFeatures2<
+        vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDevicePresentIdFeaturesKHR,
+        vk::PhysicalDevicePresentWaitFeaturesKHR>();
+
+    return features.get<vk::PhysicalDevicePresentIdFeaturesKHR>().presentId &&
+        features.get<vk::PhysicalDevicePresentWaitFeaturesKHR>().presentWait;
+}
+
+// heaps only the GPU can reach quickly, integrated GPUs report system
+// memory here so it says nothing about them
+vk::DeviceSize dedicatedMemory(vk::raii::PhysicalDevice const &device, vk::PhysicalDeviceType type) {
+    if (type != vk::PhysicalDeviceType::eDiscreteGpu) return 0;
+
+    vk::DeviceSize total = 0;
+    for (auto const &heap : device.getMemoryProperties().memoryHeapsSpan()) {
+        if (heap.flags & vk::MemoryHeapFlagBits::eDeviceLocal) total += heap.size;
+    }
+
+    return total;
+}
+
+
+// ----- PUBLIC
+DeviceProfile profileDevice(vk::raii::PhysicalDevice const &device, DeviceRequirements const &requirements) {
+    const auto properties_chain = device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+    const auto &properties = properties_chain.get<vk::PhysicalDeviceProperties2>().properties;
+    const auto &ids = properties_chain.get<vk::PhysicalDeviceIDProperties>();
+
+    const auto feature_chain = device.getFeatures2<
+        vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceVulkan12Features,
+        vk::PhysicalDeviceVulkan13Features>();
+    const auto &features = feature_chain.get<vk::PhysicalDeviceFeatures2>().features;
+    const auto &features12 = feature_chain.get<vk::PhysicalDeviceVulkan12Features>();
+    const auto &features13 = feature_chain.get<vk::PhysicalDeviceVulkan13Features>();
+
+    const auto extensions = device.enumerateDeviceExtensionProperties();
+    const auto families = device.getQueueFamilyProperties();
+
+    DeviceProfile profile;
+    memcpy(profile.device_uuid, ids.deviceUUID.data(), vk::UuidSize);
+    profile.driver_version = properties.driverVersion;
+
+    // --- Queues
+    // graphics has to present as well, transfer and compute prefer families
+    // of their own since those run on separate hardware engines
+    const uint32_t max_idx = families.size();
+    profile.queue_family = max_idx;
+    for (uint32_t i = 0; i < max_idx; i++) {
+        const bool graphics = bool(families[i].queueFlags & vk::QueueFlagBits::eGraphics);
+        const bool present = !requirements.surface || device.getSurfaceSupportKHR(i, requirements.surface);
+
+        if (graphics && present) {
+            profile.queue_family = i;
+            break;
+        }
+    }
+    if (profile.queue_family == max_idx) return profile;
+
+    profile.transfer_family = findFamily(
+        families,
+        vk::QueueFlagBits::eTransfer,
+        vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute
+    );
+    if (profile.transfer_family == max_idx) {
+        profile.transfer_family = findFamily(families, vk::QueueFlagBits::eTransfer, vk::QueueFlagBits::eGraphics);
+    }
+    if (profile.transfer_family == max_idx) profile.transfer_family = profile.queue_family;
+
+    profile.compute_family = findFamily(families, vk::QueueFlagBits::eCompute, vk::QueueFlagBits::eGraphics);
+    if (profile.compute_family == max_idx) profile.compute_family = profile.queue_family;
+
+    // --- Requirements
+    // GPU driven draws need the instance index and a GPU written count,
+    // frames are paced with a timeline and recorded with sync2 and dynamic
+    // rendering
+    if (properties.apiVersion < VK_API_VERSION_1_4) return profile;
+    if (!features.multiDrawIndirect || !features.drawIndirectFirstInstance) return profile;
+    if (!features12.drawIndirectCount || !features12.timelineSemaphore) return profile;
+    if (!supportsBindless(features12)) return profile;
+    if (!features13.synchronization2 || !features13.dynamicRendering) return profile;
+
+    for (auto required : requirements.extensions) {
+        if (!hasExtension(extensions, required)) return profile;
+    }
+
+    // --- Capabilities
+    auto enable = [&](DeviceCapability capability, bool supported) {
+        if (supported) profile.capabilities |= static_cast<uint32_t>(capability);
+    };
+    enable(DeviceCapability::eMeshShading, supportsMeshShading(device, extensions));
+    enable(DeviceCapability::ePresentWait, requirements.surface && supportsPresentWait(device, extensions));
+    enable(DeviceCapability::eSamplerAnisotropy, features.samplerAnisotropy);
+    enable(DeviceCapability::eTextureBC, features.textureCompressionBC);
+    enable(DeviceCapability::eTextureETC2, features.textureCompressionETC2);
+    enable(DeviceCapability::eTextureASTC, features.textureCompressionASTC_LDR);
+
+    for (uint32_t i = 0; i < requirements.optional_extensions.size(); i++) {
+        if (hasExtension(extensions, requirements.optional_extensions[i])) {
+            profile.optional_extensions |= 1u << i;
+        }
+    }
+
+    // --- Score
+    // discrete beats integrated, then whatever the renderer would use
+    profile.score = 1;
+    if (properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu) profile.score += 1000;
+
+    profile.dedicated_memory = dedicatedMemory(device, properties.deviceType);
+    profile.score += static_cast<uint32_t>(std::min<vk::DeviceSize>(profile.dedicated_memory >> 24, 1000)); // 16 MiB steps
+
+    if (profile.transfer_family != profile.queue_family) profile.score += 100;
+    if (profile.compute_family != profile.queue_family) profile.score += 100;
+
+    if (requirements.prefer_mesh_shading && profile.has(DeviceCapability::eMeshShading)) profile.score += 2000;
+    if (requirements.prefer_present_wait && profile.has(DeviceCapability::ePresentWait)) profile.score += 200;
+
+    return profile;
+}
+
+bool profileMatchesDevice(
+    DeviceProfile const &profile,
+    vk::raii::PhysicalDevice const &device,
+    DeviceRequirements const &requirements
+) {
+    const auto properties_chain = device.getProperties2<vk::PhysicalDeviceProperties2, vk::PhysicalDeviceIDProperties>();
+    const auto &properties = properties_chain.get<vk::PhysicalDeviceProperties2>().properties;
+    const auto &ids = properties_chain.get<vk::PhysicalDeviceIDProperties>();
+
+    if (profile.driver_version != properties.driverVersion ||
+        memcmp(profile.device_uuid, ids.deviceUUID.data(), vk::UuidSize) != 0
+    ) {
+        return false;
+    }
+
+    // the optional bits index into the list, a build with a different list
+    // would enable the wrong extensions
+    const auto extensions = device.enumerateDeviceExtensionProperties();
+    for (auto const *name : requirements.extensions) {
+        if (!hasExtension(extensions, name)) return false;
+    }
+    const auto optional_count = requirements.optional_extensions.size();
+    const uint32_t known_bits = optional_count >= 32 ? ~0u : (1u << optional_count) - 1;
+    if ((profile.optional_extensions & ~known_bits) != 0) return false;
+
+    for (uint32_t i = 0; i < requirements.optional_extensions.size(); i++) {
+        if (profile.hasOptionalExtension(i) && !hasExtension(extensions, requirements.optional_extensions[i])) return false;
+    }
+
+    return true;
+}
+
+std::optional<DeviceProfile> loadDeviceProfile(std::filesystem::path const &path, uint64_t selection_key) {
+    std::ifstream file(path, std::ios::binary);
+
+    if (!file.is_open()) return std::nullopt;
+
+    DeviceProfileHeader header;
+    DeviceProfile profile;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    file.read(reinterpret_cast<char *>(&profile), sizeof(profile));
+
+    if (!file) return std::nullopt;
+    if (header.magic != DEVICE_PROFILE_MAGIC || header.version != DEVICE_PROFILE_VERSION) return std::nullopt;
+    if (header.selection_key != selection_key || header.profile_size != sizeof(profile)) return std::nullopt;
+    if (profile.score == 0) return std::nullopt;
+
+    return profile;
+}
+
+void saveDeviceProfile(
+    std::filesystem::path const &path,
+    uint64_t selection_key,
+    DeviceProfile const &profile
+) {
+    const DeviceProfileHeader header = {
+        .magic         = DEVICE_PROFILE_MAGIC,
+        .version       = DEVICE_PROFILE_VERSION,
+        .selection_key = selection_key,
+        .profile_size  = sizeof(profile)
+    };
+
+    // write next to the target first so a crash never leaves a torn file
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open device profile: " + tmp_path.string());
+        }
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(&profile), sizeof(profile));
+
+        if (!file) {
+            throw std::runtime_error("Failed to write device profile: " + tmp_path.string());
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmp_path, path, error);
+
+    if (error) {
+        throw std::runtime_error("Failed to replace device profile: " + error.message());
+    }
+}
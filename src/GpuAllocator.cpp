@@ -0,0 +1,435 @@
+#include "GpuAllocator.h"
+#include <algorithm>
+#include <iterator>
+#include <stdexcept>
+#include <string>
+#include <utility>
+
+// ----- HELPER FUNCTIONS
+vk::DeviceSize alignUp(vk::DeviceSize value, vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+vk::MemoryPropertyFlags requiredFlags(MemoryUsage usage) {
+    switch (usage) {
+        case MemoryUsage::eGpuOnly:
+            return vk::MemoryPropertyFlagBits::eDeviceLocal;
+        case MemoryUsage::eUpload:
+            return vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent;
+        case MemoryUsage::eReadback:
+            return vk::MemoryPropertyFlagBits::eHostVisible;
+    }
+    return {};
+}
+
+vk::MemoryPropertyFlags preferredFlags(MemoryUsage usage) {
+    switch (usage) {
+        case MemoryUsage::eGpuOnly:
+            return {};
+        case MemoryUsage::eUpload:
+            // write combined system memory, keeps the small BAR heap free
+            return {};
+        case MemoryUsage::eReadback:
+            return vk::MemoryPropertyFlagBits::eHostCached;
+    }
+    return {};
+}
+
+// flags that make a type a worse fit even though it satisfies the request
+vk::MemoryPropertyFlags avoidedFlags(MemoryUsage usage) {
+    switch (usage) {
+        case MemoryUsage::eGpuOnly:
+            return vk::MemoryPropertyFlagBits::eHostVisible;
+        case MemoryUsage::eUpload:
+            return vk::MemoryPropertyFlagBits::eDeviceLocal;
+        case MemoryUsage::eReadback:
+            return {};
+    }
+    return {};
+}
+
+
+// ----- GPU BUFFER
+GpuBuffer::GpuBuffer(GpuBuffer &&other) noexcept
+    : buffer(std::move(other.buffer)),
+      allocation(other.allocation),
+      allocator(std::exchange(other.allocator, nullptr)) {}
+
+GpuBuffer &GpuBuffer::operator=(GpuBuffer &&other) noexcept {
+    if (this != &other) {
+        buffer = nullptr;
+        if (allocator) allocator->free(allocation);
+
+        buffer = std::move(other.buffer);
+        allocation = other.allocation;
+        allocator = std::exchange(other.allocator, nullptr);
+    }
+    return *this;
+}
+
+GpuBuffer::~GpuBuffer() {
+    // the buffer has to go before the memory it is bound to
+    buffer = nullptr;
+
+    if (allocator) {
+        allocator->free(allocation);
+        allocator = nullptr;
+    }
+}
+
+
+// ----- GPU IMAGE
+GpuImage::GpuImage(GpuImage &&other) noexcept
+    : image(std::move(other.image)),
+      allocation(other.allocation),
+      allocator(std::exchange(other.allocator, nullptr)) {}
+
+GpuImage &GpuImage::operator=(GpuImage &&other) noexcept {
+    if (this != &other) {
+        image = nullptr;
+        if (allocator) allocator->free(allocation);
+
+        image = std::move(other.image);
+        allocation = other.allocation;
+        allocator = std::exchange(other.allocator, nullptr);
+    }
+    return *this;
+}
+
+GpuImage::~GpuImage() {
+    image = nullptr;
+
+    if (allocator) {
+        allocator->free(allocation);
+        allocator = nullptr;
+    }
+}
+
+
+// ----- GPU ALLOCATOR
+GpuAllocator::GpuAllocator(
+    vk::raii::PhysicalDevice const &physical_device,
+    vk::raii::Device const &device,
+    bool memory_budget
+) : physical_device(physical_device),
+    device(device),
+    memory_properties(physical_device.getMemoryProperties()),
+    max_allocations(physical_device.getProperties().limits.maxMemoryAllocationCount),
+    non_coherent_atom(physical_device.getProperties().limits.nonCoherentAtomSize),
+    memory_budget(memory_budget) {}
+
+uint32_t GpuAllocator::findMemoryType(uint32_t type_bits, MemoryUsage usage) const {
+    const auto required = requiredFlags(usage);
+    const auto preferred = preferredFlags(usage);
+    const auto avoided = avoidedFlags(usage);
+
+    uint32_t best_type = memory_properties.memoryTypeCount;
+    int best_score = -1;
+
+    for (uint32_t i = 0; i < memory_properties.memoryTypeCount; i++) {
+        const auto flags = memory_properties.memoryTypes[i].propertyFlags;
+
+        if (!(type_bits & (1u << i))) continue;
+        if ((flags & required) != required) continue;
+
+        int score = 1;
+        if (preferred && (flags & preferred) == preferred) score += 2;
+        if (!(flags & avoided)) score += 1;
+
+        if (score > best_score) {
+            best_score = score;
+            best_type = i;
+        }
+    }
+
+    if (best_type == memory_properties.memoryTypeCount) {
+        throw std::runtime_error("No memory type satisfies the requested usage");
+    }
+
+    return best_type;
+}
+
+vk::DeviceSize GpuAllocator::blockSizeFor(uint32_t memory_type) const {
+    const auto &type = memory_properties.memoryTypes[memory_type];
+    const auto heap_size = memory_properties.memoryHeaps[type.heapIndex].size;
+
+    auto block_size = (type.propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible)
+        ? GPU_HOST_BLOCK_SIZE
+        : GPU_BLOCK_SIZE;
+
+    // small heaps (e.g. a 256MiB BAR) would be swallowed by a single block
+    return std::min(block_size, heap_size / 8);
+}
+
+uint32_t GpuAllocator::createBlock(
+    uint32_t memory_type,
+    vk::DeviceSize size,
+    bool linear,
+    bool dedicated
+) {
+    if (live_blocks >= max_allocations) {
+        throw std::runtime_error("Exceeded maxMemoryAllocationCount");
+    }
+
+    vk::MemoryAllocateInfo alloc_info = {
+        .allocationSize  = size,
+        .memoryTypeIndex = memory_type
+    };
+
+    auto block = std::make_unique<MemoryBlock>();
+    block->memory = vk::raii::DeviceMemory(device, alloc_info);
+    block->size = size;
+    block->memory_type = memory_type;
+    block->linear = linear;
+    block->dedicated = dedicated;
+    block->free_ranges.emplace(0, size);
+
+    const auto flags = memory_properties.memoryTypes[memory_type].propertyFlags;
+    if (flags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        block->mapped = block->memory.mapMemory(0, vk::WholeSize);
+    }
+
+    live_blocks++;
+
+    // reuse a slot left by a released dedicated block
+    auto slot = std::ranges::find_if(blocks, [](auto const &existing) { return !existing; });
+    if (slot != blocks.end()) {
+        *slot = std::move(block);
+        return static_cast<uint32_t>(slot - blocks.begin());
+    }
+
+    blocks.push_back(std::move(block));
+    return static_cast<uint32_t>(blocks.size() - 1);
+}
+
+std::optional<vk::DeviceSize> GpuAllocator::suballocate(
+    MemoryBlock &block,
+    vk::DeviceSize size,
+    vk::DeviceSize alignment
+) {
+    // first fit, good enough when most resources are long lived
+    for (auto it = block.free_ranges.begin(); it != block.free_ranges.end(); it++) {
+        const auto [range_offset, range_size] = *it;
+        const auto offset = alignUp(range_offset, alignment);
+        const auto range_end = range_offset + range_size;
+
+        if (offset + size > range_end) continue;
+
+        block.free_ranges.erase(it);
+        if (offset > range_offset) {
+            block.free_ranges.emplace(range_offset, offset - range_offset);
+        }
+        if (offset + size < range_end) {
+            block.free_ranges.emplace(offset + size, range_end - offset - size);
+        }
+
+        block.allocated += size;
+        return offset;
+    }
+
+    return std::nullopt;
+}
+
+GpuAllocation GpuAllocator::allocate(
+    vk::MemoryRequirements const &requirements,
+    MemoryUsage usage,
+    bool linear
+) {
+    std::lock_guard lock(mutex);
+
+    const auto memory_type = findMemoryType(requirements.memoryTypeBits, usage);
+    const auto block_size = blockSizeFor(memory_type);
+
+    auto make_allocation = [&](uint32_t block_id, vk::DeviceSize offset) {
+        auto &block = *blocks[block_id];
+        return GpuAllocation {
+            .memory      = *block.memory,
+            .offset      = offset,
+            .size        = requirements.size,
+            .mapped      = block.mapped ? static_cast<char *>(block.mapped) + offset : nullptr,
+            .memory_type = memory_type,
+            .block_id    = block_id
+        };
+    };
+
+    // large resources get their own block instead of fragmenting the pool
+    if (requirements.size > block_size / 2) {
+        auto block_id = createBlock(memory_type, requirements.size, linear, true);
+        auto offset = suballocate(*blocks[block_id], requirements.size, requirements.alignment);
+        return make_allocation(block_id, *offset);
+    }
+
+    for (uint32_t i = 0; i < blocks.size(); i++) {
+        auto &block = blocks[i];
+
+        if (!block || block->dedicated) continue;
+        if (block->memory_type != memory_type || block->linear != linear) continue;
+
+        if (auto offset = suballocate(*block, requirements.size, requirements.alignment)) {
+            return make_allocation(i, *offset);
+        }
+    }
+
+    auto block_id = createBlock(memory_type, block_size, linear, false);
+    auto offset = suballocate(*blocks[block_id], requirements.size, requirements.alignment);
+    return make_allocation(block_id, *offset);
+}
+
+void GpuAllocator::invalidate(GpuAllocation const &allocation) const {
+    const auto flags = memory_properties.memoryTypes[allocation.memory_type].propertyFlags;
+    if (flags & vk::MemoryPropertyFlagBits::eHostCoherent) return;
+
+    vk::DeviceSize block_size;
+    {
+        std::lock_guard lock(mutex);
+        block_size = blocks[allocation.block_id]->size;
+    }
+
+    // ranges have to be atom aligned, but may not run past the block
+    const auto begin = allocation.offset / non_coherent_atom * non_coherent_atom;
+    const auto end = std::min(alignUp(allocation.offset + allocation.size, non_coherent_atom), block_size);
+
+    device.invalidateMappedMemoryRanges(vk::MappedMemoryRange{
+        .memory = allocation.memory,
+        .offset = begin,
+        .size   = end - begin
+    });
+}
+
+void GpuAllocator::free(GpuAllocation const &allocation) {
+    if (allocation.size == 0) return;
+
+    std::lock_guard lock(mutex);
+
+    auto &block = blocks[allocation.block_id];
+    block->allocated -= allocation.size;
+
+    if (block->dedicated) {
+        block.reset();
+        live_blocks--;
+        return;
+    }
+
+    // merge with the neighbouring free ranges
+    auto offset = allocation.offset;
+    auto size = allocation.size;
+    auto &ranges = block->free_ranges;
+
+    auto next = ranges.lower_bound(offset);
+    if (next != ranges.end() && offset + size == next->first) {
+        size += next->second;
+        next = ranges.erase(next);
+    }
+    if (next != ranges.begin()) {
+        auto prev = std::prev(next);
+        if (prev->first + prev->second == offset) {
+            offset = prev->first;
+            size += prev->second;
+            ranges.erase(prev);
+        }
+    }
+
+    ranges.emplace(offset, size);
+}
+
+GpuBuffer GpuAllocator::createBuffer(vk::BufferCreateInfo const &info, MemoryUsage usage) {
+    GpuBuffer result = nullptr;
+    result.buffer = vk::raii::Buffer(device, info);
+    result.allocation = allocate(result.buffer.getMemoryRequirements(), usage, true);
+    result.allocator = this;
+
+    result.buffer.bindMemory(result.allocation.memory, result.allocation.offset);
+    return result;
+}
+
+GpuImage GpuAllocator::createImage(vk::ImageCreateInfo const &info, MemoryUsage usage) {
+    GpuImage result = nullptr;
+    result.image = vk::raii::Image(device, info);
+    result.allocation = allocate(
+        result.image.getMemoryRequirements(),
+        usage,
+        info.tiling == vk::ImageTiling::eLinear
+    );
+    result.allocator = this;
+
+    result.image.bindMemory(result.allocation.memory, result.allocation.offset);
+    return result;
+}
+
+std::vector<HeapBudget> GpuAllocator::getBudgets() const {
+    std::vector<HeapBudget> budgets(memory_properties.memoryHeapCount);
+
+    for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+        budgets[i].heap_size = memory_properties.memoryHeaps[i].size;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        for (auto const &block : blocks) {
+            if (!block) continue;
+
+            auto heap = memory_properties.memoryTypes[block->memory_type].heapIndex;
+            budgets[heap].block_bytes += block->size;
+            budgets[heap].allocated_bytes += block->allocated;
+        }
+    }
+
+    if (memory_budget) {
+        auto chain = physical_device.getMemoryProperties2<
+            vk::PhysicalDeviceMemoryProperties2,
+            vk::PhysicalDeviceMemoryBudgetPropertiesEXT
+        >();
+        auto const &budget_properties = chain.get<vk::PhysicalDeviceMemoryBudgetPropertiesEXT>();
+
+        for (uint32_t i = 0; i < memory_properties.memoryHeapCount; i++) {
+            budgets[i].budget = budget_properties.heapBudget[i];
+            budgets[i].usage = budget_properties.heapUsage[i];
+        }
+    } else {
+        // without the extension assume we are the only user of the heap
+        for (auto &budget : budgets) {
+            budget.budget = budget.heap_size / 10 * 8;
+            budget.usage = budget.block_bytes;
+        }
+    }
+
+    return budgets;
+}
+
+
+// ----- GPU ARENA
+GpuArena::GpuArena(
+    GpuAllocator &allocator,
+    vk::DeviceSize capacity,
+    vk::BufferUsageFlags usage,
+    MemoryUsage memory_usage
+) : size(capacity) {
+    vk::BufferCreateInfo buffer_info = {
+        .size        = capacity,
+        .usage       = usage,
+        .sharingMode = vk::SharingMode::eExclusive
+    };
+
+    storage = allocator.createBuffer(buffer_info, memory_usage);
+}
+
+std::optional<GpuBufferSlice> GpuArena::allocate(vk::DeviceSize bytes, vk::DeviceSize alignment) {
+    const auto offset = alignUp(head, alignment);
+
+    if (offset + bytes > size) return std::nullopt;
+
+    head = offset + bytes;
+
+    return GpuBufferSlice {
+        .buffer = *storage,
+        .offset = offset,
+        .size   = bytes,
+        .mapped = storage.allocation.mapped
+            ? static_cast<char *>(storage.allocation.mapped) + offset
+            : nullptr
+    };
+}
+
+void GpuArena::reset() {
+    head = 0;
+}
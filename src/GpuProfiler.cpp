@@ -0,0 +1,144 @@
+#include "GpuProfiler.h"
+#include <algorithm>
+#include <numeric>
+
+// ----- PUBLIC
+GpuProfiler::GpuProfiler(
+    vk::raii::Device const &device,
+    vk::PhysicalDeviceLimits const &limits,
+    uint32_t timestamp_valid_bits,
+    uint32_t frame_count
+) {
+    // stays disabled and every call turns into a no-op
+    if (timestamp_valid_bits == 0 || !limits.timestampComputeAndGraphics) return;
+
+    period_ns = limits.timestampPeriod;
+    valid_mask = timestamp_valid_bits >= 64 ? ~0ull : (1ull << timestamp_valid_bits) - 1;
+
+    pool = vk::raii::QueryPool(device, {
+        .queryType  = vk::QueryType::eTimestamp,
+        .queryCount = frame_count * GPU_PROFILER_MAX_SCOPES * 2
+    });
+
+    frames.resize(frame_count);
+    for (auto &frame : frames) {
+        frame.names.resize(GPU_PROFILER_MAX_SCOPES);
+    }
+}
+
+void GpuProfiler::beginFrame(vk::raii::CommandBuffer const &cmd, uint32_t frame) {
+    if (!enabled()) return;
+
+    collect(frame);
+    current_frame = frame;
+
+    cmd.resetQueryPool(*pool, frame * GPU_PROFILER_MAX_SCOPES * 2, GPU_PROFILER_MAX_SCOPES * 2);
+}
+
+uint32_t GpuProfiler::begin(
+    vk::raii::CommandBuffer const &cmd,
+    const char *name,
+    vk::PipelineStageFlags2 stage
+) {
+    if (!enabled()) return GPU_PROFILER_NO_SCOPE;
+
+    auto &frame = frames[current_frame];
+    if (frame.count == GPU_PROFILER_MAX_SCOPES) return GPU_PROFILER_NO_SCOPE;
+
+    const auto scope = frame.count++;
+    frame.names[scope] = name;
+
+    cmd.writeTimestamp2(stage, *pool, (current_frame * GPU_PROFILER_MAX_SCOPES + scope) * 2);
+
+    return scope;
+}
+
+void GpuProfiler::end(
+    vk::raii::CommandBuffer const &cmd,
+    uint32_t scope,
+    vk::PipelineStageFlags2 stage
+) {
+    if (scope == GPU_PROFILER_NO_SCOPE) return;
+
+    cmd.writeTimestamp2(stage, *pool, (current_frame * GPU_PROFILER_MAX_SCOPES + scope) * 2 + 1);
+}
+
+std::vector<GpuPassStats> GpuProfiler::stats() const {
+    std::vector<GpuPassStats> result;
+    result.reserve(passes.size());
+
+    std::vector<double> sorted;
+    for (auto const &pass : passes) {
+        if (pass.count == 0) continue;
+
+        sorted.assign(pass.samples_ms.begin(), pass.samples_ms.begin() + pass.count);
+        std::ranges::sort(sorted);
+
+        const auto p99 = std::min<size_t>(sorted.size() - 1, sorted.size() * 99 / 100);
+
+        result.push_back({
+            .name   = pass.name,
+            .min_ms = sorted.front(),
+            .avg_ms = std::accumulate(sorted.begin(), sorted.end(), 0.0) / sorted.size(),
+            .p99_ms = sorted[p99]
+        });
+    }
+
+    return result;
+}
+
+std::optional<GpuSample> GpuProfiler::latest(const char *name) const {
+    auto it = std::ranges::find_if(passes, [name](auto const &pass) {
+        return pass.name == name;
+    });
+    if (it == passes.end() || it->count == 0) return std::nullopt;
+
+    const auto newest = (it->next + GPU_PROFILER_HISTORY - 1) % GPU_PROFILER_HISTORY;
+    return GpuSample{.ms = it->samples_ms[newest], .sequence = it->total};
+}
+
+
+// ----- PRIVATE
+void GpuProfiler::collect(uint32_t frame) {
+    auto &scopes = frames[frame];
+    if (scopes.count == 0) return;
+
+    // value and availability pairs, a scope missing either end is dropped
+    // instead of waiting on it
+    const uint32_t query_count = scopes.count * 2;
+    const auto data = pool.getResults<uint64_t>(
+        frame * GPU_PROFILER_MAX_SCOPES * 2,
+        query_count,
+        query_count * 2 * sizeof(uint64_t),
+        2 * sizeof(uint64_t),
+        vk::QueryResultFlagBits::e64 | vk::QueryResultFlagBits::eWithAvailability
+    ).second;
+
+    for (uint32_t scope = 0; scope < scopes.count; scope++) {
+        const auto *begin = &data[scope * 4];
+        const auto *end = begin + 2;
+
+        if (!begin[1] || !end[1]) continue;
+
+        // masking keeps the subtraction right across a counter wrap
+        const auto ticks = ((end[0] & valid_mask) - (begin[0] & valid_mask)) & valid_mask;
+
+        auto &pass = history(scopes.names[scope]);
+        pass.samples_ms[pass.next] = static_cast<double>(ticks) * period_ns * 1e-6;
+        pass.next = (pass.next + 1) % GPU_PROFILER_HISTORY;
+        pass.count = std::min(pass.count + 1, GPU_PROFILER_HISTORY);
+        pass.total++;
+    }
+
+    scopes.count = 0;
+}
+
+GpuProfiler::PassHistory &GpuProfiler::history(const char *name) {
+    auto it = std::ranges::find_if(passes, [name](auto const &pass) {
+        return pass.name == name;
+    });
+
+    if (it != passes.end()) return *it;
+
+    return passes.emplace_back(PassHistory{.name = name});
+}
@@ -0,0 +1,854 @@
+#include "GpuScene.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <stdexcept>
+#include <utility>
+#include <glm/gtc/quaternion.hpp>
+
+// ----- HELPER FUNCTIONS
+vk::raii::DescriptorSetLayout createPushSetLayout(
+    vk::raii::Device const &device,
+    std::vector<vk::DescriptorSetLayoutBinding> const &bindings
+) {
+    return vk::raii::DescriptorSetLayout(device, {
+        .flags        = vk::DescriptorSetLayoutCreateFlagBits::ePushDescriptor,
+        .bindingCount = static_cast<uint32_t>(bindings.size()),
+        .pBindings    = bindings.data()
+    });
+}
+
+PipelineRecipe computeRecipe(const char *entry, vk::PipelineLayout layout, ShaderLibrary &shaders) {
+    return [entry, layout, &shaders](vk::raii::Device const &device, vk::raii::PipelineCache const &cache) {
+        auto shader_module = createShaderModule(device, *shaders.get(SCENE_SHADER_PATH));
+
+        vk::ComputePipelineCreateInfo pipeline_info = {
+            .stage  = {
+                .stage  = vk::ShaderStageFlagBits::eCompute,
+                .module = *shader_module,
+                .pName  = entry
+            },
+            .layout = layout
+        };
+
+        return vk::raii::Pipeline(device, cache, pipeline_info);
+    };
+}
+
+// normalized planes from the rows of a Vulkan (0..w depth) projection, a
+// point is inside when dot(plane.xyz, p) + plane.w >= 0 for all six
+void extractFrustumPlanes(glm::mat4 const &m, glm::vec4 (&planes)[6]) {
+    auto row = [&](int r) { return glm::vec4(m[0][r], m[1][r], m[2][r], m[3][r]); };
+
+    planes[0] = row(3) + row(0);
+    planes[1] = row(3) - row(0);
+    planes[2] = row(3) + row(1);
+    planes[3] = row(3) - row(1);
+    planes[4] = row(2);
+    planes[5] = row(3) - row(2);
+
+    for (auto &plane : planes) {
+        plane /= glm::length(glm::vec3(plane));
+    }
+}
+
+vk::DescriptorBufferInfo bufferInfo(GpuBuffer const &buffer) {
+    return {.buffer = *buffer, .offset = 0, .range = vk::WholeSize};
+}
+
+vk::DescriptorBufferInfo sliceInfo(GpuBufferSlice const &slice) {
+    return {.buffer = slice.buffer, .offset = slice.offset, .range = slice.size};
+}
+
+// largest axis scale and the rotation left once it is divided out, shear
+// and non-uniform scale are lost
+void decomposeTransform(glm::mat4 const &m, glm::vec3 &position, glm::quat &rotation, float &scale) {
+    glm::vec3 axes[3] = {glm::vec3(m[0]), glm::vec3(m[1]), glm::vec3(m[2])};
+    const glm::vec3 lengths = {glm::length(axes[0]), glm::length(axes[1]), glm::length(axes[2])};
+
+    glm::mat3 basis(1.0f);
+    for (int i = 0; i < 3; i++) {
+        if (lengths[i] > 0.0f) basis[i] = axes[i] / lengths[i];
+    }
+
+    position = glm::vec3(m[3]);
+    rotation = glm::quat_cast(basis);
+    scale = std::max(lengths.x, std::max(lengths.y, lengths.z));
+}
+
+glm::mat4 composeTransform(glm::vec3 position, glm::quat rotation, float scale) {
+    glm::mat4 m = glm::mat4_cast(rotation);
+    m[0] *= scale;
+    m[1] *= scale;
+    m[2] *= scale;
+    m[3] = glm::vec4(position, 1.0f);
+
+    return m;
+}
+
+// same sphere as instanceSphere in scene.slang, before the transform
+glm::vec4 localSphere(GpuMeshDraw const &mesh) {
+    const auto center = glm::vec3(mesh.bounds_min + mesh.bounds_max) * 0.5f;
+    const auto radius = glm::length(glm::vec3(mesh.bounds_max - mesh.bounds_min)) * 0.5f;
+
+    return glm::vec4(center, radius);
+}
+
+// everything but first_draw, which only moves when instances are added
+void fillMeshDraw(Mesh const &mesh, GpuMeshDraw &draw) {
+    draw.bounds_min = glm::vec4(mesh.bounds_min, 0.0f);
+    draw.bounds_max = glm::vec4(mesh.bounds_max, 0.0f);
+    draw.index_count = mesh.index_count;
+    draw.meshlet_count = mesh.meshlet_count;
+}
+
+// rows [first, end) of `rows` into the same rows of `table`, through the
+// frame ring so nothing has to be allocated or retired per frame
+void copyRows(
+    vk::raii::CommandBuffer const &cmd,
+    FrameRingBuffer &frame_ring,
+    const void *rows,
+    vk::DeviceSize stride,
+    uint32_t first,
+    uint32_t end,
+    GpuBuffer const &table
+) {
+    const auto offset = first * stride;
+    const auto size = (end - first) * stride;
+
+    const auto slice = frame_ring.write(static_cast<const char *>(rows) + offset, size);
+    if (!slice) {
+        throw std::runtime_error("Frame ring buffer exhausted");
+    }
+
+    cmd.copyBuffer(slice->buffer, *table, vk::BufferCopy{slice->offset, offset, size});
+}
+
+
+// ----- PUBLIC
+GpuScene::GpuScene(
+    vk::raii::Device const &device,
+    GpuAllocator &allocator,
+    PipelineBuilder &pipeline_builder,
+    RetireCallback retire,
+    bool mesh_shading,
+    TaskScheduler *cull_scheduler
+) : device(device), allocator(allocator), retire(std::move(retire)), cull_scheduler(cull_scheduler) {
+    using Type = vk::DescriptorType;
+    constexpr auto compute = vk::ShaderStageFlagBits::eCompute;
+    constexpr auto vertex = vk::ShaderStageFlagBits::eVertex;
+
+    // binding numbers are unique across main.slang so every entry point can
+    // share one module
+    cull_set_layout = createPushSetLayout(device, {
+        {.binding = 0, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = compute},
+        {.binding = 1, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = compute},
+        {.binding = 2, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = compute},
+        {.binding = 3, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = compute},
+        {.binding = 4, .descriptorType = Type::eSampledImage,  .descriptorCount = 1, .stageFlags = compute},
+        {.binding = 5, .descriptorType = Type::eUniformBuffer, .descriptorCount = 1, .stageFlags = compute},
+        {.binding = 8, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = compute}
+    });
+    hiz_set_layout = createPushSetLayout(device, {
+        {.binding = 6, .descriptorType = Type::eSampledImage, .descriptorCount = 1, .stageFlags = compute},
+        {.binding = 7, .descriptorType = Type::eStorageImage, .descriptorCount = 1, .stageFlags = compute}
+    });
+    draw_set_layout = createPushSetLayout(device, {
+        {.binding = 0, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = vertex},
+        {.binding = 1, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = vertex}
+    });
+
+    if (mesh_shading) {
+        draw_stages |= vk::PipelineStageFlagBits2::eTaskShaderEXT | vk::PipelineStageFlagBits2::eMeshShaderEXT;
+
+        constexpr auto task = vk::ShaderStageFlagBits::eTaskEXT;
+        constexpr auto mesh = vk::ShaderStageFlagBits::eMeshEXT;
+
+        mesh_set_layout = createPushSetLayout(device, {
+            {.binding = 0,  .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = task | mesh},
+            {.binding = 1,  .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = task | mesh},
+            {.binding = 8,  .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = task},
+            {.binding = 9,  .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = task | mesh},
+            {.binding = 10, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = mesh},
+            {.binding = 11, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = mesh},
+            {.binding = 12, .descriptorType = Type::eStorageBuffer, .descriptorCount = 1, .stageFlags = mesh},
+            {.binding = 13, .descriptorType = Type::eUniformBuffer, .descriptorCount = 1, .stageFlags = task | mesh}
+        });
+    }
+
+    cull_layout = vk::raii::PipelineLayout(device, {
+        .setLayoutCount = 1,
+        .pSetLayouts    = &*cull_set_layout
+    });
+
+    // source and destination extents of the level being reduced
+    const vk::PushConstantRange hiz_range = {
+        .stageFlags = compute,
+        .offset     = 0,
+        .size       = 4 * sizeof(uint32_t)
+    };
+    hiz_layout = vk::raii::PipelineLayout(device, {
+        .setLayoutCount         = 1,
+        .pSetLayouts            = &*hiz_set_layout,
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &hiz_range
+    });
+
+    cull_pipeline = pipeline_builder.build(computeRecipe("compMain", *cull_layout, pipeline_builder.shaders()));
+    hiz_pipeline = pipeline_builder.build(computeRecipe("hizMain", *hiz_layout, pipeline_builder.shaders()));
+
+    if (cull_scheduler) cpu_instances = std::make_unique<InstanceStore>(*cull_scheduler);
+}
+
+uint32_t GpuScene::addMesh(MeshHandle mesh) {
+    meshes.push_back(std::move(mesh));
+    drawable.push_back(false);
+    mesh_instances.push_back(0);
+    resized = true;
+
+    return static_cast<uint32_t>(meshes.size() - 1);
+}
+
+uint32_t GpuScene::addTexture(TextureHandle texture, uint32_t sampler) {
+    textures.push_back({.texture = std::move(texture), .sampler = sampler});
+
+    return static_cast<uint32_t>(textures.size() - 1);
+}
+
+uint32_t GpuScene::addInstance(uint32_t mesh, glm::mat4 const &transform, uint32_t texture) {
+    if (mesh >= meshes.size()) {
+        throw std::out_of_range("Instance refers to an unknown mesh");
+    }
+    if (texture != NO_SCENE_TEXTURE && texture >= textures.size()) {
+        throw std::out_of_range("Instance refers to an unknown texture");
+    }
+
+    instances.push_back({.transform = transform, .mesh = mesh});
+    instance_textures.push_back(texture);
+    if (texture != NO_SCENE_TEXTURE) {
+        textures[texture].instances.push_back(static_cast<uint32_t>(instances.size() - 1));
+    }
+    mesh_instances[mesh]++;
+    resized = true;
+
+    // the sphere is filled in once the mesh's bounds are known
+    if (cpu_instances) {
+        glm::vec3 position;
+        glm::quat rotation;
+        float scale;
+        decomposeTransform(transform, position, rotation, scale);
+
+        cpu_instances->add(mesh, position, rotation, scale, glm::vec4(0.0f));
+    }
+
+    return static_cast<uint32_t>(instances.size() - 1);
+}
+
+void GpuScene::setTransform(uint32_t instance, glm::vec3 position, glm::quat rotation, float scale) {
+    if (cpu_instances) {
+        cpu_instances->setTransform(instance, position, rotation, scale);
+        return;
+    }
+
+    instances[instance].transform = composeTransform(position, rotation, scale);
+    dirty_instances.add(instance);
+}
+
+void GpuScene::resize(vk::Extent2D extent) {
+    if (hiz) retire(std::move(hiz));
+    hiz_valid = false;
+
+    // level 0 is half the depth buffer, every texel covers at least 2x2
+    auto level = vk::Extent2D{std::max(extent.width / 2, 1u), std::max(extent.height / 2, 1u)};
+    const auto level_count = static_cast<uint32_t>(std::bit_width(std::max(level.width, level.height)));
+
+    auto next = std::make_shared<HiZ>();
+    next->depth_extent = extent;
+    next->image = allocator.createImage({
+        .imageType     = vk::ImageType::e2D,
+        .format        = HIZ_FORMAT,
+        .extent        = {level.width, level.height, 1},
+        .mipLevels     = level_count,
+        .arrayLayers   = 1,
+        .samples       = vk::SampleCountFlagBits::e1,
+        .tiling        = vk::ImageTiling::eOptimal,
+        .usage         = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eStorage,
+        .sharingMode   = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined
+    }, MemoryUsage::eGpuOnly);
+
+    next->view = vk::raii::ImageView(device, {
+        .image            = *next->image,
+        .viewType         = vk::ImageViewType::e2D,
+        .format           = HIZ_FORMAT,
+        .subresourceRange = {vk::ImageAspectFlagBits::eColor, 0, level_count, 0, 1}
+    });
+
+    for (uint32_t i = 0; i < level_count; i++) {
+        next->levels.emplace_back(device, vk::ImageViewCreateInfo {
+            .image            = *next->image,
+            .viewType         = vk::ImageViewType::e2D,
+            .format           = HIZ_FORMAT,
+            .subresourceRange = {vk::ImageAspectFlagBits::eColor, i, 1, 0, 1}
+        });
+        next->extents.push_back(level);
+
+        level = {std::max(level.width / 2, 1u), std::max(level.height / 2, 1u)};
+    }
+
+    hiz = std::move(next);
+}
+
+bool GpuScene::update() {
+    if (!cull_pipeline.ready() || !hiz_pipeline.ready() || !hiz || instances.empty()) return false;
+
+    if (!tables || resized) {
+        rebuildTables();
+    } else {
+        refreshTables();
+    }
+
+    return true;
+}
+
+bool GpuScene::resident() const {
+    for (size_t i = 0; i < meshes.size(); i++) {
+        const auto state = meshes[i]->state.load(std::memory_order_acquire);
+        if (state == MeshState::eFailed) continue;
+        if (state != MeshState::eReady || !drawable[i]) return false;
+    }
+    for (auto const &texture : textures) {
+        const auto state = texture.texture->state.load(std::memory_order_acquire);
+        if (state == TextureState::eFailed) continue;
+        if (state != TextureState::eReady || texture.texture->bindlessIndex() != texture.slot) return false;
+    }
+
+    return true;
+}
+
+void GpuScene::cullOnCpu(FrameRingBuffer &frame_ring, glm::mat4 const &view_proj, bool task_draws) {
+    if (!cpu_instances) return;
+
+    glm::vec4 planes[6];
+    extractFrustumPlanes(view_proj, planes);
+
+    cpu_instances->update();
+    cpu_instances->cull(planes);
+
+    // survivors are packed into the same per mesh ranges the cull shader
+    // uses, the task shader finds its command through first_draw. Every
+    // chunk continues where the chunks before it left off
+    const auto mesh_count = static_cast<uint32_t>(meshes.size());
+    const auto group_count = cpu_instances->groupCount();
+    const auto chunk_count = cpu_instances->chunkCount();
+
+    cpu_draws.counts.assign(mesh_count, 0);
+    chunk_offsets.resize(size_t(chunk_count) * mesh_count);
+
+    for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+        const auto visible = cpu_instances->chunkVisible(chunk);
+        for (uint32_t mesh = 0; mesh < group_count; mesh++) {
+            chunk_offsets[size_t(chunk) * mesh_count + mesh] = mesh_draws[mesh].first_draw + cpu_draws.counts[mesh];
+            cpu_draws.counts[mesh] += visible[mesh];
+        }
+    }
+
+    const vk::DeviceSize command_size = task_draws ? sizeof(GpuTaskCommand) : sizeof(vk::DrawIndexedIndirectCommand);
+    const auto slots = instances.size();
+    const auto instance_slice = frame_ring.allocate(slots * sizeof(GpuInstance));
+    const auto draw_slice = frame_ring.allocate(slots * command_size);
+    if (!instance_slice || !draw_slice) {
+        throw std::runtime_error("Frame ring buffer exhausted");
+    }
+    cpu_draws.instances = *instance_slice;
+    cpu_draws.draws = *draw_slice;
+
+    auto *packed = static_cast<GpuInstance *>(instance_slice->mapped);
+    auto *task_commands = static_cast<GpuTaskCommand *>(draw_slice->mapped);
+    auto *draw_commands = static_cast<vk::DrawIndexedIndirectCommand *>(draw_slice->mapped);
+
+    CpuScope scope("instance pack");
+    cull_scheduler->parallelFor(cpu_instances->size(), INSTANCE_CHUNK_SIZE, [&](uint32_t begin, uint32_t end) {
+        auto *next = chunk_offsets.data() + size_t(begin / INSTANCE_CHUNK_SIZE) * mesh_count;
+
+        for (uint32_t i = begin; i < end; i++) {
+            if (!cpu_instances->visible(i)) continue;
+
+            auto const &instance = instances[i];
+            auto const &mesh = mesh_draws[instance.mesh];
+            const auto slot = next[instance.mesh]++;
+
+            packed[slot] = {
+                .transform = cpu_instances->world(i),
+                .mesh      = instance.mesh,
+                .texture   = instance.texture,
+                .sampler   = instance.sampler
+            };
+
+            // the packed slot doubles as the instance index
+            if (task_draws) {
+                task_commands[slot] = {
+                    .command  = {(mesh.meshlet_count + TASK_GROUP_SIZE - 1) / TASK_GROUP_SIZE, 1, 1},
+                    .instance = slot
+                };
+            } else {
+                draw_commands[slot] = {
+                    .indexCount    = mesh.index_count,
+                    .instanceCount = 1,
+                    .firstIndex    = 0,
+                    .vertexOffset  = 0,
+                    .firstInstance = slot
+                };
+            }
+        }
+    });
+}
+
+vk::DeviceSize GpuScene::frameRingBytes() const {
+    // every row changed, plus room to align both slices
+    constexpr vk::DeviceSize slice_alignment = 256;
+    const auto table_bytes = instances.size() * sizeof(GpuInstance) + meshes.size() * sizeof(GpuMeshDraw) + 2 * slice_alignment;
+    if (!cpu_instances) return table_bytes;
+
+    // and every instance visible
+    return table_bytes + instances.size() * (sizeof(GpuInstance) + sizeof(vk::DrawIndexedIndirectCommand)) + 2 * slice_alignment;
+}
+
+void GpuScene::reloadPipelines(PipelineBuilder &pipeline_builder) {
+    next_cull_pipeline = pipeline_builder.build(computeRecipe("compMain", *cull_layout, pipeline_builder.shaders()));
+    next_hiz_pipeline = pipeline_builder.build(computeRecipe("hizMain", *hiz_layout, pipeline_builder.shaders()));
+}
+
+bool GpuScene::reloadDone() const {
+    auto done = [](PipelineHandle const &handle) { return handle.empty() || handle.ready(); };
+    return done(next_cull_pipeline) && done(next_hiz_pipeline);
+}
+
+void GpuScene::swapPipelines() {
+    if (next_cull_pipeline.empty() && next_hiz_pipeline.empty()) return;
+
+    auto next_cull = std::exchange(next_cull_pipeline, {});
+    auto next_hiz = std::exchange(next_hiz_pipeline, {});
+
+    // get() rethrows a failed compile before anything is replaced
+    next_cull.get();
+    next_hiz.get();
+
+    auto old = std::make_shared<std::pair<PipelineHandle, PipelineHandle>>(
+        std::exchange(cull_pipeline, std::move(next_cull)),
+        std::exchange(hiz_pipeline, std::move(next_hiz))
+    );
+    retire(std::move(old));
+}
+
+RenderImage GpuScene::importHiZ(RenderGraph &graph) {
+    const ImageState initial = hiz_valid
+        ? ImageState{vk::ImageLayout::eGeneral, vk::PipelineStageFlagBits2::eComputeShader, vk::AccessFlagBits2::eShaderStorageWrite}
+        : ImageState{};
+
+    return graph.importImage(
+        "hi-z",
+        *hiz->image,
+        *hiz->view,
+        HIZ_FORMAT,
+        hiz->extents.front(),
+        initial,
+        vk::ImageLayout::eGeneral
+    );
+}
+
+void GpuScene::cull(
+    vk::raii::CommandBuffer const &cmd,
+    FrameRingBuffer &frame_ring,
+    glm::mat4 const &view_proj,
+    bool task_draws
+) {
+    frame_view_proj = view_proj;
+
+    // last frame's culling, indirect reads and vertex fetches are done
+    // before the tables are overwritten
+    const vk::MemoryBarrier2 reuse_barrier = {
+        .srcStageMask = vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eDrawIndirect | draw_stages,
+        .dstStageMask = vk::PipelineStageFlagBits2::eAllTransfer | vk::PipelineStageFlagBits2::eComputeShader
+    };
+    cmd.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &reuse_barrier});
+
+    if (!dirty_instances.empty()) {
+        copyRows(cmd, frame_ring, instances.data(), sizeof(GpuInstance), dirty_instances.first, dirty_instances.end, tables->instances);
+        dirty_instances = {};
+    }
+    if (!dirty_meshes.empty()) {
+        copyRows(cmd, frame_ring, mesh_draws.data(), sizeof(GpuMeshDraw), dirty_meshes.first, dirty_meshes.end, tables->meshes);
+        dirty_meshes = {};
+    }
+
+    if (!cpu_instances) cmd.fillBuffer(*tables->counts, 0, vk::WholeSize, 0);
+
+    const vk::MemoryBarrier2 transfer_barrier = {
+        .srcStageMask  = vk::PipelineStageFlagBits2::eAllTransfer,
+        .srcAccessMask = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask  = vk::PipelineStageFlagBits2::eComputeShader | draw_stages,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderStorageRead | vk::AccessFlagBits2::eShaderStorageWrite
+    };
+    cmd.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &transfer_barrier});
+
+    // cullOnCpu already wrote the draws, host writes are visible at submit
+    if (cpu_instances) return;
+
+    GpuCullConstants constants = {
+        .prev_view_proj = hiz_view_proj,
+        .hiz_size       = glm::vec2(hiz->extents.front().width, hiz->extents.front().height),
+        .instance_count = static_cast<uint32_t>(instances.size()),
+        .hiz_levels     = static_cast<uint32_t>(hiz->levels.size()),
+        .occlusion      = hiz_valid ? 1u : 0u,
+        .task_draws     = task_draws ? 1u : 0u
+    };
+    extractFrustumPlanes(view_proj, constants.planes);
+
+    const auto constant_slice = frame_ring.push(constants);
+    if (!constant_slice) {
+        throw std::runtime_error("Frame ring buffer exhausted");
+    }
+
+    const auto instance_info = bufferInfo(tables->instances);
+    const auto mesh_info = bufferInfo(tables->meshes);
+    const auto draw_info = bufferInfo(tables->draws);
+    const auto count_info = bufferInfo(tables->counts);
+    const vk::DescriptorImageInfo hiz_info = {
+        .imageView   = *hiz->view,
+        .imageLayout = vk::ImageLayout::eShaderReadOnlyOptimal
+    };
+    const vk::DescriptorBufferInfo constant_info = {
+        .buffer = constant_slice->buffer,
+        .offset = constant_slice->offset,
+        .range  = constant_slice->size
+    };
+
+    auto write = [](uint32_t binding, vk::DescriptorType type) {
+        return vk::WriteDescriptorSet {
+            .dstBinding      = binding,
+            .descriptorCount = 1,
+            .descriptorType  = type
+        };
+    };
+    // both draw paths share the draw buffer, only one is written
+    std::array<vk::WriteDescriptorSet, 7> writes = {
+        write(0, vk::DescriptorType::eStorageBuffer),
+        write(1, vk::DescriptorType::eStorageBuffer),
+        write(2, vk::DescriptorType::eStorageBuffer),
+        write(3, vk::DescriptorType::eStorageBuffer),
+        write(4, vk::DescriptorType::eSampledImage),
+        write(5, vk::DescriptorType::eUniformBuffer),
+        write(8, vk::DescriptorType::eStorageBuffer)
+    };
+    writes[0].pBufferInfo = &instance_info;
+    writes[1].pBufferInfo = &mesh_info;
+    writes[2].pBufferInfo = &draw_info;
+    writes[3].pBufferInfo = &count_info;
+    writes[4].pImageInfo = &hiz_info;
+    writes[5].pBufferInfo = &constant_info;
+    writes[6].pBufferInfo = &draw_info;
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, cull_pipeline.get());
+    cmd.pushDescriptorSet(vk::PipelineBindPoint::eCompute, *cull_layout, 0, writes);
+    cmd.dispatch((constants.instance_count + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+
+    const vk::MemoryBarrier2 indirect_barrier = {
+        .srcStageMask  = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+        .dstStageMask  = vk::PipelineStageFlagBits2::eDrawIndirect | draw_stages,
+        .dstAccessMask = vk::AccessFlagBits2::eIndirectCommandRead | vk::AccessFlagBits2::eShaderStorageRead
+    };
+    cmd.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &indirect_barrier});
+}
+
+void GpuScene::draw(vk::raii::CommandBuffer const &cmd, vk::PipelineLayout layout, uint32_t first_mesh, uint32_t end_mesh) const {
+    const auto instance_info = cpu_instances ? sliceInfo(cpu_draws.instances) : bufferInfo(tables->instances);
+    const auto mesh_info = bufferInfo(tables->meshes);
+
+    std::array<vk::WriteDescriptorSet, 2> writes = {{
+        {
+            .dstBinding      = 0,
+            .descriptorCount = 1,
+            .descriptorType  = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo     = &instance_info
+        },
+        {
+            .dstBinding      = 1,
+            .descriptorCount = 1,
+            .descriptorType  = vk::DescriptorType::eStorageBuffer,
+            .pBufferInfo     = &mesh_info
+        }
+    }};
+    cmd.pushDescriptorSet(vk::PipelineBindPoint::eGraphics, layout, 0, writes);
+
+    // one call per mesh whatever the instance count, the GPU decides how
+    // many of the mesh's draw slots are used, or the CPU already knows
+    for (uint32_t i = first_mesh; i < end_mesh; i++) {
+        if (!drawable[i] || mesh_instances[i] == 0) continue;
+        if (cpu_instances && cpu_draws.counts[i] == 0) continue;
+
+        auto const &mesh = *meshes[i];
+        cmd.bindVertexBuffers(0, {*mesh.vertex_buffer}, {vk::DeviceSize(0)});
+        cmd.bindIndexBuffer(*mesh.index_buffer, 0, mesh.index_type);
+
+        if (cpu_instances) {
+            cmd.drawIndexedIndirect(
+                cpu_draws.draws.buffer,
+                cpu_draws.draws.offset + mesh_draws[i].first_draw * sizeof(vk::DrawIndexedIndirectCommand),
+                cpu_draws.counts[i],
+                sizeof(vk::DrawIndexedIndirectCommand)
+            );
+            continue;
+        }
+
+        cmd.drawIndexedIndirectCount(
+            *tables->draws,
+            mesh_draws[i].first_draw * sizeof(vk::DrawIndexedIndirectCommand),
+            *tables->counts,
+            i * sizeof(uint32_t),
+            mesh_instances[i],
+            sizeof(vk::DrawIndexedIndirectCommand)
+        );
+    }
+}
+
+void GpuScene::drawMeshlets(
+    vk::raii::CommandBuffer const &cmd,
+    vk::PipelineLayout layout,
+    GpuBufferSlice const &camera,
+    uint32_t first_mesh,
+    uint32_t end_mesh
+) const {
+    const auto instance_info = cpu_instances ? sliceInfo(cpu_draws.instances) : bufferInfo(tables->instances);
+    const auto mesh_info = bufferInfo(tables->meshes);
+    const auto task_info = cpu_instances ? sliceInfo(cpu_draws.draws) : bufferInfo(tables->draws);
+    const vk::DescriptorBufferInfo camera_info = {
+        .buffer = camera.buffer,
+        .offset = camera.offset,
+        .range  = camera.size
+    };
+
+    for (uint32_t i = first_mesh; i < end_mesh; i++) {
+        if (!drawable[i] || mesh_instances[i] == 0) continue;
+        if (cpu_instances && cpu_draws.counts[i] == 0) continue;
+
+        auto const &mesh = *meshes[i];
+        const auto meshlet_info = bufferInfo(mesh.meshlet_buffer);
+        const auto meshlet_vertex_info = bufferInfo(mesh.meshlet_vertex_buffer);
+        const auto meshlet_triangle_info = bufferInfo(mesh.meshlet_triangle_buffer);
+        const auto vertex_info = bufferInfo(mesh.vertex_buffer);
+
+        auto write = [](uint32_t binding, vk::DescriptorType type, vk::DescriptorBufferInfo const &info) {
+            return vk::WriteDescriptorSet {
+                .dstBinding      = binding,
+                .descriptorCount = 1,
+                .descriptorType  = type,
+                .pBufferInfo     = &info
+            };
+        };
+        const std::array<vk::WriteDescriptorSet, 8> writes = {
+            write(0, vk::DescriptorType::eStorageBuffer, instance_info),
+            write(1, vk::DescriptorType::eStorageBuffer, mesh_info),
+            write(8, vk::DescriptorType::eStorageBuffer, task_info),
+            write(9, vk::DescriptorType::eStorageBuffer, meshlet_info),
+            write(10, vk::DescriptorType::eStorageBuffer, meshlet_vertex_info),
+            write(11, vk::DescriptorType::eStorageBuffer, meshlet_triangle_info),
+            write(12, vk::DescriptorType::eStorageBuffer, vertex_info),
+            write(13, vk::DescriptorType::eUniformBuffer, camera_info)
+        };
+
+        cmd.pushDescriptorSet(vk::PipelineBindPoint::eGraphics, layout, 0, writes);
+        cmd.pushConstants<uint32_t>(layout, vk::ShaderStageFlagBits::eTaskEXT, 0, i);
+
+        if (cpu_instances) {
+            cmd.drawMeshTasksIndirectEXT(
+                cpu_draws.draws.buffer,
+                cpu_draws.draws.offset + mesh_draws[i].first_draw * sizeof(GpuTaskCommand),
+                cpu_draws.counts[i],
+                sizeof(GpuTaskCommand)
+            );
+            continue;
+        }
+
+        cmd.drawMeshTasksIndirectCountEXT(
+            *tables->draws,
+            mesh_draws[i].first_draw * sizeof(GpuTaskCommand),
+            *tables->counts,
+            i * sizeof(uint32_t),
+            mesh_instances[i],
+            sizeof(GpuTaskCommand)
+        );
+    }
+}
+
+GpuBufferSlice GpuScene::meshletConstants(FrameRingBuffer &frame_ring, glm::mat4 const &view_proj, glm::vec3 eye) {
+    GpuMeshletConstants constants = {
+        .view_proj = view_proj,
+        .eye       = glm::vec4(eye, 1.0f)
+    };
+    extractFrustumPlanes(view_proj, constants.planes);
+
+    const auto slice = frame_ring.push(constants);
+    if (!slice) {
+        throw std::runtime_error("Frame ring buffer exhausted");
+    }
+
+    return *slice;
+}
+
+void GpuScene::buildHiZ(vk::raii::CommandBuffer const &cmd, vk::ImageView depth) {
+    // the CPU path only tests the frustum, nothing reads the pyramid
+    if (cpu_instances) return;
+
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, hiz_pipeline.get());
+
+    const vk::MemoryBarrier2 level_barrier = {
+        .srcStageMask  = vk::PipelineStageFlagBits2::eComputeShader,
+        .srcAccessMask = vk::AccessFlagBits2::eShaderStorageWrite,
+        .dstStageMask  = vk::PipelineStageFlagBits2::eComputeShader,
+        .dstAccessMask = vk::AccessFlagBits2::eShaderSampledRead
+    };
+
+    // each level keeps the farthest depth of the texels it covers
+    auto src_extent = hiz->depth_extent;
+    for (size_t i = 0; i < hiz->levels.size(); i++) {
+        const vk::DescriptorImageInfo src_info = {
+            .imageView   = i == 0 ? depth : *hiz->levels[i - 1],
+            .imageLayout = i == 0 ? vk::ImageLayout::eDepthReadOnlyOptimal : vk::ImageLayout::eGeneral
+        };
+        const vk::DescriptorImageInfo dst_info = {
+            .imageView   = *hiz->levels[i],
+            .imageLayout = vk::ImageLayout::eGeneral
+        };
+        std::array<vk::WriteDescriptorSet, 2> writes = {{
+            {
+                .dstBinding      = 6,
+                .descriptorCount = 1,
+                .descriptorType  = vk::DescriptorType::eSampledImage,
+                .pImageInfo      = &src_info
+            },
+            {
+                .dstBinding      = 7,
+                .descriptorCount = 1,
+                .descriptorType  = vk::DescriptorType::eStorageImage,
+                .pImageInfo      = &dst_info
+            }
+        }};
+
+        const auto dst_extent = hiz->extents[i];
+        const std::array<uint32_t, 4> extents = {src_extent.width, src_extent.height, dst_extent.width, dst_extent.height};
+
+        if (i > 0) cmd.pipelineBarrier2({.memoryBarrierCount = 1, .pMemoryBarriers = &level_barrier});
+
+        cmd.pushDescriptorSet(vk::PipelineBindPoint::eCompute, *hiz_layout, 0, writes);
+        cmd.pushConstants<uint32_t>(*hiz_layout, vk::ShaderStageFlagBits::eCompute, 0, extents);
+        cmd.dispatch(
+            (dst_extent.width + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+            (dst_extent.height + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE,
+            1
+        );
+
+        src_extent = dst_extent;
+    }
+
+    hiz_valid = true;
+    hiz_view_proj = frame_view_proj;
+}
+
+
+// ----- PRIVATE
+void GpuScene::refreshTables() {
+    // a mesh that finished loading only changes its own row, its instances
+    // pick it up through the mesh index
+    bool arrived = false;
+    for (uint32_t i = 0; i < meshes.size(); i++) {
+        if (drawable[i] || meshes[i]->state.load(std::memory_order_acquire) != MeshState::eReady) continue;
+
+        drawable[i] = true;
+        fillMeshDraw(*meshes[i], mesh_draws[i]);
+        dirty_meshes.add(i);
+        arrived = true;
+    }
+
+    if (arrived && cpu_instances) {
+        for (uint32_t i = 0; i < instances.size(); i++) {
+            const auto mesh = instances[i].mesh;
+            if (drawable[mesh]) cpu_instances->setSphere(i, localSphere(mesh_draws[mesh]));
+        }
+    }
+
+    // every view keeps its own slot, so moving to a finer mip only changes
+    // which slot the texture's instances point at
+    for (auto &texture : textures) {
+        const auto slot = texture.texture->bindlessIndex();
+        if (slot == texture.slot) continue;
+
+        texture.slot = slot;
+        for (const auto i : texture.instances) {
+            instances[i].texture = slot;
+            instances[i].sampler = slot == BINDLESS_NONE ? BINDLESS_NONE : texture.sampler;
+            dirty_instances.add(i);
+        }
+    }
+}
+
+void GpuScene::rebuildTables() {
+    resized = false;
+
+    mesh_draws.assign(meshes.size(), {});
+    uint32_t first_draw = 0;
+    for (size_t i = 0; i < meshes.size(); i++) {
+        auto const &mesh = *meshes[i];
+        drawable[i] = mesh.state.load(std::memory_order_acquire) == MeshState::eReady;
+
+        mesh_draws[i].first_draw = first_draw;
+        first_draw += mesh_instances[i];
+
+        if (drawable[i]) fillMeshDraw(mesh, mesh_draws[i]);
+    }
+
+    for (auto &texture : textures) {
+        texture.slot = texture.texture->bindlessIndex();
+    }
+    for (size_t i = 0; i < instances.size(); i++) {
+        if (instance_textures[i] == NO_SCENE_TEXTURE) continue;
+
+        auto const &texture = textures[instance_textures[i]];
+        instances[i].texture = texture.slot;
+        instances[i].sampler = texture.slot == BINDLESS_NONE ? BINDLESS_NONE : texture.sampler;
+    }
+
+    // meshes still loading keep an empty sphere, they are skipped when drawn
+    if (cpu_instances) {
+        for (uint32_t i = 0; i < instances.size(); i++) {
+            const auto mesh = instances[i].mesh;
+            if (drawable[mesh]) cpu_instances->setSphere(i, localSphere(mesh_draws[mesh]));
+        }
+    }
+
+    if (tables) retire(std::move(tables));
+
+    auto storage = [&](vk::DeviceSize size, vk::BufferUsageFlags usage) {
+        return allocator.createBuffer({
+            .size        = size,
+            .usage       = vk::BufferUsageFlagBits::eStorageBuffer | usage,
+            .sharingMode = vk::SharingMode::eExclusive
+        }, MemoryUsage::eGpuOnly);
+    };
+
+    auto next = std::make_shared<Tables>();
+    next->instances = storage(instances.size() * sizeof(GpuInstance), vk::BufferUsageFlagBits::eTransferDst);
+    next->meshes = storage(mesh_draws.size() * sizeof(GpuMeshDraw), vk::BufferUsageFlagBits::eTransferDst);
+    next->draws = storage(instances.size() * sizeof(vk::DrawIndexedIndirectCommand), vk::BufferUsageFlagBits::eIndirectBuffer);
+    next->counts = storage(
+        mesh_draws.size() * sizeof(uint32_t),
+        vk::BufferUsageFlagBits::eIndirectBuffer | vk::BufferUsageFlagBits::eTransferDst
+    );
+    tables = std::move(next);
+
+    // the new tables start out empty, the next cull pass fills every row
+    dirty_instances = {.first = 0, .end = static_cast<uint32_t>(instances.size())};
+    dirty_meshes = {.first = 0, .end = static_cast<uint32_t>(mesh_draws.size())};
+}
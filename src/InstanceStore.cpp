@@ -0,0 +1,251 @@
+#include "InstanceStore.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define INSTANCE_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif defined(__ARM_NEON)
+#define INSTANCE_SIMD_NEON 1
+#include <arm_neon.h>
+#endif
+
+// ----- HELPER FUNCTIONS
+// four lanes of floats, loads and stores are unaligned so the SoA vectors
+// need no special allocator
+struct SimdFloat {
+#if defined(INSTANCE_SIMD_SSE2)
+    __m128 v;
+
+    static SimdFloat load(const float *p) { return {_mm_loadu_ps(p)}; }
+    static SimdFloat splat(float x) { return {_mm_set1_ps(x)}; }
+    void store(float *p) const { _mm_storeu_ps(p, v); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return {_mm_add_ps(a.v, b.v)}; }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return {_mm_sub_ps(a.v, b.v)}; }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return {_mm_mul_ps(a.v, b.v)}; }
+
+    // bit i set when lane i of a is below lane i of b
+    friend uint32_t lessMask(SimdFloat a, SimdFloat b) {
+        return static_cast<uint32_t>(_mm_movemask_ps(_mm_cmplt_ps(a.v, b.v)));
+    }
+#elif defined(INSTANCE_SIMD_NEON)
+    float32x4_t v;
+
+    static SimdFloat load(const float *p) { return {vld1q_f32(p)}; }
+    static SimdFloat splat(float x) { return {vdupq_n_f32(x)}; }
+    void store(float *p) const { vst1q_f32(p, v); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return {vaddq_f32(a.v, b.v)}; }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return {vsubq_f32(a.v, b.v)}; }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return {vmulq_f32(a.v, b.v)}; }
+
+    friend uint32_t lessMask(SimdFloat a, SimdFloat b) {
+        static const uint32_t lane_bits[4] = {1, 2, 4, 8};
+        const auto bits = vandq_u32(vcltq_f32(a.v, b.v), vld1q_u32(lane_bits));
+
+        return vgetq_lane_u32(bits, 0) | vgetq_lane_u32(bits, 1) | vgetq_lane_u32(bits, 2) | vgetq_lane_u32(bits, 3);
+    }
+#else
+    float v[4];
+
+    static SimdFloat load(const float *p) { return {{p[0], p[1], p[2], p[3]}}; }
+    static SimdFloat splat(float x) { return {{x, x, x, x}}; }
+    void store(float *p) const { std::copy(v, v + 4, p); }
+
+    friend SimdFloat operator+(SimdFloat a, SimdFloat b) { return {{a.v[0] + b.v[0], a.v[1] + b.v[1], a.v[2] + b.v[2], a.v[3] + b.v[3]}}; }
+    friend SimdFloat operator-(SimdFloat a, SimdFloat b) { return {{a.v[0] - b.v[0], a.v[1] - b.v[1], a.v[2] - b.v[2], a.v[3] - b.v[3]}}; }
+    friend SimdFloat operator*(SimdFloat a, SimdFloat b) { return {{a.v[0] * b.v[0], a.v[1] * b.v[1], a.v[2] * b.v[2], a.v[3] * b.v[3]}}; }
+
+    friend uint32_t lessMask(SimdFloat a, SimdFloat b) {
+        uint32_t mask = 0;
+        for (uint32_t i = 0; i < 4; i++) {
+            if (a.v[i] < b.v[i]) mask |= 1u << i;
+        }
+        return mask;
+    }
+#endif
+};
+
+// rows become columns, lane i of every input ends up in output i
+void transpose(SimdFloat &a, SimdFloat &b, SimdFloat &c, SimdFloat &d) {
+#if defined(INSTANCE_SIMD_SSE2)
+    _MM_TRANSPOSE4_PS(a.v, b.v, c.v, d.v);
+#elif defined(INSTANCE_SIMD_NEON)
+    const auto ab = vtrnq_f32(a.v, b.v);
+    const auto cd = vtrnq_f32(c.v, d.v);
+
+    a.v = vcombine_f32(vget_low_f32(ab.val[0]), vget_low_f32(cd.val[0]));
+    b.v = vcombine_f32(vget_low_f32(ab.val[1]), vget_low_f32(cd.val[1]));
+    c.v = vcombine_f32(vget_high_f32(ab.val[0]), vget_high_f32(cd.val[0]));
+    d.v = vcombine_f32(vget_high_f32(ab.val[1]), vget_high_f32(cd.val[1]));
+#else
+    std::swap(a.v[1], b.v[0]);
+    std::swap(a.v[2], c.v[0]);
+    std::swap(a.v[3], d.v[0]);
+    std::swap(b.v[2], c.v[1]);
+    std::swap(b.v[3], d.v[1]);
+    std::swap(c.v[3], d.v[2]);
+#endif
+}
+
+// column `column` of four consecutive matrices from one register per row
+void storeColumn(glm::mat4 *worlds, int column, SimdFloat x, SimdFloat y, SimdFloat z, SimdFloat w) {
+    transpose(x, y, z, w);
+
+    x.store(&worlds[0][column].x);
+    y.store(&worlds[1][column].x);
+    z.store(&worlds[2][column].x);
+    w.store(&worlds[3][column].x);
+}
+
+
+// ----- PUBLIC
+uint32_t InstanceStore::add(uint32_t group, glm::vec3 position, glm::quat rotation, float instance_scale, glm::vec4 sphere) {
+    // grow a whole SIMD block at a time, the new lanes stay zero
+    if (count % INSTANCE_SIMD_WIDTH == 0) {
+        const size_t padded = count + INSTANCE_SIMD_WIDTH;
+
+        for (auto *values : {
+            &position_x, &position_y, &position_z,
+            &rotation_x, &rotation_y, &rotation_z, &rotation_w,
+            &scale, &sphere_x, &sphere_y, &sphere_z, &sphere_radius,
+            &world_x, &world_y, &world_z, &world_radius
+        }) {
+            values->resize(padded, 0.0f);
+        }
+        groups.resize(padded, 0);
+        worlds.resize(padded, glm::mat4(0.0f));
+        visibility.resize(padded, 0);
+    }
+
+    const auto index = count++;
+    groups[index] = group;
+    group_count = std::max(group_count, group + 1);
+
+    setTransform(index, position, rotation, instance_scale);
+    setSphere(index, sphere);
+
+    return index;
+}
+
+void InstanceStore::setTransform(uint32_t index, glm::vec3 position, glm::quat rotation, float instance_scale) {
+    position_x[index] = position.x;
+    position_y[index] = position.y;
+    position_z[index] = position.z;
+
+    rotation = glm::normalize(rotation);
+    rotation_x[index] = rotation.x;
+    rotation_y[index] = rotation.y;
+    rotation_z[index] = rotation.z;
+    rotation_w[index] = rotation.w;
+
+    scale[index] = instance_scale;
+    moved = true;
+}
+
+void InstanceStore::setSphere(uint32_t index, glm::vec4 sphere) {
+    sphere_x[index] = sphere.x;
+    sphere_y[index] = sphere.y;
+    sphere_z[index] = sphere.z;
+    sphere_radius[index] = sphere.w;
+    moved = true;
+}
+
+void InstanceStore::update() {
+    if (!moved) return;
+    moved = false;
+
+    CpuScope scope("instance update");
+    scheduler.parallelFor(count, INSTANCE_CHUNK_SIZE, [this](uint32_t begin, uint32_t end) {
+        updateRange(begin, end);
+    });
+}
+
+void InstanceStore::cull(glm::vec4 const (&planes)[6]) {
+    CpuScope scope("instance cull");
+
+    chunk_visible.assign(size_t(chunkCount()) * group_count, 0);
+    scheduler.parallelFor(count, INSTANCE_CHUNK_SIZE, [this, &planes](uint32_t begin, uint32_t end) {
+        cullRange(begin, end, planes);
+    });
+}
+
+
+// ----- PRIVATE
+void InstanceStore::updateRange(uint32_t begin, uint32_t end) {
+    const auto one = SimdFloat::splat(1.0f);
+    const auto two = SimdFloat::splat(2.0f);
+    const auto zero = SimdFloat::splat(0.0f);
+
+    // ranges start on a chunk boundary, the last block may run into padding
+    for (uint32_t i = begin; i < end; i += INSTANCE_SIMD_WIDTH) {
+        const auto qx = SimdFloat::load(&rotation_x[i]);
+        const auto qy = SimdFloat::load(&rotation_y[i]);
+        const auto qz = SimdFloat::load(&rotation_z[i]);
+        const auto qw = SimdFloat::load(&rotation_w[i]);
+        const auto s = SimdFloat::load(&scale[i]);
+        const auto s2 = s * two;
+
+        const auto xx = qx * qx, yy = qy * qy, zz = qz * qz;
+        const auto xy = qx * qy, xz = qx * qz, yz = qy * qz;
+        const auto wx = qw * qx, wy = qw * qy, wz = qw * qz;
+
+        // the rotation matrix of a unit quaternion, as glm::mat3_cast, with
+        // the uniform scale folded in
+        const auto m00 = s - s2 * (yy + zz), m01 = s2 * (xy + wz), m02 = s2 * (xz - wy);
+        const auto m10 = s2 * (xy - wz), m11 = s - s2 * (xx + zz), m12 = s2 * (yz + wx);
+        const auto m20 = s2 * (xz + wy), m21 = s2 * (yz - wx), m22 = s - s2 * (xx + yy);
+
+        const auto px = SimdFloat::load(&position_x[i]);
+        const auto py = SimdFloat::load(&position_y[i]);
+        const auto pz = SimdFloat::load(&position_z[i]);
+
+        storeColumn(&worlds[i], 0, m00, m01, m02, zero);
+        storeColumn(&worlds[i], 1, m10, m11, m12, zero);
+        storeColumn(&worlds[i], 2, m20, m21, m22, zero);
+        storeColumn(&worlds[i], 3, px, py, pz, one);
+
+        const auto cx = SimdFloat::load(&sphere_x[i]);
+        const auto cy = SimdFloat::load(&sphere_y[i]);
+        const auto cz = SimdFloat::load(&sphere_z[i]);
+
+        (m00 * cx + m10 * cy + m20 * cz + px).store(&world_x[i]);
+        (m01 * cx + m11 * cy + m21 * cz + py).store(&world_y[i]);
+        (m02 * cx + m12 * cy + m22 * cz + pz).store(&world_z[i]);
+        (SimdFloat::load(&sphere_radius[i]) * s).store(&world_radius[i]);
+    }
+}
+
+void InstanceStore::cullRange(uint32_t begin, uint32_t end, glm::vec4 const (&planes)[6]) {
+    SimdFloat plane_x[6], plane_y[6], plane_z[6], plane_w[6];
+    for (int p = 0; p < 6; p++) {
+        plane_x[p] = SimdFloat::splat(planes[p].x);
+        plane_y[p] = SimdFloat::splat(planes[p].y);
+        plane_z[p] = SimdFloat::splat(planes[p].z);
+        plane_w[p] = SimdFloat::splat(planes[p].w);
+    }
+
+    auto *visible_counts = chunk_visible.data() + size_t(begin / INSTANCE_CHUNK_SIZE) * group_count;
+
+    for (uint32_t i = begin; i < end; i += INSTANCE_SIMD_WIDTH) {
+        const auto x = SimdFloat::load(&world_x[i]);
+        const auto y = SimdFloat::load(&world_y[i]);
+        const auto z = SimdFloat::load(&world_z[i]);
+        const auto negative_radius = SimdFloat::splat(0.0f) - SimdFloat::load(&world_radius[i]);
+
+        // a lane is out once the sphere is fully behind any plane
+        uint32_t outside = 0;
+        for (int p = 0; p < 6; p++) {
+            const auto distance = plane_x[p] * x + plane_y[p] * y + plane_z[p] * z + plane_w[p];
+            outside |= lessMask(distance, negative_radius);
+        }
+
+        const auto lanes = std::min(INSTANCE_SIMD_WIDTH, end - i);
+        for (uint32_t lane = 0; lane < lanes; lane++) {
+            const bool inside = (outside & (1u << lane)) == 0;
+            visibility[i + lane] = inside ? 1 : 0;
+            if (inside) visible_counts[groups[i + lane]]++;
+        }
+    }
+}
@@ -0,0 +1,57 @@
+#include "Mesh.h"
+#include <cstring>
+
+// ----- VERTEX
+vk::VertexInputBindingDescription Vertex::getBindingDescription() {
+    return {
+        .binding   = 0,
+        .stride    = sizeof(Vertex),
+        .inputRate = vk::VertexInputRate::eVertex
+    };
+}
+
+std::array<vk::VertexInputAttributeDescription, 3> Vertex::getAttributeDescriptions() {
+    return {{
+        {
+            .location = 0,
+            .binding  = 0,
+            .format   = vk::Format::eR32G32B32Sfloat,
+            .offset   = offsetof(Vertex, position)
+        },
+        {
+            .location = 1,
+            .binding  = 0,
+            .format   = vk::Format::eR32G32B32Sfloat,
+            .offset   = offsetof(Vertex, normal)
+        },
+        {
+            .location = 2,
+            .binding  = 0,
+            .format   = vk::Format::eR32G32Sfloat,
+            .offset   = offsetof(Vertex, uv)
+        }
+    }};
+}
+
+size_t VertexHash::operator()(Vertex const &vertex) const {
+    const float components[] = {
+        vertex.position.x, vertex.position.y, vertex.position.z,
+        vertex.normal.x, vertex.normal.y, vertex.normal.z,
+        vertex.uv.x, vertex.uv.y
+    };
+
+    // FNV-1a over the float bits
+    size_t hash = 0xcbf29ce484222325ull;
+    for (auto component : components) {
+        // -0.0 compares equal to 0.0, so it has to hash the same
+        component += 0.0f;
+
+        uint32_t bits;
+        memcpy(&bits, &component, sizeof(bits));
+
+        hash ^= bits;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
@@ -0,0 +1,470 @@
+#include "MeshCache.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+#include <thread>
+#include <utility>
+#include <glm/gtc/packing.hpp>
+
+#ifdef _WIN32
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+constexpr uint32_t MESH_CACHE_MAGIC = 0x4853454d; // "MESH"
+constexpr uint32_t MESH_CACHE_VERSION = 1;
+
+// ----- HELPER FUNCTIONS
+uint64_t alignSection(uint64_t offset) {
+    return (offset + 15) & ~uint64_t(15);
+}
+
+uint16_t quantizeUnorm16(float value) {
+    return static_cast<uint16_t>(std::lround(std::clamp(value, 0.0f, 1.0f) * 65535.0f));
+}
+
+int16_t quantizeSnorm16(float value) {
+    return static_cast<int16_t>(std::lround(std::clamp(value, -1.0f, 1.0f) * 32767.0f));
+}
+
+// octahedral mapping keeps unit vectors accurate in two components
+glm::vec2 octEncode(glm::vec3 normal) {
+    const float sum = std::abs(normal.x) + std::abs(normal.y) + std::abs(normal.z);
+    if (sum == 0.0f) return {0.0f, 0.0f};
+
+    glm::vec2 oct = glm::vec2(normal) / sum;
+
+    if (normal.z < 0.0f) {
+        oct = {
+            (1.0f - std::abs(oct.y)) * (oct.x >= 0.0f ? 1.0f : -1.0f),
+            (1.0f - std::abs(oct.x)) * (oct.y >= 0.0f ? 1.0f : -1.0f)
+        };
+    }
+
+    return oct;
+}
+
+// Greedy clustering in index order, closes a meshlet once either limit is hit
+void buildMeshlets(
+    MeshData const &data,
+    std::vector<Meshlet> &meshlets,
+    std::vector<uint32_t> &meshlet_vertices,
+    std::vector<uint8_t> &meshlet_triangles
+) {
+    std::vector<uint8_t> local_index(data.vertices.size(), 0xff);
+    std::vector<uint32_t> current_vertices;
+    std::vector<uint8_t> current_triangles;
+
+    auto flush = [&] {
+        if (current_triangles.empty()) return;
+
+        Meshlet meshlet = {
+            .vertex_offset   = static_cast<uint32_t>(meshlet_vertices.size()),
+            .triangle_offset = static_cast<uint32_t>(meshlet_triangles.size()),
+            .vertex_count    = static_cast<uint32_t>(current_vertices.size()),
+            .triangle_count  = static_cast<uint32_t>(current_triangles.size() / 3)
+        };
+
+        // sphere around the AABB center
+        glm::vec3 lo(INFINITY), hi(-INFINITY);
+        for (auto v : current_vertices) {
+            lo = glm::min(lo, data.vertices[v].position);
+            hi = glm::max(hi, data.vertices[v].position);
+        }
+        const glm::vec3 center = (lo + hi) * 0.5f;
+        float radius = 0.0f;
+        for (auto v : current_vertices) {
+            radius = std::max(radius, glm::length(data.vertices[v].position - center));
+        }
+        meshlet.sphere = glm::vec4(center, radius);
+
+        // normal cone from the face normals
+        std::vector<glm::vec3> face_normals;
+        glm::vec3 axis(0.0f);
+        for (size_t t = 0; t < current_triangles.size(); t += 3) {
+            const auto &p0 = data.vertices[current_vertices[current_triangles[t + 0]]].position;
+            const auto &p1 = data.vertices[current_vertices[current_triangles[t + 1]]].position;
+            const auto &p2 = data.vertices[current_vertices[current_triangles[t + 2]]].position;
+
+            auto normal = glm::cross(p1 - p0, p2 - p0);
+            const float length = glm::length(normal);
+            normal = length > 0.0f ? normal / length : glm::vec3(0.0f);
+
+            face_normals.push_back(normal);
+            axis += normal;
+        }
+
+        const float axis_length = glm::length(axis);
+        axis = axis_length > 0.0f ? axis / axis_length : glm::vec3(0.0f, 0.0f, 1.0f);
+
+        float min_dot = 1.0f;
+        for (auto const &normal : face_normals) {
+            min_dot = std::min(min_dot, glm::dot(normal, axis));
+        }
+
+        // a cone that wide never culls anything, so disable the test
+        if (min_dot <= 0.1f) {
+            meshlet.cone_apex = glm::vec4(center, 0.0f);
+            meshlet.cone_axis_cutoff = glm::vec4(axis, 1.0f);
+        } else {
+            // push the apex back until every triangle plane is in front of it
+            float max_t = 0.0f;
+            for (size_t t = 0; t < face_normals.size(); t++) {
+                const auto &p0 = data.vertices[current_vertices[current_triangles[t * 3]]].position;
+                const float dc = glm::dot(center - p0, face_normals[t]);
+                const float dn = glm::dot(axis, face_normals[t]);
+                max_t = std::max(max_t, dc / dn);
+            }
+
+            meshlet.cone_apex = glm::vec4(center - axis * max_t, 0.0f);
+            meshlet.cone_axis_cutoff = glm::vec4(axis, std::sqrt(1.0f - min_dot * min_dot));
+        }
+
+        meshlets.push_back(meshlet);
+        meshlet_vertices.insert(meshlet_vertices.end(), current_vertices.begin(), current_vertices.end());
+        meshlet_triangles.insert(meshlet_triangles.end(), current_triangles.begin(), current_triangles.end());
+
+        for (auto v : current_vertices) local_index[v] = 0xff;
+        current_vertices.clear();
+        current_triangles.clear();
+    };
+
+    for (size_t i = 0; i + 2 < data.indices.size(); i += 3) {
+        const uint32_t tri[3] = {data.indices[i], data.indices[i + 1], data.indices[i + 2]};
+
+        uint32_t new_vertices = 0;
+        for (auto v : tri) {
+            if (local_index[v] == 0xff) new_vertices++;
+        }
+
+        if (current_vertices.size() + new_vertices > MESHLET_MAX_VERTICES ||
+            current_triangles.size() / 3 + 1 > MESHLET_MAX_TRIANGLES
+        ) {
+            flush();
+        }
+
+        for (auto v : tri) {
+            if (local_index[v] == 0xff) {
+                local_index[v] = static_cast<uint8_t>(current_vertices.size());
+                current_vertices.push_back(v);
+            }
+            current_triangles.push_back(local_index[v]);
+        }
+    }
+
+    flush();
+}
+
+
+// ----- PACKED VERTEX
+vk::VertexInputBindingDescription PackedVertex::getBindingDescription() {
+    return {
+        .binding   = 0,
+        .stride    = sizeof(PackedVertex),
+        .inputRate = vk::VertexInputRate::eVertex
+    };
+}
+
+std::array<vk::VertexInputAttributeDescription, 3> PackedVertex::getAttributeDescriptions() {
+    return {{
+        {
+            .location = 0,
+            .binding  = 0,
+            .format   = vk::Format::eR16G16B16A16Unorm,
+            .offset   = offsetof(PackedVertex, position)
+        },
+        {
+            .location = 1,
+            .binding  = 0,
+            .format   = vk::Format::eR16G16Snorm,
+            .offset   = offsetof(PackedVertex, normal)
+        },
+        {
+            .location = 2,
+            .binding  = 0,
+            .format   = vk::Format::eR16G16Sfloat,
+            .offset   = offsetof(PackedVertex, uv)
+        }
+    }};
+}
+
+
+// ----- MAPPED FILE
+MappedFile::MappedFile(std::filesystem::path const &path) {
+#ifdef _WIN32
+    file_handle = CreateFileW(
+        path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+        OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr
+    );
+    if (file_handle == INVALID_HANDLE_VALUE) {
+        file_handle = nullptr;
+        return;
+    }
+
+    LARGE_INTEGER file_size;
+    if (!GetFileSizeEx(file_handle, &file_size) || file_size.QuadPart == 0) {
+        close();
+        return;
+    }
+
+    mapping_handle = CreateFileMappingW(file_handle, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping_handle) {
+        close();
+        return;
+    }
+
+    bytes = static_cast<const std::byte *>(MapViewOfFile(mapping_handle, FILE_MAP_READ, 0, 0, 0));
+    length = bytes ? static_cast<size_t>(file_size.QuadPart) : 0;
+#else
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) == 0 && file_stat.st_size > 0) {
+        void *mapping = mmap(nullptr, file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+        if (mapping != MAP_FAILED) {
+            // the file is read front to back exactly once
+            madvise(mapping, file_stat.st_size, MADV_SEQUENTIAL);
+
+            bytes = static_cast<const std::byte *>(mapping);
+            length = static_cast<size_t>(file_stat.st_size);
+        }
+    }
+
+    // the mapping keeps its own reference to the file
+    ::close(fd);
+#endif
+}
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+MappedFile::MappedFile(MappedFile &&other) noexcept {
+    *this = std::move(other);
+}
+
+MappedFile &MappedFile::operator=(MappedFile &&other) noexcept {
+    if (this != &other) {
+        close();
+
+        bytes = std::exchange(other.bytes, nullptr);
+        length = std::exchange(other.length, 0);
+#ifdef _WIN32
+        file_handle = std::exchange(other.file_handle, nullptr);
+        mapping_handle = std::exchange(other.mapping_handle, nullptr);
+#endif
+    }
+    return *this;
+}
+
+void MappedFile::close() {
+#ifdef _WIN32
+    if (bytes) UnmapViewOfFile(bytes);
+    if (mapping_handle) CloseHandle(mapping_handle);
+    if (file_handle) CloseHandle(file_handle);
+    mapping_handle = nullptr;
+    file_handle = nullptr;
+#else
+    if (bytes) munmap(const_cast<std::byte *>(bytes), length);
+#endif
+    bytes = nullptr;
+    length = 0;
+}
+
+
+// ----- PUBLIC
+uint64_t hashBytes(const std::byte *data, size_t size) {
+    // word at a time multiply-xorshift, fast enough to hash a source on
+    // every launch and only used to detect changes
+    constexpr uint64_t prime = 0x9e3779b97f4a7c15ull;
+    uint64_t hash = size * prime;
+
+    size_t i = 0;
+    for (; i + sizeof(uint64_t) <= size; i += sizeof(uint64_t)) {
+        uint64_t word;
+        memcpy(&word, data + i, sizeof(word));
+
+        hash ^= word * prime;
+        hash = (hash << 31 | hash >> 33) * prime;
+    }
+
+    uint64_t tail = 0;
+    memcpy(&tail, data + i, size - i);
+    hash ^= tail * prime;
+    hash ^= hash >> 29;
+
+    return hash;
+}
+
+void prefetchFile(std::filesystem::path const &path) {
+    MappedFile file(path);
+    if (!file) return;
+
+    // one read per page faults the whole file in, the sink keeps the loop
+    constexpr size_t page_size = 4096;
+    uint8_t sum = 0;
+    for (size_t offset = 0; offset < file.size(); offset += page_size) {
+        sum ^= std::to_integer<uint8_t>(file.data()[offset]);
+    }
+
+    volatile uint8_t sink = sum;
+    (void)sink;
+}
+
+std::filesystem::path meshCachePath(std::filesystem::path const &source) {
+    auto path = source;
+    path += MESH_CACHE_EXTENSION;
+    return path;
+}
+
+std::vector<std::byte> encodeMeshCache(MeshData const &data, uint64_t source_hash, uint64_t source_size) {
+    std::vector<Meshlet> meshlets;
+    std::vector<uint32_t> meshlet_vertices;
+    std::vector<uint8_t> meshlet_triangles;
+    buildMeshlets(data, meshlets, meshlet_vertices, meshlet_triangles);
+
+    glm::vec3 lo(INFINITY), hi(-INFINITY);
+    for (auto const &vertex : data.vertices) {
+        lo = glm::min(lo, vertex.position);
+        hi = glm::max(hi, vertex.position);
+    }
+    const glm::vec3 extent = hi - lo;
+
+    const bool small_indices = data.vertices.size() <= UINT16_MAX;
+
+    MeshCacheHeader header = {
+        .magic                  = MESH_CACHE_MAGIC,
+        .version                = MESH_CACHE_VERSION,
+        .source_hash            = source_hash,
+        .source_size            = source_size,
+        .file_size              = 0,
+        .bounds_min             = {lo.x, lo.y, lo.z, 0.0f},
+        .bounds_max             = {hi.x, hi.y, hi.z, 0.0f},
+        .vertex_count           = static_cast<uint32_t>(data.vertices.size()),
+        .index_count            = static_cast<uint32_t>(data.indices.size()),
+        .index_size             = small_indices ? 2u : 4u,
+        .meshlet_count          = static_cast<uint32_t>(meshlets.size()),
+        .meshlet_vertex_count   = static_cast<uint32_t>(meshlet_vertices.size()),
+        .meshlet_triangle_bytes = static_cast<uint32_t>(meshlet_triangles.size())
+    };
+
+    header.vertex_offset = alignSection(sizeof(MeshCacheHeader));
+    header.index_offset = alignSection(header.vertex_offset + uint64_t(header.vertex_count) * sizeof(PackedVertex));
+    header.meshlet_offset = alignSection(header.index_offset + uint64_t(header.index_count) * header.index_size);
+    header.meshlet_vertex_offset = alignSection(header.meshlet_offset + meshlets.size() * sizeof(Meshlet));
+    header.meshlet_triangle_offset = alignSection(header.meshlet_vertex_offset + meshlet_vertices.size() * sizeof(uint32_t));
+    header.file_size = alignSection(header.meshlet_triangle_offset + meshlet_triangles.size());
+
+    std::vector<std::byte> blob(header.file_size);
+    memcpy(blob.data(), &header, sizeof(header));
+
+    auto *vertices = reinterpret_cast<PackedVertex *>(blob.data() + header.vertex_offset);
+    for (size_t i = 0; i < data.vertices.size(); i++) {
+        auto const &vertex = data.vertices[i];
+        auto &packed = vertices[i];
+
+        for (int axis = 0; axis < 3; axis++) {
+            const float range = extent[axis] > 0.0f ? extent[axis] : 1.0f;
+            packed.position[axis] = quantizeUnorm16((vertex.position[axis] - lo[axis]) / range);
+        }
+        packed.position[3] = 0;
+
+        const auto oct = octEncode(vertex.normal);
+        packed.normal[0] = quantizeSnorm16(oct.x);
+        packed.normal[1] = quantizeSnorm16(oct.y);
+
+        packed.uv[0] = glm::packHalf1x16(vertex.uv.x);
+        packed.uv[1] = glm::packHalf1x16(vertex.uv.y);
+    }
+
+    auto *indices = blob.data() + header.index_offset;
+    if (small_indices) {
+        for (size_t i = 0; i < data.indices.size(); i++) {
+            const auto index = static_cast<uint16_t>(data.indices[i]);
+            memcpy(indices + i * sizeof(index), &index, sizeof(index));
+        }
+    } else {
+        memcpy(indices, data.indices.data(), data.indices.size() * sizeof(uint32_t));
+    }
+
+    memcpy(blob.data() + header.meshlet_offset, meshlets.data(), meshlets.size() * sizeof(Meshlet));
+    memcpy(blob.data() + header.meshlet_vertex_offset, meshlet_vertices.data(), meshlet_vertices.size() * sizeof(uint32_t));
+    memcpy(blob.data() + header.meshlet_triangle_offset, meshlet_triangles.data(), meshlet_triangles.size());
+
+    return blob;
+}
+
+void writeMeshCache(std::filesystem::path const &path, std::vector<std::byte> const &blob) {
+    // several workers may race on the same source, keep their temp files apart
+    auto tmp_path = path;
+    tmp_path += ".tmp" + std::to_string(std::hash<std::thread::id>{}(std::this_thread::get_id()));
+
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open mesh cache: " + tmp_path.string());
+        }
+
+        file.write(reinterpret_cast<const char *>(blob.data()), static_cast<std::streamsize>(blob.size()));
+
+        if (!file) {
+            throw std::runtime_error("Failed to write mesh cache: " + tmp_path.string());
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmp_path, path, error);
+
+    if (error) {
+        std::filesystem::remove(tmp_path, error);
+        throw std::runtime_error("Failed to replace mesh cache: " + path.string());
+    }
+}
+
+std::optional<MeshCacheView> viewMeshCache(
+    const std::byte *data,
+    size_t size,
+    uint64_t source_hash,
+    uint64_t source_size
+) {
+    if (!data || size < sizeof(MeshCacheHeader)) return std::nullopt;
+
+    MeshCacheView view = {.base = data};
+    memcpy(&view.header, data, sizeof(MeshCacheHeader));
+
+    auto const &header = view.header;
+
+    if (header.magic != MESH_CACHE_MAGIC || header.version != MESH_CACHE_VERSION) return std::nullopt;
+    if (header.source_hash != source_hash || header.source_size != source_size) return std::nullopt;
+    if (header.file_size != size) return std::nullopt;
+    if (header.index_size != 2 && header.index_size != 4) return std::nullopt;
+
+    // every section must fit inside the file
+    auto fits = [size](uint64_t offset, uint64_t bytes) {
+        return offset <= size && bytes <= size - offset;
+    };
+
+    if (!fits(header.vertex_offset, uint64_t(header.vertex_count) * sizeof(PackedVertex)) ||
+        !fits(header.index_offset, uint64_t(header.index_count) * header.index_size) ||
+        !fits(header.meshlet_offset, uint64_t(header.meshlet_count) * sizeof(Meshlet)) ||
+        !fits(header.meshlet_vertex_offset, uint64_t(header.meshlet_vertex_count) * sizeof(uint32_t)) ||
+        !fits(header.meshlet_triangle_offset, header.meshlet_triangle_bytes)
+    ) {
+        return std::nullopt;
+    }
+
+    return view;
+}
@@ -0,0 +1,542 @@
+#include "MeshLoader.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/gtc/quaternion.hpp>
+#include <glm/gtc/type_ptr.hpp>
+
+#define TINYOBJLOADER_IMPLEMENTATION
+#include <tiny_obj_loader.h>
+// the implementation comes from the tinygltf target's compile definitions
+#include <tiny_gltf.h>
+
+// ----- HELPER FUNCTIONS
+// Merges bit identical vertices so every unique vertex is stored once
+class MeshBuilder {
+public:
+    void add(Vertex const &vertex) {
+        auto [it, inserted] = unique.try_emplace(vertex, static_cast<uint32_t>(data.vertices.size()));
+
+        if (inserted) {
+            data.vertices.push_back(vertex);
+        }
+        data.indices.push_back(it->second);
+    }
+
+    MeshData take() {
+        return std::move(data);
+    }
+
+private:
+    std::unordered_map<Vertex, uint32_t, VertexHash> unique;
+    MeshData data;
+};
+
+MeshData parseObj(std::filesystem::path const &path) {
+    tinyobj::attrib_t attrib;
+    std::vector<tinyobj::shape_t> shapes;
+    std::vector<tinyobj::material_t> materials;
+    std::string warn, err;
+
+    if (!tinyobj::LoadObj(&attrib, &shapes, &materials, &warn, &err, path.string().c_str())) {
+        throw std::runtime_error("Failed to load " + path.string() + ": " + warn + err);
+    }
+
+    MeshBuilder builder;
+
+    for (auto const &shape : shapes) {
+        for (auto const &index : shape.mesh.indices) {
+            Vertex vertex = {};
+
+            vertex.position = {
+                attrib.vertices[3 * index.vertex_index + 0],
+                attrib.vertices[3 * index.vertex_index + 1],
+                attrib.vertices[3 * index.vertex_index + 2]
+            };
+
+            if (index.normal_index >= 0) {
+                vertex.normal = {
+                    attrib.normals[3 * index.normal_index + 0],
+                    attrib.normals[3 * index.normal_index + 1],
+                    attrib.normals[3 * index.normal_index + 2]
+                };
+            }
+
+            // OBJ puts the origin at the bottom left, Vulkan at the top left
+            if (index.texcoord_index >= 0) {
+                vertex.uv = {
+                    attrib.texcoords[2 * index.texcoord_index + 0],
+                    1.0f - attrib.texcoords[2 * index.texcoord_index + 1]
+                };
+            }
+
+            builder.add(vertex);
+        }
+    }
+
+    return builder.take();
+}
+
+// Strided view into a glTF buffer
+struct AccessorView {
+    const unsigned char *data = nullptr;
+    size_t stride = 0;
+    size_t count = 0;
+    size_t components = 0;
+    int component_type = 0;
+    bool normalized = false;
+};
+
+AccessorView viewAccessor(tinygltf::Model const &model, int accessor_idx) {
+    if (accessor_idx < 0 || accessor_idx >= static_cast<int>(model.accessors.size())) {
+        throw std::runtime_error("Invalid glTF accessor index");
+    }
+    auto const &accessor = model.accessors[accessor_idx];
+
+    if (accessor.bufferView < 0 || accessor.sparse.isSparse) {
+        throw std::runtime_error("Sparse glTF accessors are not supported");
+    }
+    if (accessor.bufferView >= static_cast<int>(model.bufferViews.size())) {
+        throw std::runtime_error("Invalid glTF buffer view index");
+    }
+
+    auto const &view = model.bufferViews[accessor.bufferView];
+    if (view.buffer < 0 || view.buffer >= static_cast<int>(model.buffers.size())) {
+        throw std::runtime_error("Invalid glTF buffer index");
+    }
+    auto const &buffer = model.buffers[view.buffer];
+
+    const int stride = accessor.ByteStride(view);
+    if (stride <= 0) {
+        throw std::runtime_error("Invalid glTF accessor stride");
+    }
+
+    // the last element has to end inside the view, and the view inside the
+    // buffer, reads are only checked against the count after this
+    const int component_size = tinygltf::GetComponentSizeInBytes(accessor.componentType);
+    const int components = tinygltf::GetNumComponentsInType(accessor.type);
+    if (component_size <= 0 || components <= 0) {
+        throw std::runtime_error("Invalid glTF accessor type");
+    }
+
+    const auto element_size = static_cast<size_t>(component_size * components);
+    const size_t end = accessor.count == 0
+        ? accessor.byteOffset
+        : accessor.byteOffset + (accessor.count - 1) * static_cast<size_t>(stride) + element_size;
+    if (view.byteOffset + view.byteLength > buffer.data.size() || end > view.byteLength) {
+        throw std::runtime_error("glTF accessor reads past the end of its buffer");
+    }
+
+    return {
+        .data           = buffer.data.data() + view.byteOffset + accessor.byteOffset,
+        .stride         = static_cast<size_t>(stride),
+        .count          = accessor.count,
+        .components     = static_cast<size_t>(components),
+        .component_type = accessor.componentType,
+        .normalized     = accessor.normalized
+    };
+}
+
+float readComponent(AccessorView const &view, size_t element, size_t component) {
+    const auto *ptr = view.data + element * view.stride;
+
+    switch (view.component_type) {
+        case TINYGLTF_COMPONENT_TYPE_FLOAT: {
+            float value;
+            memcpy(&value, ptr + component * sizeof(float), sizeof(value));
+            return value;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE: {
+            float value = ptr[component];
+            return view.normalized ? value / 255.0f : value;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            uint16_t value;
+            memcpy(&value, ptr + component * sizeof(value), sizeof(value));
+            return view.normalized ? value / 65535.0f : value;
+        }
+        default:
+            throw std::runtime_error("Unsupported glTF attribute component type");
+    }
+}
+
+uint32_t readIndex(AccessorView const &view, size_t element) {
+    const auto *ptr = view.data + element * view.stride;
+
+    switch (view.component_type) {
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_BYTE:
+            return *ptr;
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_SHORT: {
+            uint16_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        case TINYGLTF_COMPONENT_TYPE_UNSIGNED_INT: {
+            uint32_t value;
+            memcpy(&value, ptr, sizeof(value));
+            return value;
+        }
+        default:
+            throw std::runtime_error("Unsupported glTF index component type");
+    }
+}
+
+glm::mat4 nodeTransform(tinygltf::Node const &node) {
+    if (node.matrix.size() == 16) {
+        return glm::mat4(glm::make_mat4(node.matrix.data()));
+    }
+
+    glm::mat4 transform(1.0f);
+
+    if (node.translation.size() == 3) {
+        transform = glm::translate(transform, glm::vec3(glm::make_vec3(node.translation.data())));
+    }
+    if (node.rotation.size() == 4) {
+        // glTF stores xyzw, glm takes wxyz
+        glm::quat rotation(
+            static_cast<float>(node.rotation[3]),
+            static_cast<float>(node.rotation[0]),
+            static_cast<float>(node.rotation[1]),
+            static_cast<float>(node.rotation[2])
+        );
+        transform *= glm::mat4_cast(rotation);
+    }
+    if (node.scale.size() == 3) {
+        transform = glm::scale(transform, glm::vec3(glm::make_vec3(node.scale.data())));
+    }
+
+    return transform;
+}
+
+void appendPrimitive(
+    tinygltf::Model const &model,
+    tinygltf::Primitive const &primitive,
+    glm::mat4 const &transform,
+    MeshBuilder &builder
+) {
+    if (primitive.mode != TINYGLTF_MODE_TRIANGLES && primitive.mode != -1) return;
+
+    auto position_attr = primitive.attributes.find("POSITION");
+    if (position_attr == primitive.attributes.end()) return;
+
+    auto positions = viewAccessor(model, position_attr->second);
+
+    AccessorView normals, uvs;
+    if (auto it = primitive.attributes.find("NORMAL"); it != primitive.attributes.end()) {
+        normals = viewAccessor(model, it->second);
+    }
+    if (auto it = primitive.attributes.find("TEXCOORD_0"); it != primitive.attributes.end()) {
+        uvs = viewAccessor(model, it->second);
+    }
+
+    AccessorView indices;
+    if (primitive.indices >= 0) {
+        indices = viewAccessor(model, primitive.indices);
+    }
+
+    if (positions.components < 3 ||
+        (normals.data && normals.components < 3) ||
+        (uvs.data && uvs.components < 2) ||
+        (indices.data && indices.components != 1)
+    ) {
+        throw std::runtime_error("Unexpected glTF accessor type for an attribute or index");
+    }
+
+    const glm::mat3 normal_matrix = glm::transpose(glm::inverse(glm::mat3(transform)));
+    const size_t count = indices.data ? indices.count : positions.count;
+
+    for (size_t i = 0; i < count; i++) {
+        const size_t idx = indices.data ? readIndex(indices, i) : i;
+        if (idx >= positions.count ||
+            (normals.data && idx >= normals.count) ||
+            (uvs.data && idx >= uvs.count)
+        ) {
+            throw std::runtime_error("glTF index " + std::to_string(idx) + " is out of range of its attributes");
+        }
+
+        Vertex vertex = {};
+
+        glm::vec3 position = {
+            readComponent(positions, idx, 0),
+            readComponent(positions, idx, 1),
+            readComponent(positions, idx, 2)
+        };
+        vertex.position = glm::vec3(transform * glm::vec4(position, 1.0f));
+
+        if (normals.data) {
+            glm::vec3 normal = {
+                readComponent(normals, idx, 0),
+                readComponent(normals, idx, 1),
+                readComponent(normals, idx, 2)
+            };
+            vertex.normal = glm::normalize(normal_matrix * normal);
+        }
+
+        if (uvs.data) {
+            vertex.uv = {readComponent(uvs, idx, 0), readComponent(uvs, idx, 1)};
+        }
+
+        builder.add(vertex);
+    }
+}
+
+void appendNode(
+    tinygltf::Model const &model,
+    int node_idx,
+    glm::mat4 const &parent,
+    MeshBuilder &builder
+) {
+    auto const &node = model.nodes[node_idx];
+    const auto transform = parent * nodeTransform(node);
+
+    if (node.mesh >= 0) {
+        for (auto const &primitive : model.meshes[node.mesh].primitives) {
+            appendPrimitive(model, primitive, transform, builder);
+        }
+    }
+
+    for (auto child : node.children) {
+        appendNode(model, child, transform, builder);
+    }
+}
+
+MeshData parseGltf(std::filesystem::path const &path, bool binary) {
+    tinygltf::Model model;
+    tinygltf::TinyGLTF loader;
+    std::string warn, err;
+
+    // textures go through the KTX path, skip decoding embedded images
+    loader.SetImageLoader(
+        [](tinygltf::Image *, const int, std::string *, std::string *,
+           int, int, const unsigned char *, int, void *) { return true; },
+        nullptr
+    );
+
+    const bool loaded = binary
+        ? loader.LoadBinaryFromFile(&model, &err, &warn, path.string())
+        : loader.LoadASCIIFromFile(&model, &err, &warn, path.string());
+
+    if (!loaded) {
+        throw std::runtime_error("Failed to load " + path.string() + ": " + warn + err);
+    }
+
+    MeshBuilder builder;
+
+    const int scene_idx = model.defaultScene >= 0 ? model.defaultScene : 0;
+    if (scene_idx < static_cast<int>(model.scenes.size())) {
+        for (auto node : model.scenes[scene_idx].nodes) {
+            appendNode(model, node, glm::mat4(1.0f), builder);
+        }
+    } else {
+        // no scene graph, take the meshes as they are
+        for (auto const &mesh : model.meshes) {
+            for (auto const &primitive : mesh.primitives) {
+                appendPrimitive(model, primitive, glm::mat4(1.0f), builder);
+            }
+        }
+    }
+
+    return builder.take();
+}
+
+
+// ----- PUBLIC
+MeshData parseMesh(std::filesystem::path const &path) {
+    auto extension = path.extension().string();
+    std::ranges::transform(extension, extension.begin(), [](unsigned char c) { return std::tolower(c); });
+
+    if (extension == ".obj") return parseObj(path);
+    if (extension == ".gltf") return parseGltf(path, false);
+    if (extension == ".glb") return parseGltf(path, true);
+
+    throw std::runtime_error("Unsupported mesh format: " + path.string());
+}
+
+MeshLoader::MeshLoader(
+    vk::raii::Device const &device,
+    GpuAllocator &allocator,
+    UploadQueue &upload_queue,
+    TaskScheduler &scheduler,
+    vk::PipelineStageFlags2 shader_stages
+) : device(device),
+    allocator(allocator),
+    upload_queue(upload_queue),
+    scheduler(scheduler),
+    shader_stages(shader_stages),
+    contexts(device, upload_queue) {}
+
+MeshLoader::~MeshLoader() {
+    stopping.store(true, std::memory_order_relaxed);
+    scheduler.wait(outstanding);
+}
+
+MeshHandle MeshLoader::load(std::filesystem::path path) {
+    auto mesh = std::make_shared<Mesh>();
+    mesh->path = std::move(path);
+
+    scheduler.submit([this, mesh] { loadMesh(mesh); }, outstanding);
+
+    return mesh;
+}
+
+
+// ----- PRIVATE
+void MeshLoader::loadMesh(MeshHandle const &mesh) {
+    if (stopping.load(std::memory_order_relaxed)) {
+        mesh->error = "Mesh loader shut down before loading";
+        mesh->state.store(MeshState::eFailed, std::memory_order_release);
+        return;
+    }
+
+    auto context = contexts.acquire();
+
+    try {
+        CpuScope scope("load mesh");
+        MappedFile source(mesh->path);
+        if (!source) {
+            throw std::runtime_error("Failed to open mesh: " + mesh->path.string());
+        }
+
+        const auto source_size = source.size();
+        const auto source_hash = hashBytes(source.data(), source_size);
+        source = {};
+
+        const auto cache_path = meshCachePath(mesh->path);
+        MappedFile cache(cache_path);
+        auto view = viewMeshCache(cache.data(), cache.size(), source_hash, source_size);
+
+        // miss or stale, parse the source and leave a cache for next time
+        std::vector<std::byte> blob;
+        if (!view) {
+            blob = encodeMeshCache(parseMesh(mesh->path), source_hash, source_size);
+
+            try {
+                writeMeshCache(cache_path, blob);
+            } catch (const std::exception &) {
+                // read only asset directories just pay the parse every launch
+            }
+
+            view = viewMeshCache(blob.data(), blob.size(), source_hash, source_size);
+        }
+
+        if (view->header.index_count == 0) {
+            throw std::runtime_error("Mesh has no triangles: " + mesh->path.string());
+        }
+
+        upload(mesh, *view, *context);
+    } catch (const std::exception &e) {
+        mesh->error = e.what();
+        mesh->state.store(MeshState::eFailed, std::memory_order_release);
+    }
+
+    contexts.release(std::move(context));
+}
+
+void MeshLoader::upload(MeshHandle const &mesh, MeshCacheView const &view, UploadContext &context) {
+    auto const &header = view.header;
+
+    // the cache layout is the upload layout, so the mapped file goes into
+    // staging in one copy and each section is copied out by offset
+    auto staging = allocator.createBuffer({
+        .size        = header.file_size,
+        .usage       = vk::BufferUsageFlagBits::eTransferSrc,
+        .sharingMode = vk::SharingMode::eExclusive
+    }, MemoryUsage::eUpload);
+    memcpy(staging.allocation.mapped, view.base, header.file_size);
+
+    auto make_buffer = [this](vk::DeviceSize size, vk::BufferUsageFlags usage) {
+        return allocator.createBuffer({
+            .size        = size,
+            .usage       = usage | vk::BufferUsageFlagBits::eTransferDst,
+            .sharingMode = vk::SharingMode::eExclusive
+        }, MemoryUsage::eGpuOnly);
+    };
+
+    const vk::DeviceSize vertex_bytes = vk::DeviceSize(header.vertex_count) * sizeof(PackedVertex);
+    const vk::DeviceSize index_bytes = vk::DeviceSize(header.index_count) * header.index_size;
+    const vk::DeviceSize meshlet_bytes = vk::DeviceSize(header.meshlet_count) * sizeof(Meshlet);
+    const vk::DeviceSize meshlet_vertex_bytes = vk::DeviceSize(header.meshlet_vertex_count) * sizeof(uint32_t);
+    const vk::DeviceSize meshlet_triangle_bytes = header.meshlet_triangle_bytes;
+    // shaders read the packed triangles a word at a time, sections are 16
+    // byte aligned in the file so the padded copy stays inside it
+    const vk::DeviceSize meshlet_triangle_words = (meshlet_triangle_bytes + 3) / 4 * 4;
+
+    mesh->vertex_buffer = make_buffer(
+        vertex_bytes,
+        vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eStorageBuffer
+    );
+    mesh->index_buffer = make_buffer(
+        index_bytes,
+        vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eStorageBuffer
+    );
+    mesh->meshlet_buffer = make_buffer(meshlet_bytes, vk::BufferUsageFlagBits::eStorageBuffer);
+    mesh->meshlet_vertex_buffer = make_buffer(meshlet_vertex_bytes, vk::BufferUsageFlagBits::eStorageBuffer);
+    mesh->meshlet_triangle_buffer = make_buffer(meshlet_triangle_words, vk::BufferUsageFlagBits::eStorageBuffer);
+
+    mesh->index_count = header.index_count;
+    mesh->index_type = header.index_size == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32;
+    mesh->bounds_min = glm::vec3(header.bounds_min[0], header.bounds_min[1], header.bounds_min[2]);
+    mesh->bounds_max = glm::vec3(header.bounds_max[0], header.bounds_max[1], header.bounds_max[2]);
+    mesh->meshlet_count = header.meshlet_count;
+
+    auto cmd = context.begin(device);
+
+    auto copy = [&](GpuBuffer const &dst, vk::DeviceSize offset, vk::DeviceSize size) {
+        cmd.copyBuffer(*staging, *dst, vk::BufferCopy{
+            .srcOffset = offset,
+            .dstOffset = 0,
+            .size      = size
+        });
+    };
+    copy(mesh->vertex_buffer, header.vertex_offset, vertex_bytes);
+    copy(mesh->index_buffer, header.index_offset, index_bytes);
+    copy(mesh->meshlet_buffer, header.meshlet_offset, meshlet_bytes);
+    copy(mesh->meshlet_vertex_buffer, header.meshlet_vertex_offset, meshlet_vertex_bytes);
+    copy(mesh->meshlet_triangle_buffer, header.meshlet_triangle_offset, meshlet_triangle_words);
+
+    auto transfer = [](GpuBuffer const &buffer, vk::PipelineStageFlags2 stage, vk::AccessFlags2 access) {
+        return BufferOwnershipTransfer {
+            .buffer     = *buffer,
+            .src_stage  = vk::PipelineStageFlagBits2::eCopy,
+            .src_access = vk::AccessFlagBits2::eTransferWrite,
+            .dst_stage  = stage,
+            .dst_access = access
+        };
+    };
+
+    UploadRelease release = {
+        .buffers = {
+            transfer(
+                mesh->vertex_buffer,
+                vk::PipelineStageFlagBits2::eVertexAttributeInput | shader_stages,
+                vk::AccessFlagBits2::eVertexAttributeRead | vk::AccessFlagBits2::eShaderStorageRead
+            ),
+            transfer(
+                mesh->index_buffer,
+                vk::PipelineStageFlagBits2::eIndexInput | shader_stages,
+                vk::AccessFlagBits2::eIndexRead | vk::AccessFlagBits2::eShaderStorageRead
+            ),
+            transfer(mesh->meshlet_buffer, shader_stages, vk::AccessFlagBits2::eShaderStorageRead),
+            transfer(mesh->meshlet_vertex_buffer, shader_stages, vk::AccessFlagBits2::eShaderStorageRead),
+            transfer(mesh->meshlet_triangle_buffer, shader_stages, vk::AccessFlagBits2::eShaderStorageRead)
+        },
+        .on_acquired = [mesh] {
+            mesh->state.store(MeshState::eReady, std::memory_order_release);
+        }
+    };
+
+    mesh->state.store(MeshState::eUploading, std::memory_order_release);
+    auto value = upload_queue.submit(cmd, std::move(release));
+
+    context.in_flight.push_back({
+        std::move(cmd),
+        std::make_shared<GpuBuffer>(std::move(staging)),
+        value
+    });
+}
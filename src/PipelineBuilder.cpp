@@ -0,0 +1,155 @@
+#include "PipelineBuilder.h"
+#include "CpuProfiler.h"
+#include <fstream>
+#include <stdexcept>
+
+// ----- HELPER FUNCTIONS
+std::vector<char> readFile(const std::string &filename) {
+    std::ifstream file(filename, std::ios::ate | std::ios::binary);
+
+    if (!file.is_open()) {
+        throw std::runtime_error("Failed to open file: " + filename);
+    }
+
+    std::vector<char> buffer(file.tellg());
+
+    file.seekg(0, std::ios::beg);
+    file.read(buffer.data(), static_cast<std::streamsize>(buffer.size()));
+
+    return buffer;
+}
+
+vk::raii::ShaderModule createShaderModule(vk::raii::Device const &device, std::vector<char> const &code) {
+    vk::ShaderModuleCreateInfo module_info = {
+        .codeSize = code.size(),
+        .pCode    = reinterpret_cast<const uint32_t *>(code.data())
+    };
+
+    return vk::raii::ShaderModule(device, module_info);
+}
+
+
+// ----- SHADER LIBRARY
+ShaderLibrary::ShaderLibrary(TaskScheduler &scheduler) : scheduler(scheduler) {}
+
+void ShaderLibrary::prefetch(std::string const &path) {
+    std::lock_guard lock(mutex);
+
+    auto [iter, inserted] = entries.try_emplace(path, nullptr);
+    if (!inserted) return;
+
+    // submitted under the lock so get() never sees an entry it can't wait on.
+    // High priority since a non worker thread may be the one waiting
+    auto entry = std::make_shared<Entry>();
+    iter->second = entry;
+    scheduler.submit([path, entry] {
+        try {
+            CpuScope scope("read shader");
+            entry->code = std::make_shared<const std::vector<char>>(readFile(path));
+        } catch (...) {
+            entry->error = std::current_exception();
+        }
+    }, entry->loaded, TaskPriority::eHigh);
+}
+
+ShaderCode ShaderLibrary::get(std::string const &path) {
+    std::shared_ptr<Entry> entry;
+    {
+        std::lock_guard lock(mutex);
+        auto iter = entries.find(path);
+        if (iter != entries.end()) entry = iter->second;
+    }
+
+    if (!entry) {
+        // threads missing together each read, the first to finish is kept
+        auto loaded = std::make_shared<Entry>();
+        loaded->code = std::make_shared<const std::vector<char>>(readFile(path));
+
+        std::lock_guard lock(mutex);
+        entries.try_emplace(path, loaded);
+        return loaded->code;
+    }
+
+    scheduler.wait(entry->loaded);
+
+    if (entry->error) {
+        std::rethrow_exception(entry->error);
+    }
+
+    return entry->code;
+}
+
+void ShaderLibrary::replace(std::string const &path, ShaderCode code) {
+    auto entry = std::make_shared<Entry>();
+    entry->code = std::move(code);
+
+    std::lock_guard lock(mutex);
+    entries[path] = std::move(entry);
+}
+
+
+// ----- PIPELINE HANDLE
+bool PipelineHandle::ready() const {
+    return job && job->done.load(std::memory_order_acquire);
+}
+
+bool PipelineHandle::failed() const {
+    return ready() && job->error != nullptr;
+}
+
+vk::Pipeline PipelineHandle::get() const {
+    if (!ready()) return nullptr;
+
+    if (job->error) {
+        std::rethrow_exception(job->error);
+    }
+
+    return *job->pipeline;
+}
+
+
+// ----- PIPELINE BUILDER
+PipelineBuilder::PipelineBuilder(
+    vk::raii::Device const &device,
+    vk::raii::PipelineCache const &cache,
+    TaskScheduler &scheduler,
+    ShaderLibrary &shaders
+) : device(device), cache(cache), scheduler(scheduler), shader_library(shaders) {}
+
+PipelineBuilder::~PipelineBuilder() {
+    // jobs that have not started yet skip straight to failing
+    stopping.store(true, std::memory_order_relaxed);
+    scheduler.wait(outstanding);
+}
+
+PipelineHandle PipelineBuilder::build(PipelineRecipe recipe) {
+    PipelineHandle handle;
+    handle.job = std::make_shared<PipelineJob>();
+    handle.job->recipe = std::move(recipe);
+
+    scheduler.submit([this, job = handle.job] { compile(*job); }, outstanding);
+
+    return handle;
+}
+
+void PipelineBuilder::waitIdle() {
+    scheduler.wait(outstanding);
+}
+
+
+// ----- PRIVATE
+void PipelineBuilder::compile(PipelineJob &job) {
+    // the pipeline cache is internally synchronized, so jobs can share it
+    try {
+        if (stopping.load(std::memory_order_relaxed)) {
+            throw std::runtime_error("Pipeline builder shut down before compiling");
+        }
+
+        CpuScope scope("build pipeline");
+        job.pipeline = job.recipe(device, cache);
+    } catch (...) {
+        job.error = std::current_exception();
+    }
+    job.recipe = nullptr;
+    job.done.store(true, std::memory_order_release);
+}
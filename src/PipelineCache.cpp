@@ -0,0 +1,140 @@
+#include "PipelineCache.h"
+#include <cstring>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <system_error>
+
+constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x48434350; // "PCCH"
+constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// ----- HELPER FUNCTIONS
+uint64_t hashCacheData(std::vector<uint8_t> const &data) {
+    // FNV-1a, only used to catch truncated or corrupted files
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (auto byte : data) {
+        hash ^= byte;
+        hash *= 0x100000001b3ull;
+    }
+
+    return hash;
+}
+
+bool headerMatchesDevice(
+    PipelineCacheHeader const &header,
+    vk::PhysicalDeviceProperties const &properties
+) {
+    return header.magic == PIPELINE_CACHE_MAGIC &&
+           header.version == PIPELINE_CACHE_VERSION &&
+           header.vendor_id == properties.vendorID &&
+           header.device_id == properties.deviceID &&
+           header.driver_version == properties.driverVersion &&
+           memcmp(header.cache_uuid, properties.pipelineCacheUUID.data(), vk::UuidSize) == 0;
+}
+
+// the driver prefixes its own header, check it agrees before handing it back
+bool blobMatchesDevice(
+    std::vector<uint8_t> const &data,
+    vk::PhysicalDeviceProperties const &properties
+) {
+    VkPipelineCacheHeaderVersionOne driver_header;
+
+    if (data.size() < sizeof(driver_header)) return false;
+    memcpy(&driver_header, data.data(), sizeof(driver_header));
+
+    return driver_header.headerSize >= sizeof(driver_header) &&
+           driver_header.headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE &&
+           driver_header.vendorID == properties.vendorID &&
+           driver_header.deviceID == properties.deviceID &&
+           memcmp(driver_header.pipelineCacheUUID, properties.pipelineCacheUUID.data(), vk::UuidSize) == 0;
+}
+
+
+// ----- PUBLIC
+std::vector<uint8_t> readPipelineCacheFile(std::filesystem::path const &path) {
+    std::ifstream file(path, std::ios::binary | std::ios::ate);
+
+    if (!file.is_open()) return {};
+
+    std::vector<uint8_t> bytes(static_cast<size_t>(file.tellg()));
+    file.seekg(0);
+    file.read(reinterpret_cast<char *>(bytes.data()), bytes.size());
+
+    if (!file) return {};
+
+    return bytes;
+}
+
+std::vector<uint8_t> parsePipelineCache(
+    std::vector<uint8_t> const &file,
+    vk::PhysicalDeviceProperties const &properties
+) {
+    if (file.size() < sizeof(PipelineCacheHeader)) return {};
+
+    PipelineCacheHeader header;
+    memcpy(&header, file.data(), sizeof(header));
+
+    if (!headerMatchesDevice(header, properties)) return {};
+    if (header.data_size != file.size() - sizeof(header)) return {};
+
+    std::vector<uint8_t> data(file.begin() + sizeof(header), file.end());
+
+    if (hashCacheData(data) != header.data_hash) return {};
+    if (!blobMatchesDevice(data, properties)) return {};
+
+    return data;
+}
+
+std::vector<uint8_t> loadPipelineCache(
+    std::filesystem::path const &path,
+    vk::PhysicalDeviceProperties const &properties
+) {
+    return parsePipelineCache(readPipelineCacheFile(path), properties);
+}
+
+void savePipelineCache(
+    std::filesystem::path const &path,
+    vk::PhysicalDeviceProperties const &properties,
+    vk::raii::PipelineCache const &cache
+) {
+    auto data = cache.getData();
+
+    PipelineCacheHeader header = {
+        .magic          = PIPELINE_CACHE_MAGIC,
+        .version        = PIPELINE_CACHE_VERSION,
+        .vendor_id      = properties.vendorID,
+        .device_id      = properties.deviceID,
+        .driver_version = properties.driverVersion,
+        .cache_uuid     = {},
+        .data_size      = data.size(),
+        .data_hash      = hashCacheData(data)
+    };
+    memcpy(header.cache_uuid, properties.pipelineCacheUUID.data(), vk::UuidSize);
+
+    // write next to the target first so a crash never leaves a torn file
+    auto tmp_path = path;
+    tmp_path += ".tmp";
+
+    {
+        std::ofstream file(tmp_path, std::ios::binary | std::ios::trunc);
+
+        if (!file.is_open()) {
+            throw std::runtime_error("Failed to open pipeline cache: " + tmp_path.string());
+        }
+
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(data.data()), data.size());
+
+        if (!file) {
+            throw std::runtime_error("Failed to write pipeline cache: " + tmp_path.string());
+        }
+    }
+
+    std::error_code error;
+    std::filesystem::rename(tmp_path, path, error);
+
+    if (error) {
+        throw std::runtime_error("Failed to replace pipeline cache: " + error.message());
+    }
+}
@@ -0,0 +1,118 @@
+#include "QueueOwnership.h"
+
+// ----- HELPER FUNCTIONS
+void recordBarrier(vk::raii::CommandBuffer const &cmd, vk::BufferMemoryBarrier2 const &barrier) {
+    vk::DependencyInfo dependency_info = {
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers    = &barrier
+    };
+
+    cmd.pipelineBarrier2(dependency_info);
+}
+
+void recordBarrier(vk::raii::CommandBuffer const &cmd, vk::ImageMemoryBarrier2 const &barrier) {
+    vk::DependencyInfo dependency_info = {
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers    = &barrier
+    };
+
+    cmd.pipelineBarrier2(dependency_info);
+}
+
+bool isSameFamily(uint32_t src_family, uint32_t dst_family) {
+    return src_family == dst_family ||
+           src_family == vk::QueueFamilyIgnored ||
+           dst_family == vk::QueueFamilyIgnored;
+}
+
+
+// ----- BUFFERS
+void releaseOwnership(vk::raii::CommandBuffer const &cmd, BufferOwnershipTransfer const &transfer) {
+    if (isSameFamily(transfer.src_family, transfer.dst_family)) return;
+
+    // destination access is ignored for a release
+    recordBarrier(cmd, vk::BufferMemoryBarrier2 {
+        .srcStageMask        = transfer.src_stage,
+        .srcAccessMask       = transfer.src_access,
+        .srcQueueFamilyIndex = transfer.src_family,
+        .dstQueueFamilyIndex = transfer.dst_family,
+        .buffer              = transfer.buffer,
+        .offset              = transfer.offset,
+        .size                = transfer.size
+    });
+}
+
+void acquireOwnership(vk::raii::CommandBuffer const &cmd, BufferOwnershipTransfer const &transfer) {
+    if (isSameFamily(transfer.src_family, transfer.dst_family)) {
+        recordBarrier(cmd, vk::BufferMemoryBarrier2 {
+            .srcStageMask        = transfer.src_stage,
+            .srcAccessMask       = transfer.src_access,
+            .dstStageMask        = transfer.dst_stage,
+            .dstAccessMask       = transfer.dst_access,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .buffer              = transfer.buffer,
+            .offset              = transfer.offset,
+            .size                = transfer.size
+        });
+        return;
+    }
+
+    // source access is ignored for an acquire, the semaphore covers it
+    recordBarrier(cmd, vk::BufferMemoryBarrier2 {
+        .dstStageMask        = transfer.dst_stage,
+        .dstAccessMask       = transfer.dst_access,
+        .srcQueueFamilyIndex = transfer.src_family,
+        .dstQueueFamilyIndex = transfer.dst_family,
+        .buffer              = transfer.buffer,
+        .offset              = transfer.offset,
+        .size                = transfer.size
+    });
+}
+
+
+// ----- IMAGES
+void releaseOwnership(vk::raii::CommandBuffer const &cmd, ImageOwnershipTransfer const &transfer) {
+    if (isSameFamily(transfer.src_family, transfer.dst_family)) return;
+
+    // both halves must describe the same layout transition
+    recordBarrier(cmd, vk::ImageMemoryBarrier2 {
+        .srcStageMask        = transfer.src_stage,
+        .srcAccessMask       = transfer.src_access,
+        .oldLayout           = transfer.old_layout,
+        .newLayout           = transfer.new_layout,
+        .srcQueueFamilyIndex = transfer.src_family,
+        .dstQueueFamilyIndex = transfer.dst_family,
+        .image               = transfer.image,
+        .subresourceRange    = transfer.range
+    });
+}
+
+void acquireOwnership(vk::raii::CommandBuffer const &cmd, ImageOwnershipTransfer const &transfer) {
+    if (isSameFamily(transfer.src_family, transfer.dst_family)) {
+        recordBarrier(cmd, vk::ImageMemoryBarrier2 {
+            .srcStageMask        = transfer.src_stage,
+            .srcAccessMask       = transfer.src_access,
+            .dstStageMask        = transfer.dst_stage,
+            .dstAccessMask       = transfer.dst_access,
+            .oldLayout           = transfer.old_layout,
+            .newLayout           = transfer.new_layout,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image               = transfer.image,
+            .subresourceRange    = transfer.range
+        });
+        return;
+    }
+
+    recordBarrier(cmd, vk::ImageMemoryBarrier2 {
+        .dstStageMask        = transfer.dst_stage,
+        .dstAccessMask       = transfer.dst_access,
+        .oldLayout           = transfer.old_layout,
+        .newLayout           = transfer.new_layout,
+        .srcQueueFamilyIndex = transfer.src_family,
+        .dstQueueFamilyIndex = transfer.dst_family,
+        .image               = transfer.image,
+        .subresourceRange    = transfer.range
+    });
+}
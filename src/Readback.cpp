@@ -0,0 +1,195 @@
+#include "Readback.h"
+#include <algorithm>
+#include <stdexcept>
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+// ----- HELPER FUNCTIONS
+vk::ExternalMemoryHandleTypeFlagBits exportHandleType(ReadbackTarget target) {
+    return target == ReadbackTarget::eDmaBuf
+        ? vk::ExternalMemoryHandleTypeFlagBits::eDmaBufEXT
+        : vk::ExternalMemoryHandleTypeFlagBits::eOpaqueFd;
+}
+
+
+// ----- EXPORTED FD
+ReadbackPool::ExportedFd &ReadbackPool::ExportedFd::operator=(ExportedFd &&other) noexcept {
+    if (this != &other) {
+        reset();
+        fd = std::exchange(other.fd, -1);
+    }
+    return *this;
+}
+
+void ReadbackPool::ExportedFd::reset() {
+#ifndef _WIN32
+    if (fd >= 0) close(fd);
+#endif
+    fd = -1;
+}
+
+
+// ----- PUBLIC
+bool canExportReadback(vk::raii::PhysicalDevice const &physical_device, ReadbackTarget target) {
+    if (target == ReadbackTarget::eHostMemory) return true;
+
+    const auto properties = physical_device.getExternalBufferProperties({
+        .usage      = vk::BufferUsageFlagBits::eTransferDst,
+        .handleType = exportHandleType(target)
+    });
+
+    return bool(properties.externalMemoryProperties.externalMemoryFeatures & vk::ExternalMemoryFeatureFlagBits::eExportable);
+}
+
+ReadbackPool::ReadbackPool(
+    GpuAllocator &allocator,
+    vk::raii::Device const &device,
+    vk::Extent2D extent,
+    vk::Format format,
+    uint32_t texel_size,
+    uint32_t frame_count,
+    ReadbackTarget target
+) : allocator(&allocator),
+    readback_target(target),
+    extent(extent),
+    format(format),
+    row_pitch(extent.width * texel_size) {
+#ifdef _WIN32
+    if (target != ReadbackTarget::eHostMemory) {
+        throw std::runtime_error("Exported readback needs POSIX file descriptors");
+    }
+#endif
+
+    slots.resize(frame_count);
+    const auto size = vk::DeviceSize(row_pitch) * extent.height;
+
+    for (auto &slot : slots) {
+        if (target != ReadbackTarget::eHostMemory) {
+            createExported(slot, device, size);
+            continue;
+        }
+
+        slot.buffer = allocator.createBuffer({
+            .size        = size,
+            .usage       = vk::BufferUsageFlagBits::eTransferDst,
+            .sharingMode = vk::SharingMode::eExclusive
+        }, MemoryUsage::eReadback);
+    }
+}
+
+void ReadbackPool::collect(uint32_t frame, ReadbackSink const &sink) {
+    auto &slot = slots[frame];
+    if (!slot.pending) return;
+
+    slot.pending = false;
+
+    ReadbackFrame readback = {
+        .size      = vk::DeviceSize(row_pitch) * extent.height,
+        .extent    = extent,
+        .format    = format,
+        .row_pitch = row_pitch,
+        .frame     = slot.frame
+    };
+
+    if (readback_target == ReadbackTarget::eHostMemory) {
+        allocator->invalidate(slot.buffer.allocation);
+        readback.data = slot.buffer.allocation.mapped;
+    } else {
+        readback.fd = slot.fd.fd;
+        readback.size = slot.exported_size;
+    }
+
+    if (sink) sink(readback);
+}
+
+void ReadbackPool::record(
+    vk::raii::CommandBuffer const &cmd,
+    uint32_t frame,
+    vk::Image image,
+    uint64_t frame_number
+) {
+    auto &slot = slots[frame];
+
+    cmd.copyImageToBuffer(image, vk::ImageLayout::eTransferSrcOptimal, slot.handle(), vk::BufferImageCopy{
+        .bufferOffset      = 0,
+        .bufferRowLength   = 0,
+        .bufferImageHeight = 0,
+        .imageSubresource  = {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+        .imageOffset       = {0, 0, 0},
+        .imageExtent       = {extent.width, extent.height, 1}
+    });
+
+    // the timeline wait covers execution, this covers visibility to the
+    // host. Exported consumers are ordered by the same timeline wait
+    const vk::BufferMemoryBarrier2 to_host = {
+        .srcStageMask        = vk::PipelineStageFlagBits2::eCopy,
+        .srcAccessMask       = vk::AccessFlagBits2::eTransferWrite,
+        .dstStageMask        = vk::PipelineStageFlagBits2::eHost,
+        .dstAccessMask       = vk::AccessFlagBits2::eHostRead,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .buffer              = slot.handle(),
+        .offset              = 0,
+        .size                = vk::WholeSize
+    };
+    cmd.pipelineBarrier2({
+        .bufferMemoryBarrierCount = 1,
+        .pBufferMemoryBarriers    = &to_host
+    });
+
+    slot.frame = frame_number;
+    slot.pending = true;
+}
+
+void ReadbackPool::drain(ReadbackSink const &sink) {
+    // oldest first so the sink sees frames in order
+    std::vector<uint32_t> order;
+    for (uint32_t i = 0; i < slots.size(); i++) {
+        if (slots[i].pending) order.push_back(i);
+    }
+    std::ranges::sort(order, {}, [this](uint32_t i) { return slots[i].frame; });
+
+    for (auto frame : order) {
+        collect(frame, sink);
+    }
+}
+
+
+// ----- PRIVATE
+void ReadbackPool::createExported(Slot &slot, vk::raii::Device const &device, vk::DeviceSize size) {
+    const auto handle_type = exportHandleType(readback_target);
+
+    const vk::ExternalMemoryBufferCreateInfo external_info = {
+        .handleTypes = handle_type
+    };
+    slot.exported_buffer = vk::raii::Buffer(device, {
+        .pNext       = &external_info,
+        .size        = size,
+        .usage       = vk::BufferUsageFlagBits::eTransferDst,
+        .sharingMode = vk::SharingMode::eExclusive
+    });
+
+    const auto requirements = slot.exported_buffer.getMemoryRequirements();
+
+    const vk::MemoryDedicatedAllocateInfo dedicated_info = {
+        .buffer = *slot.exported_buffer
+    };
+    const vk::ExportMemoryAllocateInfo export_info = {
+        .pNext       = &dedicated_info,
+        .handleTypes = handle_type
+    };
+    slot.exported_memory = vk::raii::DeviceMemory(device, {
+        .pNext           = &export_info,
+        .allocationSize  = requirements.size,
+        .memoryTypeIndex = allocator->findMemoryType(requirements.memoryTypeBits, MemoryUsage::eGpuOnly)
+    });
+    slot.exported_buffer.bindMemory(*slot.exported_memory, 0);
+    slot.exported_size = requirements.size;
+
+    slot.fd = ExportedFd(device.getMemoryFdKHR({
+        .memory     = *slot.exported_memory,
+        .handleType = handle_type
+    }));
+}
@@ -0,0 +1,472 @@
+#include "RenderGraph.h"
+#include <algorithm>
+#include <numeric>
+
+// ----- HELPER FUNCTIONS
+struct UsageInfo {
+    vk::ImageLayout layout;
+    vk::PipelineStageFlags2 stage;
+    vk::AccessFlags2 access;
+    bool write;
+};
+
+UsageInfo usageInfo(ImageUsage usage) {
+    using Stage = vk::PipelineStageFlagBits2;
+    using Access = vk::AccessFlagBits2;
+
+    switch (usage) {
+        case ImageUsage::eColorAttachment:
+            return {
+                vk::ImageLayout::eColorAttachmentOptimal,
+                Stage::eColorAttachmentOutput,
+                Access::eColorAttachmentRead | Access::eColorAttachmentWrite,
+                true
+            };
+        case ImageUsage::eDepthAttachment:
+            return {
+                vk::ImageLayout::eDepthAttachmentOptimal,
+                Stage::eEarlyFragmentTests | Stage::eLateFragmentTests,
+                Access::eDepthStencilAttachmentRead | Access::eDepthStencilAttachmentWrite,
+                true
+            };
+        case ImageUsage::eDepthRead:
+            return {
+                vk::ImageLayout::eDepthReadOnlyOptimal,
+                Stage::eEarlyFragmentTests | Stage::eLateFragmentTests | Stage::eFragmentShader | Stage::eComputeShader,
+                Access::eDepthStencilAttachmentRead | Access::eShaderSampledRead,
+                false
+            };
+        case ImageUsage::eSampled:
+            return {
+                vk::ImageLayout::eShaderReadOnlyOptimal,
+                Stage::eFragmentShader | Stage::eComputeShader,
+                Access::eShaderSampledRead,
+                false
+            };
+        case ImageUsage::eStorageRead:
+            return {
+                vk::ImageLayout::eGeneral,
+                Stage::eFragmentShader | Stage::eComputeShader,
+                Access::eShaderStorageRead,
+                false
+            };
+        case ImageUsage::eStorageWrite:
+            return {
+                vk::ImageLayout::eGeneral,
+                Stage::eFragmentShader | Stage::eComputeShader,
+                Access::eShaderStorageRead | Access::eShaderStorageWrite,
+                true
+            };
+        case ImageUsage::eTransferSrc:
+            return {
+                vk::ImageLayout::eTransferSrcOptimal,
+                Stage::eAllTransfer,
+                Access::eTransferRead,
+                false
+            };
+        case ImageUsage::eTransferDst:
+            return {
+                vk::ImageLayout::eTransferDstOptimal,
+                Stage::eAllTransfer,
+                Access::eTransferWrite,
+                true
+            };
+    }
+    return {};
+}
+
+vk::ImageAspectFlags aspectOf(vk::Format format) {
+    switch (format) {
+        case vk::Format::eD16Unorm:
+        case vk::Format::eX8D24UnormPack32:
+        case vk::Format::eD32Sfloat:
+            return vk::ImageAspectFlagBits::eDepth;
+        case vk::Format::eD16UnormS8Uint:
+        case vk::Format::eD24UnormS8Uint:
+        case vk::Format::eD32SfloatS8Uint:
+            return vk::ImageAspectFlagBits::eDepth | vk::ImageAspectFlagBits::eStencil;
+        case vk::Format::eS8Uint:
+            return vk::ImageAspectFlagBits::eStencil;
+        default:
+            return vk::ImageAspectFlagBits::eColor;
+    }
+}
+
+
+// ----- TRANSIENT SET
+RenderGraph::TransientSet::~TransientSet() {
+    // images go before the memory they are bound to
+    images.clear();
+
+    for (auto const &slot : slots) {
+        allocator->free(slot.allocation);
+    }
+}
+
+
+// ----- PUBLIC
+RenderGraph::RenderGraph(vk::raii::Device const &device, GpuAllocator &allocator, RetireCallback retire)
+    : device(device), allocator(allocator), retire(std::move(retire)) {}
+
+void RenderGraph::reset() {
+    images.clear();
+    passes.clear();
+}
+
+RenderImage RenderGraph::importImage(
+    const char *name,
+    vk::Image image,
+    vk::ImageView view,
+    vk::Format format,
+    vk::Extent2D extent,
+    ImageState initial,
+    vk::ImageLayout final_layout
+) {
+    images.push_back({
+        .name         = name,
+        .image        = image,
+        .view         = view,
+        .format       = format,
+        .extent       = extent,
+        .initial      = initial,
+        .final_layout = final_layout
+    });
+
+    return static_cast<RenderImage>(images.size() - 1);
+}
+
+RenderImage RenderGraph::createImage(const char *name, TransientImageDesc const &desc) {
+    const auto transient_index = static_cast<uint32_t>(std::ranges::count_if(images, &ImageNode::transient));
+
+    images.push_back({
+        .name            = name,
+        .format          = desc.format,
+        .extent          = desc.extent,
+        .transient       = true,
+        .transient_index = transient_index,
+        .desc            = desc
+    });
+
+    return static_cast<RenderImage>(images.size() - 1);
+}
+
+void RenderGraph::addPass(
+    const char *name,
+    std::vector<ImageAccess> accesses,
+    PassExecute execute,
+    bool side_effects
+) {
+    passes.push_back({
+        .name         = name,
+        .accesses     = std::move(accesses),
+        .execute      = std::move(execute),
+        .side_effects = side_effects
+    });
+}
+
+void RenderGraph::execute(vk::raii::CommandBuffer const &cmd, GpuProfiler *profiler) {
+    cull();
+    allocateTransients();
+
+    // what the next access to each image has to wait for
+    struct Tracked {
+        vk::ImageLayout layout = vk::ImageLayout::eUndefined;
+        vk::PipelineStageFlags2 write_stage;
+        vk::AccessFlags2 write_access;
+        vk::PipelineStageFlags2 read_stages;
+        vk::PipelineStageFlags2 visible_stages;
+        vk::AccessFlags2 visible_access;
+        bool touched = false;
+    };
+    std::vector<Tracked> tracked(images.size());
+
+    // transients wait on whatever last used their memory, imports on the
+    // state the caller handed in
+    std::vector<vk::PipelineStageFlags2> slot_stages;
+    std::vector<vk::AccessFlags2> slot_writes;
+    if (transients) {
+        for (auto const &slot : transients->slots) {
+            slot_stages.push_back(slot.tail_stage);
+            slot_writes.push_back(slot.tail_write);
+        }
+    }
+
+    for (size_t i = 0; i < images.size(); i++) {
+        if (images[i].transient) continue;
+
+        tracked[i].layout = images[i].initial.layout;
+        tracked[i].write_stage = images[i].initial.stage;
+        tracked[i].write_access = images[i].initial.access;
+    }
+
+    auto barrier = [&](
+        ImageNode const &node,
+        Tracked const &state,
+        vk::ImageLayout new_layout,
+        vk::PipelineStageFlags2 src_stage,
+        vk::AccessFlags2 src_access,
+        vk::PipelineStageFlags2 dst_stage,
+        vk::AccessFlags2 dst_access
+    ) {
+        return vk::ImageMemoryBarrier2 {
+            .srcStageMask        = src_stage,
+            .srcAccessMask       = src_access,
+            .dstStageMask        = dst_stage,
+            .dstAccessMask       = dst_access,
+            .oldLayout           = state.layout,
+            .newLayout           = new_layout,
+            .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+            .image               = node.image,
+            .subresourceRange    = {aspectOf(node.format), 0, vk::RemainingMipLevels, 0, vk::RemainingArrayLayers}
+        };
+    };
+
+    barrier_count = 0;
+    std::vector<vk::ImageMemoryBarrier2> barriers;
+
+    for (auto &pass : passes) {
+        if (!pass.alive) continue;
+
+        for (auto const &access : pass.accesses) {
+            auto const &node = images[access.image];
+            auto &state = tracked[access.image];
+            const auto info = usageInfo(access.usage);
+            const auto write_access = info.write ? info.access & ~vk::AccessFlags2(
+                vk::AccessFlagBits2::eColorAttachmentRead |
+                vk::AccessFlagBits2::eDepthStencilAttachmentRead |
+                vk::AccessFlagBits2::eShaderStorageRead
+            ) : vk::AccessFlags2{};
+
+            // the previous occupant's writes have to be made available
+            // before the memory changes hands, not just waited on
+            if (node.transient && !state.touched) {
+                auto &node_slot = transients->images[node.transient_index].slot;
+                state.write_stage = slot_stages[node_slot];
+                state.write_access = slot_writes[node_slot];
+            }
+            if (node.transient) {
+                const auto node_slot = transients->images[node.transient_index].slot;
+                slot_stages[node_slot] |= info.stage;
+                slot_writes[node_slot] |= write_access;
+            }
+            state.touched = true;
+
+            if (info.write || info.layout != state.layout) {
+                // writes and transitions wait on the last write and on every
+                // read since, so nothing still reads the old contents
+                barriers.push_back(barrier(
+                    node, state, info.layout,
+                    state.write_stage | state.read_stages, state.write_access,
+                    info.stage, info.access
+                ));
+
+                state.layout = info.layout;
+                state.write_stage = info.stage;
+                state.write_access = write_access;
+                state.read_stages = info.write ? vk::PipelineStageFlags2{} : info.stage;
+                state.visible_stages = info.stage;
+                state.visible_access = info.access;
+                continue;
+            }
+
+            // reads only need a barrier the first time a stage or access
+            // type sees the last write
+            if ((info.stage & ~state.visible_stages) || (info.access & ~state.visible_access)) {
+                barriers.push_back(barrier(
+                    node, state, info.layout,
+                    state.write_stage, state.write_access,
+                    info.stage, info.access
+                ));
+                state.visible_stages |= info.stage;
+                state.visible_access |= info.access;
+            }
+            state.read_stages |= info.stage;
+        }
+
+        recordBarriers(cmd, barriers);
+
+        const auto scope = profiler ? profiler->begin(cmd, pass.name) : GPU_PROFILER_NO_SCOPE;
+        pass.execute(cmd);
+        if (profiler) profiler->end(cmd, scope);
+    }
+
+    // hand outputs back in the layout the caller asked for
+    for (size_t i = 0; i < images.size(); i++) {
+        auto const &node = images[i];
+        auto const &state = tracked[i];
+
+        if (node.transient || node.final_layout == vk::ImageLayout::eUndefined) continue;
+        if (node.final_layout == state.layout) continue;
+
+        barriers.push_back(barrier(
+            node, state, node.final_layout,
+            state.write_stage | state.read_stages, state.write_access,
+            vk::PipelineStageFlagBits2::eBottomOfPipe, {}
+        ));
+    }
+    recordBarriers(cmd, barriers);
+
+    if (transients) {
+        for (size_t i = 0; i < slot_stages.size(); i++) {
+            transients->slots[i].tail_stage = slot_stages[i];
+            transients->slots[i].tail_write = slot_writes[i];
+        }
+    }
+}
+
+
+// ----- PRIVATE
+void RenderGraph::cull() {
+    const auto writes = [](ImageUsage usage) { return usageInfo(usage).write; };
+
+    std::vector<bool> needed(images.size(), false);
+    for (size_t i = 0; i < images.size(); i++) {
+        needed[i] = !images[i].transient && images[i].final_layout != vk::ImageLayout::eUndefined;
+    }
+
+    // walk backwards from the outputs, a pass lives if it writes something
+    // a later live pass or the caller needs
+    culled_passes = 0;
+    for (auto pass = passes.rbegin(); pass != passes.rend(); pass++) {
+        pass->alive = pass->side_effects || std::ranges::any_of(pass->accesses, [&](auto const &access) {
+            return writes(access.usage) && needed[access.image];
+        });
+
+        if (!pass->alive) {
+            culled_passes++;
+            continue;
+        }
+
+        for (auto const &access : pass->accesses) {
+            needed[access.image] = true;
+        }
+    }
+
+    for (auto &node : images) {
+        node.first_pass = NO_PASS;
+        node.last_pass = NO_PASS;
+    }
+    for (uint32_t i = 0; i < passes.size(); i++) {
+        if (!passes[i].alive) continue;
+
+        for (auto const &access : passes[i].accesses) {
+            auto &node = images[access.image];
+            if (node.first_pass == NO_PASS) node.first_pass = i;
+            node.last_pass = i;
+        }
+    }
+}
+
+void RenderGraph::allocateTransients() {
+    std::vector<Signature> next;
+    std::vector<ImageNode *> nodes;
+    for (auto &node : images) {
+        if (!node.transient) continue;
+
+        next.push_back({node.desc, node.first_pass, node.last_pass});
+        nodes.push_back(&node);
+    }
+
+    // same images with the same lifetimes, last frame's layout still fits
+    if (!transients || next != signature) {
+        if (transients) retire(std::move(transients));
+        signature = std::move(next);
+
+        auto set = std::make_shared<TransientSet>();
+        set->allocator = &allocator;
+        set->images.resize(nodes.size());
+
+        std::vector<vk::MemoryRequirements> requirements(nodes.size());
+        for (size_t i = 0; i < nodes.size(); i++) {
+            auto const &desc = nodes[i]->desc;
+            if (nodes[i]->first_pass == NO_PASS) continue;
+
+            set->images[i].image = vk::raii::Image(device, {
+                .imageType     = vk::ImageType::e2D,
+                .format        = desc.format,
+                .extent        = {desc.extent.width, desc.extent.height, 1},
+                .mipLevels     = 1,
+                .arrayLayers   = 1,
+                .samples       = desc.samples,
+                .tiling        = vk::ImageTiling::eOptimal,
+                .usage         = desc.usage,
+                .sharingMode   = vk::SharingMode::eExclusive,
+                .initialLayout = vk::ImageLayout::eUndefined
+            });
+            requirements[i] = set->images[i].image.getMemoryRequirements();
+        }
+
+        // greedy by first use, an image moves into a slot whose previous
+        // occupants are all dead by the time it is first written
+        std::vector<uint32_t> order(nodes.size());
+        std::iota(order.begin(), order.end(), 0u);
+        std::ranges::sort(order, {}, [&](uint32_t i) { return nodes[i]->first_pass; });
+
+        for (auto i : order) {
+            if (nodes[i]->first_pass == NO_PASS) continue;
+
+            auto const &needs = requirements[i];
+            auto slot = std::ranges::find_if(set->slots, [&](auto const &candidate) {
+                return candidate.last_pass < nodes[i]->first_pass &&
+                       (candidate.requirements.memoryTypeBits & needs.memoryTypeBits);
+            });
+
+            if (slot == set->slots.end()) {
+                set->slots.push_back({.requirements = needs, .last_pass = nodes[i]->last_pass});
+                set->images[i].slot = static_cast<uint32_t>(set->slots.size() - 1);
+                continue;
+            }
+
+            slot->requirements.size = std::max(slot->requirements.size, needs.size);
+            slot->requirements.alignment = std::max(slot->requirements.alignment, needs.alignment);
+            slot->requirements.memoryTypeBits &= needs.memoryTypeBits;
+            slot->last_pass = nodes[i]->last_pass;
+            set->images[i].slot = static_cast<uint32_t>(slot - set->slots.begin());
+        }
+
+        for (auto &slot : set->slots) {
+            slot.allocation = allocator.allocate(slot.requirements, MemoryUsage::eGpuOnly, false);
+        }
+
+        for (size_t i = 0; i < nodes.size(); i++) {
+            auto &transient = set->images[i];
+            if (nodes[i]->first_pass == NO_PASS) continue;
+
+            auto const &allocation = set->slots[transient.slot].allocation;
+            transient.image.bindMemory(allocation.memory, allocation.offset);
+
+            transient.view = vk::raii::ImageView(device, {
+                .image            = *transient.image,
+                .viewType         = vk::ImageViewType::e2D,
+                .format           = nodes[i]->desc.format,
+                .subresourceRange = {aspectOf(nodes[i]->desc.format), 0, 1, 0, 1}
+            });
+        }
+
+        transients = std::move(set);
+    }
+
+    for (size_t i = 0; i < nodes.size(); i++) {
+        auto const &transient = transients->images[i];
+        if (nodes[i]->first_pass == NO_PASS) continue;
+
+        nodes[i]->image = *transient.image;
+        nodes[i]->view = *transient.view;
+    }
+}
+
+void RenderGraph::recordBarriers(
+    vk::raii::CommandBuffer const &cmd,
+    std::vector<vk::ImageMemoryBarrier2> &barriers
+) {
+    if (barriers.empty()) return;
+
+    cmd.pipelineBarrier2({
+        .imageMemoryBarrierCount = static_cast<uint32_t>(barriers.size()),
+        .pImageMemoryBarriers    = barriers.data()
+    });
+
+    barrier_count += static_cast<uint32_t>(barriers.size());
+    barriers.clear();
+}
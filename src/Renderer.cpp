@@ -1,14 +1,25 @@
 #include "Renderer.h"
+#include "PipelineCache.h"
 #include "vulkan/vulkan.hpp"
 #include <GLFW/glfw3.h>
+#include <glm/gtc/matrix_transform.hpp>
 #include <algorithm>
+#include <array>
+#include <chrono>
 #include <cassert>
 #include <cstdint>
 #include <cstring>
+#include <exception>
+#include <format>
+#include <fstream>
 #include <iterator>
 #include <map>
+#include <optional>
+#include <set>
 #include <stdexcept>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <iostream>
 #include <vulkan/vulkan_core.h>
 #include <vulkan/vulkan_raii.hpp>
@@ -31,11 +42,17 @@ VKAPI_ATTR vk::Bool32 VKAPI_CALL debugCB(
 	return vk::False;
 }
 
-uint32_t minSwapImgs(vk::SurfaceCapabilitiesKHR const &capabilities) {
+// mailbox needs a spare image to always have one free to render into, the
+// rest get by with two when latency matters more than keeping the GPU busy
+uint32_t minSwapImgs(vk::SurfaceCapabilitiesKHR const &capabilities, vk::PresentModeKHR mode, bool low_latency) {
     const auto max_cap = capabilities.maxImageCount;
     const auto min_cap = capabilities.minImageCount;
 
-    auto min_img = std::max(3u, min_cap);
+    uint32_t wanted = 3;
+    if (mode == vk::PresentModeKHR::eImmediate) wanted = 2;
+    if (mode != vk::PresentModeKHR::eMailbox && low_latency) wanted = 2;
+
+    auto min_img = std::max(wanted, min_cap);
 
     if (0 < max_cap && max_cap < min_img) {
         min_img = max_cap;
@@ -58,7 +75,9 @@ vk::SurfaceFormatKHR pickSwapSurfaceFormat(std::vector<vk::SurfaceFormatKHR> con
     return fmt_iter != available.end() ? *fmt_iter : available[0];
 }
 
-vk::PresentModeKHR pickSwapPresentMode(const std::vector<vk::PresentModeKHR> &available) {
+// the requested mode, or the closest one that tears no more than it does.
+// FIFO is always there
+vk::PresentModeKHR pickSwapPresentMode(const std::vector<vk::PresentModeKHR> &available, vk::PresentModeKHR requested) {
     assert(std::ranges::any_of(
         available,
         [](auto mode) {
@@ -66,18 +85,61 @@ vk::PresentModeKHR pickSwapPresentMode(const std::vector<vk::PresentModeKHR> &av
         }
     ));
 
-    if (std::ranges::any_of(
-        available,
-        [](const auto mode) {
-            return vk::PresentModeKHR::eMailbox == mode; 
-        })
-    ) {
-        return vk::PresentModeKHR::eMailbox;
+    std::vector<vk::PresentModeKHR> preference = {requested};
+    if (requested == vk::PresentModeKHR::eImmediate) preference.push_back(vk::PresentModeKHR::eMailbox);
+    if (requested == vk::PresentModeKHR::eFifoRelaxed) preference.push_back(vk::PresentModeKHR::eFifo);
+
+    for (auto mode : preference) {
+        if (std::ranges::find(available, mode) != available.end()) return mode;
     }
 
     return vk::PresentModeKHR::eFifo;
 }
 
+// renderers in a group save side by side, each device keeps its own file
+std::filesystem::path perDevicePath(const char *base, uint32_t device_rank) {
+    if (device_rank == 0) return base;
+
+    auto path = std::filesystem::path(base);
+    path.replace_extension(std::to_string(device_rank) + path.extension().string());
+    return path;
+}
+
+// everything that changes which device wins or what it enables, a
+// different value makes the cached device profile stale
+uint64_t deviceSelectionKey(RendererOptions const &options, size_t device_count, DeviceRequirements const &requirements) {
+    const std::array<uint64_t, 5> inputs = {
+        options.headless,
+        options.mesh_shaders,
+        options.low_latency,
+        options.device_rank,
+        device_count
+    };
+
+    // FNV-1a
+    uint64_t hash = 0xcbf29ce484222325ull;
+    auto mix = [&hash](uint8_t byte) {
+        hash ^= byte;
+        hash *= 0x100000001b3ull;
+    };
+
+    for (auto input : inputs) {
+        for (uint32_t i = 0; i < sizeof(input); i++) mix((input >> (i * 8)) & 0xff);
+    }
+
+    // names in order, the optional bits index into that list. The
+    // terminators keep {"ab", "c"} apart from {"a", "bc"}
+    for (auto const *list : {&requirements.extensions, &requirements.optional_extensions}) {
+        for (auto const *name : *list) {
+            for (; *name; name++) mix(static_cast<uint8_t>(*name));
+            mix(0);
+        }
+        mix(0xff);
+    }
+
+    return hash;
+}
+
 vk::Extent2D pickSwapExtent(GLFWwindow* window, const vk::SurfaceCapabilitiesKHR &capabilities) {
     if (capabilities.currentExtent.width != 0xFFFFFFFF) {
         return capabilities.currentExtent;
@@ -100,18 +162,196 @@ vk::Extent2D pickSwapExtent(GLFWwindow* window, const vk::SurfaceCapabilitiesKHR
     };
 }
 
+// the upscale blits the scene color into the output image, which share a
+// format. Empty when that format can't be blitted
+std::optional<vk::Filter> upscaleFilter(vk::raii::PhysicalDevice const &physical_device, vk::Format format) {
+    const auto features = physical_device.getFormatProperties(format).optimalTilingFeatures;
+    if (!(features & vk::FormatFeatureFlagBits::eBlitSrc) || !(features & vk::FormatFeatureFlagBits::eBlitDst)) {
+        return std::nullopt;
+    }
+
+    return (features & vk::FormatFeatureFlagBits::eSampledImageFilterLinear) ? vk::Filter::eLinear : vk::Filter::eNearest;
+}
+
+// scene draw pipeline for one permutation. Meshlet pipelines replace the
+// vertex stage and input assembly with task and mesh shaders from their own
+// module, the other features specialize the fragment shader
+PipelineRecipe scenePipelineRecipe(ShaderPermutation const &permutation, vk::PipelineLayout layout, ShaderLibrary &shaders) {
+    return [permutation, layout, &shaders](vk::raii::Device const &device, vk::raii::PipelineCache const &cache) {
+        const bool meshlets = permutation.has(ShaderFeature::eMeshlets);
+        const SpecializationConstants specialization(permutation);
+
+        auto shader_module = createShaderModule(device, *shaders.get(SCENE_SHADER_PATH));
+        auto mesh_module = meshlets
+            ? createShaderModule(device, *shaders.get(SCENE_MESH_SHADER_PATH))
+            : vk::raii::ShaderModule(nullptr);
+
+        std::vector<vk::PipelineShaderStageCreateInfo> shader_stages;
+        if (meshlets) {
+            shader_stages.push_back({
+                .stage  = vk::ShaderStageFlagBits::eTaskEXT,
+                .module = *mesh_module,
+                .pName  = "taskMain"
+            });
+            shader_stages.push_back({
+                .stage  = vk::ShaderStageFlagBits::eMeshEXT,
+                .module = *mesh_module,
+                .pName  = "meshMain"
+            });
+        } else {
+            shader_stages.push_back({
+                .stage  = vk::ShaderStageFlagBits::eVertex,
+                .module = *shader_module,
+                .pName  = "vertMain"
+            });
+        }
+        shader_stages.push_back({
+            .stage               = vk::ShaderStageFlagBits::eFragment,
+            .module              = *shader_module,
+            .pName               = "fragMain",
+            .pSpecializationInfo = &specialization.info
+        });
+
+        const auto binding = PackedVertex::getBindingDescription();
+        const auto attributes = PackedVertex::getAttributeDescriptions();
+        vk::PipelineVertexInputStateCreateInfo vertex_input = {
+            .vertexBindingDescriptionCount   = 1,
+            .pVertexBindingDescriptions      = &binding,
+            .vertexAttributeDescriptionCount = static_cast<uint32_t>(attributes.size()),
+            .pVertexAttributeDescriptions    = attributes.data()
+        };
+        vk::PipelineInputAssemblyStateCreateInfo input_assembly = {
+            .topology = vk::PrimitiveTopology::eTriangleList
+        };
+
+        // viewport and scissor are set when recording
+        vk::PipelineViewportStateCreateInfo viewport_state = {
+            .viewportCount = 1,
+            .scissorCount  = 1
+        };
+        std::vector<vk::DynamicState> dynamic_states = {
+            vk::DynamicState::eViewport,
+            vk::DynamicState::eScissor
+        };
+        vk::PipelineDynamicStateCreateInfo dynamic_state = {
+            .dynamicStateCount = static_cast<uint32_t>(dynamic_states.size()),
+            .pDynamicStates    = dynamic_states.data()
+        };
+
+        vk::PipelineRasterizationStateCreateInfo rasterizer = {
+            .depthClampEnable        = vk::False,
+            .rasterizerDiscardEnable = vk::False,
+            .polygonMode             = vk::PolygonMode::eFill,
+            .cullMode                = vk::CullModeFlagBits::eBack,
+            .frontFace               = vk::FrontFace::eClockwise,
+            .depthBiasEnable         = vk::False,
+            .lineWidth               = 1.0f
+        };
+        vk::PipelineMultisampleStateCreateInfo multisampling = {
+            .rasterizationSamples = vk::SampleCountFlagBits::e1,
+            .sampleShadingEnable  = vk::False
+        };
+
+        vk::PipelineDepthStencilStateCreateInfo depth_stencil = {
+            .depthTestEnable  = vk::True,
+            .depthWriteEnable = vk::True,
+            .depthCompareOp   = vk::CompareOp::eLess
+        };
+
+        vk::PipelineColorBlendAttachmentState blend_attachment = {
+            .blendEnable    = vk::False,
+            .colorWriteMask = vk::ColorComponentFlagBits::eR |
+                              vk::ColorComponentFlagBits::eG |
+                              vk::ColorComponentFlagBits::eB |
+                              vk::ColorComponentFlagBits::eA
+        };
+        vk::PipelineColorBlendStateCreateInfo color_blend = {
+            .logicOpEnable   = vk::False,
+            .attachmentCount = 1,
+            .pAttachments    = &blend_attachment
+        };
+
+        // dynamic rendering replaces the render pass
+        vk::PipelineRenderingCreateInfo rendering_info = {
+            .colorAttachmentCount    = 1,
+            .pColorAttachmentFormats = &permutation.color_format,
+            .depthAttachmentFormat   = SCENE_DEPTH_FORMAT
+        };
+
+        vk::GraphicsPipelineCreateInfo pipeline_info = {
+            .pNext               = &rendering_info,
+            .stageCount          = static_cast<uint32_t>(shader_stages.size()),
+            .pStages             = shader_stages.data(),
+            .pVertexInputState   = meshlets ? nullptr : &vertex_input,
+            .pInputAssemblyState = meshlets ? nullptr : &input_assembly,
+            .pViewportState      = &viewport_state,
+            .pRasterizationState = &rasterizer,
+            .pMultisampleState   = &multisampling,
+            .pDepthStencilState  = &depth_stencil,
+            .pColorBlendState    = &color_blend,
+            .pDynamicState       = &dynamic_state,
+            .layout              = layout,
+            .renderPass          = nullptr
+        };
+
+        return vk::raii::Pipeline(device, cache, pipeline_info);
+    };
+}
 
 // ----- PUBLIC
+Renderer::Renderer(RendererOptions options)
+  : options(std::move(options)), frames(this->options.frames_in_flight) {
+    if (this->options.frames_in_flight == 0) {
+        throw std::invalid_argument("At least one frame in flight is required");
+    }
+    // every draw comes from the scene, an empty one would only clear
+    if (this->options.scene.empty()) {
+        throw std::invalid_argument("Nothing to draw, the scene has no objects");
+    }
+}
+
+Renderer::~Renderer() {
+    // a run that threw out of a frame still has submissions in flight, none
+    // of the members below may go while the GPU uses them
+    if (*logical_device) {
+        std::scoped_lock lock(queue_mutex, transfer_mutex);
+        try {
+            logical_device.waitIdle();
+        } catch (std::exception const &e) {
+            std::cerr << "Failed to idle the device: " << e.what() << std::endl;
+        }
+    }
+
+    // a renderer that failed to initialize may still have reads in flight
+    if (!scheduler) return;
+
+    scheduler->wait(pipeline_cache_read);
+    scheduler->wait(assets_prefetched);
+}
+
 void Renderer::run() {
-    initWindow();
     initVulkan();
     mainLoop();
     cleanup();
 }
 
+void Renderer::setPresentMode(vk::PresentModeKHR mode) {
+    if (options.present_mode == mode) return;
+
+    options.present_mode = mode;
+    swap_chain_stale = true;
+}
+
+void Renderer::setLighting(LightingModel lighting) {
+    if (options.lighting == lighting) return;
+
+    options.lighting = lighting;
+    if (permutations) switchScenePermutation();
+}
+
 
 // ----- PRIVATE
-void Renderer::initWindow() {
+void Renderer::initGlfw() {
     if (glfwInit() == GLFW_FALSE) {
         throw std::runtime_error("GLFW failed to initialize");
     }
@@ -119,25 +359,150 @@ void Renderer::initWindow() {
     if (ENABLE_VALIDATION) {
         std::cerr << "GLFW platform: " << glfwGetPlatform() << "\n";
     }
+}
 
+void Renderer::initWindow() {
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
-    window = glfwCreateWindow(WIDTH, HEIGHT, "Graphics App", nullptr, nullptr);
+    window = glfwCreateWindow(options.extent.width, options.extent.height, "Graphics App", nullptr, nullptr);
 
     if (window == nullptr) {
         throw std::runtime_error("GLFW failed to create window");
     }
+
+    // not every platform reports out of date on resize, so don't wait for it
+    glfwSetWindowUserPointer(window, this);
+    glfwSetFramebufferSizeCallback(window, [](GLFWwindow *window, int, int) {
+        static_cast<Renderer *>(glfwGetWindowUserPointer(window))->swap_chain_stale = true;
+    });
+
+    // P cycles the present modes, unsupported ones fall back when picked.
+    // L toggles the lighting model
+    glfwSetKeyCallback(window, [](GLFWwindow *window, int key, int, int action, int) {
+        if (action != GLFW_PRESS) return;
+
+        auto *renderer = static_cast<Renderer *>(glfwGetWindowUserPointer(window));
+
+        if (key == GLFW_KEY_L) {
+            const bool lit = renderer->options.lighting == LightingModel::eLambert;
+            renderer->setLighting(lit ? LightingModel::eUnlit : LightingModel::eLambert);
+            return;
+        }
+        if (key != GLFW_KEY_P) return;
+
+        constexpr vk::PresentModeKHR cycle[] = {
+            vk::PresentModeKHR::eFifo,
+            vk::PresentModeKHR::eFifoRelaxed,
+            vk::PresentModeKHR::eMailbox,
+            vk::PresentModeKHR::eImmediate
+        };
+
+        const auto current = std::ranges::find(cycle, renderer->options.present_mode);
+        const auto next = current == std::end(cycle) || current + 1 == std::end(cycle) ? cycle : current + 1;
+
+        renderer->setPresentMode(*next);
+    });
 }
 
 void Renderer::initVulkan() {
-    createInstance();
-    setupDebugMessenger();
-    createSurface();
-    pickPhysicalDevice();
-    createLogicalDevice();
-    createSwapChain();
-    createImageView();
+    startup_begin_ns = cpuTraceNow();
+
+    // the scheduler needs no device, so file reads start before anything else
+    createScheduler();
+    startPrefetch();
+
+    // the instance only needs GLFW initialized, so it is created on a worker
+    // while this thread makes the window. GLFW wants windows on the main thread
+    if (!options.headless) startupStage("glfw", [this] { initGlfw(); });
+
+    auto instance_ready = std::make_shared<TaskCounter>();
+    std::exception_ptr instance_error;
+    scheduler->submit([this, &instance_error] {
+        try {
+            startupStage("instance", [this] {
+                createInstance();
+                setupDebugMessenger();
+            });
+        } catch (...) {
+            instance_error = std::current_exception();
+        }
+    }, instance_ready, TaskPriority::eHigh);
+
+    // the task refers to this frame, it has to finish before an error leaves
+    try {
+        if (!options.headless) startupStage("window", [this] { initWindow(); });
+    } catch (...) {
+        scheduler->wait(instance_ready);
+        throw;
+    }
+    scheduler->wait(instance_ready);
+
+    if (instance_error) {
+        std::rethrow_exception(instance_error);
+    }
+
+    startupStage("device", [this] {
+        createSurface();
+        pickPhysicalDevice();
+        createLogicalDevice();
+        createAllocator();
+        createBindless();
+        createStreaming();
+    });
+    startupStage("swap chain", [this] {
+        createSwapChain();
+        createImageView();
+    });
+    startupStage("pipelines", [this] {
+        createPipelineCache();
+        createPipelineBuilder();
+        createScene();
+        createGraphicsPipeline();
+        createShaderReloader();
+    });
+    startupStage("frame resources", [this] {
+        createCommandPool();
+        createCommandBuffers();
+        createCommandRecorder();
+        createSyncObjects();
+        createFrameRing();
+        createProfiler();
+        createResolutionScaler();
+        createRenderGraph();
+    });
+
+    startup_ready_ns = cpuTraceNow();
+}
+
+// disk reads that need no device, they overlap instance, window and device
+// creation. The loaders still do their own reads, asset prefetch only
+// warms the OS page cache for them
+void Renderer::startPrefetch() {
+    shader_library = std::make_unique<ShaderLibrary>(*scheduler);
+    shader_library->prefetch(SCENE_SHADER_PATH);
+    if (options.mesh_shaders) shader_library->prefetch(SCENE_MESH_SHADER_PATH);
+
+    scheduler->submit([this] {
+        startupStage("pipeline cache read", [this] {
+            pipeline_cache_file = readPipelineCacheFile(perDevicePath(PIPELINE_CACHE_PATH, options.device_rank));
+        });
+    }, pipeline_cache_read, TaskPriority::eHigh);
+
+    std::set<std::filesystem::path> assets;
+    for (auto const &object : options.scene) {
+        assets.insert(object.mesh);
+        assets.insert(meshCachePath(object.mesh));
+        if (!object.texture.empty()) assets.insert(object.texture);
+    }
+    if (assets.empty()) return;
+
+    // behind everything else, a cold disk should serve shaders first
+    scheduler->submit([this, assets = std::move(assets)] {
+        startupStage("asset prefetch", [&assets] {
+            for (auto const &path : assets) prefetchFile(path);
+        });
+    }, assets_prefetched);
 }
 
 void Renderer::createInstance() {
@@ -155,15 +520,11 @@ void Renderer::createInstance() {
         required_layers.assign(validation_layers.begin(), validation_layers.end());
     }
 
-    auto supported_layers = context.enumerateInstanceLayerProperties();
-
-    if (ENABLE_VALIDATION) {
-        std::cerr << "Supported layers:" << std::endl;
-        for (auto &layer : supported_layers) {
-            std::cerr << "-\t" << layer.layerName << std::endl;
-        }
-        std::cerr << std::endl;
-    }
+    // only enumerated when something is required, names are printed only
+    // when one is missing
+    const auto supported_layers = required_layers.empty()
+        ? std::vector<vk::LayerProperties>{}
+        : context.enumerateInstanceLayerProperties();
 
     for (auto const &required : required_layers) {
         if (std::ranges::none_of(
@@ -179,25 +540,23 @@ void Renderer::createInstance() {
         }
     }
 
-    // Ensure that the necessary extensions are supported
-    uint32_t extension_count = 0;
-    auto glfw_extensions = glfwGetRequiredInstanceExtensions(&extension_count);
+    // Ensure that the necessary extensions are supported, headless needs
+    // no surface extensions at all
+    std::vector<const char *> required_extensions;
+    if (!options.headless) {
+        uint32_t extension_count = 0;
+        auto glfw_extensions = glfwGetRequiredInstanceExtensions(&extension_count);
+        required_extensions.assign(glfw_extensions, glfw_extensions + extension_count);
+    }
 
     // add LunarG validation layer for debugging
-    std::vector required_extensions(glfw_extensions, glfw_extensions + extension_count);
     if (ENABLE_VALIDATION) {
         required_extensions.push_back(vk::EXTDebugUtilsExtensionName);
     }
 
-    auto supported_extensions = context.enumerateInstanceExtensionProperties();
-
-    if (ENABLE_VALIDATION) {
-        std::cerr << "Available Extensions:" << std::endl;
-        for (const auto &extension : supported_extensions) {
-            std::cerr << "-\t" << extension.extensionName << std::endl;
-        }
-        std::cerr << std::endl;
-    }
+    const auto supported_extensions = required_extensions.empty()
+        ? std::vector<vk::ExtensionProperties>{}
+        : context.enumerateInstanceExtensionProperties();
 
     for (auto const& required : required_extensions) {
         if (std::ranges::none_of(
@@ -248,6 +607,8 @@ void Renderer::setupDebugMessenger() {
 }
 
 void Renderer::createSurface() {
+    if (options.headless) return;
+
     // convert c -> c++ binding
     VkSurfaceKHR _surface;
     auto result = glfwCreateWindowSurface(*instance, window, nullptr, &_surface);
@@ -269,124 +630,325 @@ void Renderer::pickPhysicalDevice() {
         throw std::runtime_error("No physical devices available");
     }
 
-    std::multimap<uint32_t, vk::raii::PhysicalDevice> scored_devices;
+    const DeviceRequirements requirements = {
+        .surface             = options.headless ? vk::SurfaceKHR{} : *surface,
+        .extensions          = requiredDeviceExtensions(),
+        .optional_extensions = optional_device_extensions,
+        .prefer_mesh_shading = options.mesh_shaders,
+        .prefer_present_wait = options.low_latency
+    };
 
-    for (auto &device : devices) {
-        auto properties = device.getProperties();
-        auto features = device.getFeatures();
-        auto extensions = device.enumerateDeviceExtensionProperties();
-        auto queue_families = device.getQueueFamilyProperties();
-        uint32_t score = 0;
-
-        // Score the GPUs
-        if (properties.deviceType == vk::PhysicalDeviceType::eDiscreteGpu) {
-            score += 1000;
-        }
-        score += properties.limits.maxImageDimension2D;
+    // --- Cached
+    // the last launch's pick, still valid while the same device and driver
+    // are present and, with a window, it can present to the new surface
+    const auto profile_path = perDevicePath(DEVICE_PROFILE_PATH, options.device_rank);
+    const auto selection_key = deviceSelectionKey(options, devices.size(), requirements);
 
-        // --- Compatibility
-        if (!features.geometryShader) score = 0;
-        if (properties.apiVersion < VK_API_VERSION_1_4) score = 0;
+    if (auto cached = loadDeviceProfile(profile_path, selection_key)) {
+        for (auto &device : devices) {
+            if (!profileMatchesDevice(*cached, device, requirements)) continue;
+            if (!options.headless && !device.getSurfaceSupportKHR(cached->queue_family, *surface)) break;
 
-        if (std::ranges::none_of(
-            queue_families,
-            [](auto const& family) {
-                return (family.queueFlags & vk::QueueFlagBits::eGraphics) != static_cast<vk::QueueFlags>(0);
-            })
-        ) {
-            score = 0;
-        }
-        for (auto &required : device_extensions) {
-            if (std::ranges::none_of(
-                extensions,
-                [required](auto const &supported) {
-                    return strcmp(required, supported.extensionName) == 0;
-                })
-            ) {
-                score = 0;
-                break;
+            physical_device = device;
+            device_properties = device.getProperties();
+            device_profile = *cached;
+
+            if (ENABLE_VALIDATION) {
+                std::cerr << "Picked device: " << device_properties.deviceName << " (cached)" << std::endl;
             }
+            return;
         }
+    }
+
+    // --- Scored
+    std::multimap<uint32_t, std::pair<vk::raii::PhysicalDevice, DeviceProfile>> scored_devices;
+
+    for (auto &device : devices) {
+        const auto profile = profileDevice(device, requirements);
 
         if (ENABLE_VALIDATION) {
             std::cerr
-                << "Physical Device: " << properties.deviceName
-                << "\tScore: " << score
+                << "Physical Device: " << device.getProperties().deviceName
+                << "\tScore: " << profile.score
                 << std::endl;
         }
 
-        if (score == 0) continue;
+        if (profile.score == 0) continue;
 
-        scored_devices.insert(std::make_pair(score, device));       
+        scored_devices.insert(std::make_pair(profile.score, std::make_pair(device, profile)));
     }
 
     if (scored_devices.empty()) {
         throw std::runtime_error("No suitable physical device available");
     }
+    if (options.device_rank >= scored_devices.size()) {
+        throw std::runtime_error(
+            "Device rank " + std::to_string(options.device_rank) + " requested but only "
+            + std::to_string(scored_devices.size()) + " suitable devices are available"
+        );
+    }
 
-    physical_device = scored_devices.rbegin()->second;
-}
-
-void Renderer::createLogicalDevice() {
-    auto family_properties = physical_device.getQueueFamilyProperties();
-
-    const uint32_t max_idx = family_properties.size();
-    uint32_t queue_idx = max_idx;
+    // the rest stay unused, with equal scores the enumeration order decides
+    const auto picked = std::next(scored_devices.rbegin(), options.device_rank);
+    physical_device = picked->second.first;
+    device_properties = physical_device.getProperties();
+    device_profile = picked->second.second;
 
-    // try to find queue that can do both graphics and presentation
-    // fallback is using the first different queues that support these properties
-    for (uint32_t i = 0; i < max_idx; i++) {
-        bool valid_gfx = bool(family_properties[i].queueFlags & vk::QueueFlagBits::eGraphics);
-        bool valid_pres = physical_device.getSurfaceSupportKHR(i, *surface);
+    if (ENABLE_VALIDATION) {
+        std::cerr << "Picked device: " << device_properties.deviceName << std::endl;
+    }
 
-        if (valid_gfx && valid_pres) {
-            queue_idx = i;
-            break;
-        }
+    // losing the profile only costs the next launch a full scan
+    try {
+        saveDeviceProfile(profile_path, selection_key, device_profile);
+    } catch (std::exception const &e) {
+        std::cerr << "Device profile not saved: " << e.what() << std::endl;
     }
+}
 
-    if (queue_idx == max_idx) {
-        throw std::runtime_error("No graphics queue available with presentation available");
+void Renderer::createLogicalDevice() {
+    queue_family = device_profile.queue_family;
+    transfer_family = device_profile.transfer_family;
+    compute_family = device_profile.compute_family;
+
+    if (ENABLE_VALIDATION) {
+        std::cerr
+            << "Queue families: graphics " << queue_family
+            << "\ttransfer " << transfer_family
+            << "\tcompute " << compute_family
+            << std::endl;
     }
 
     vk::StructureChain<
         vk::PhysicalDeviceFeatures2,
+        vk::PhysicalDeviceVulkan12Features,
         vk::PhysicalDeviceVulkan13Features,
-        vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT>
+        vk::PhysicalDeviceExtendedDynamicStateFeaturesEXT,
+        vk::PhysicalDeviceMeshShaderFeaturesEXT,
+        vk::PhysicalDevicePresentIdFeaturesKHR,
+        vk::PhysicalDevicePresentWaitFeaturesKHR>
     feature_chain = {
         {},
-		{.dynamicRendering = true},
-		{.extendedDynamicState = true}
+        {
+            .drawIndirectCount                             = true,
+            .descriptorIndexing                            = true,
+            .shaderSampledImageArrayNonUniformIndexing     = true,
+            .shaderStorageBufferArrayNonUniformIndexing    = true,
+            .descriptorBindingSampledImageUpdateAfterBind  = true,
+            .descriptorBindingStorageBufferUpdateAfterBind = true,
+            .descriptorBindingUpdateUnusedWhilePending     = true,
+            .descriptorBindingPartiallyBound               = true,
+            .runtimeDescriptorArray                        = true,
+            .timelineSemaphore                             = true
+        },
+		{.synchronization2 = true, .dynamicRendering = true},
+		{.extendedDynamicState = true},
+		{.taskShader = true, .meshShader = true},
+		{.presentId = true},
+		{.presentWait = true}
 	};
 
+    // the vertex path is the fallback when the device can't do mesh shading
+    mesh_shading = options.mesh_shaders && device_profile.has(DeviceCapability::eMeshShading);
+    if (!mesh_shading) {
+        feature_chain.unlink<vk::PhysicalDeviceMeshShaderFeaturesEXT>();
+    }
+    if (options.mesh_shaders && !mesh_shading) {
+        std::cerr << "Mesh shaders not supported, using the vertex path" << std::endl;
+    }
+
+    // without it low latency mode only gets the smaller swap chain
+    present_wait = options.low_latency && !options.headless && device_profile.has(DeviceCapability::ePresentWait);
+    if (!present_wait) {
+        feature_chain.unlink<vk::PhysicalDevicePresentIdFeaturesKHR>();
+        feature_chain.unlink<vk::PhysicalDevicePresentWaitFeaturesKHR>();
+    }
+    if (options.low_latency && !options.headless && !present_wait) {
+        std::cerr << "Present wait not supported, low latency mode won't throttle" << std::endl;
+    }
+
+    // block compression is optional, textures transcode to whichever is on
+    enabled_features = vk::PhysicalDeviceFeatures{};
+    enabled_features.multiDrawIndirect = true;
+    enabled_features.drawIndirectFirstInstance = true;
+    enabled_features.samplerAnisotropy = device_profile.has(DeviceCapability::eSamplerAnisotropy);
+    enabled_features.textureCompressionETC2 = device_profile.has(DeviceCapability::eTextureETC2);
+    enabled_features.textureCompressionASTC_LDR = device_profile.has(DeviceCapability::eTextureASTC);
+    enabled_features.textureCompressionBC = device_profile.has(DeviceCapability::eTextureBC);
+    feature_chain.get<vk::PhysicalDeviceFeatures2>().features = enabled_features;
+
+    // one queue per unique family, shared when families coincide
+    std::vector<uint32_t> unique_families = {queue_family};
+    for (auto family : {transfer_family, compute_family}) {
+        if (std::ranges::find(unique_families, family) == unique_families.end()) {
+            unique_families.push_back(family);
+        }
+    }
+
     float priority = 0.5f;
-    vk::DeviceQueueCreateInfo queue_info = {
-        .queueFamilyIndex = queue_idx,
-        .queueCount       = 1,
-        .pQueuePriorities = &priority
-    };
+    std::vector<vk::DeviceQueueCreateInfo> queue_infos;
+    for (auto family : unique_families) {
+        queue_infos.push_back({
+            .queueFamilyIndex = family,
+            .queueCount       = 1,
+            .pQueuePriorities = &priority
+        });
+    }
+
+    enabled_device_extensions = requiredDeviceExtensions();
+    for (uint32_t i = 0; i < optional_device_extensions.size(); i++) {
+        if (device_profile.hasOptionalExtension(i)) {
+            enabled_device_extensions.push_back(optional_device_extensions[i]);
+        }
+    }
+    if (mesh_shading) {
+        enabled_device_extensions.push_back(vk::EXTMeshShaderExtensionName);
+    }
+    if (present_wait) {
+        enabled_device_extensions.push_back(vk::KHRPresentIdExtensionName);
+        enabled_device_extensions.push_back(vk::KHRPresentWaitExtensionName);
+    }
 
     vk::DeviceCreateInfo device_info = {
         .pNext = &feature_chain.get<vk::PhysicalDeviceFeatures2>(),
-        .queueCreateInfoCount    = 1,
-        .pQueueCreateInfos       = &queue_info,
-        .enabledExtensionCount   = static_cast<uint32_t>(device_extensions.size()),
-        .ppEnabledExtensionNames = device_extensions.data()
+        .queueCreateInfoCount    = static_cast<uint32_t>(queue_infos.size()),
+        .pQueueCreateInfos       = queue_infos.data(),
+        .enabledExtensionCount   = static_cast<uint32_t>(enabled_device_extensions.size()),
+        .ppEnabledExtensionNames = enabled_device_extensions.data()
     };
 
     logical_device = vk::raii::Device(physical_device, device_info);
-    queue = vk::raii::Queue(logical_device, queue_idx, 0);
+    queue = vk::raii::Queue(logical_device, queue_family, 0);
+    transfer_queue = vk::raii::Queue(logical_device, transfer_family, 0);
+    compute_queue = vk::raii::Queue(logical_device, compute_family, 0);
+}
+
+void Renderer::createScheduler() {
+    scheduler = options.scheduler ? options.scheduler : std::make_shared<TaskScheduler>();
+
+    if (ENABLE_VALIDATION) {
+        std::cerr << "Task scheduler: " << scheduler->threadCount() << " workers" << std::endl;
+    }
+}
+
+bool Renderer::isDeviceExtensionEnabled(const char *name) const {
+    return std::ranges::any_of(
+        enabled_device_extensions,
+        [name](auto const &enabled) {
+            return strcmp(name, enabled) == 0;
+        }
+    );
+}
+
+void Renderer::createAllocator() {
+    allocator = std::make_unique<GpuAllocator>(
+        physical_device,
+        logical_device,
+        isDeviceExtensionEnabled(vk::EXTMemoryBudgetExtensionName)
+    );
+
+    if (ENABLE_VALIDATION) {
+        auto budgets = allocator->getBudgets();
+
+        for (size_t i = 0; i < budgets.size(); i++) {
+            std::cerr
+                << "Memory heap " << i
+                << "\tsize: " << (budgets[i].heap_size >> 20) << "MiB"
+                << "\tbudget: " << (budgets[i].budget >> 20) << "MiB"
+                << "\tusage: " << (budgets[i].usage >> 20) << "MiB"
+                << std::endl;
+        }
+    }
+}
+
+void Renderer::createBindless() {
+    const auto properties = physical_device.getProperties2<
+        vk::PhysicalDeviceProperties2,
+        vk::PhysicalDeviceVulkan12Properties>();
+
+    // a released slot may still be read by frames in flight
+    bindless = std::make_unique<BindlessTable>(
+        logical_device,
+        properties.get<vk::PhysicalDeviceVulkan12Properties>(),
+        [this](std::shared_ptr<void> resources) { deferDestroy(std::move(resources)); }
+    );
+
+    default_sampler = vk::raii::Sampler(logical_device, {
+        .magFilter        = vk::Filter::eLinear,
+        .minFilter        = vk::Filter::eLinear,
+        .mipmapMode       = vk::SamplerMipmapMode::eLinear,
+        .addressModeU     = vk::SamplerAddressMode::eRepeat,
+        .addressModeV     = vk::SamplerAddressMode::eRepeat,
+        .addressModeW     = vk::SamplerAddressMode::eRepeat,
+        .anisotropyEnable = enabled_features.samplerAnisotropy,
+        .maxAnisotropy    = enabled_features.samplerAnisotropy ? device_properties.limits.maxSamplerAnisotropy : 1.0f,
+        .maxLod           = vk::LodClampNone
+    });
+    default_sampler_slot = bindless->addSampler(*default_sampler);
+
+    if (ENABLE_VALIDATION) {
+        std::cerr
+            << "Bindless table: " << bindless->capacity(BindlessKind::eImage) << " images\t"
+            << bindless->capacity(BindlessKind::eSampler) << " samplers\t"
+            << bindless->capacity(BindlessKind::eBuffer) << " buffers"
+            << std::endl;
+    }
+}
+
+void Renderer::createStreaming() {
+    upload_queue = std::make_unique<UploadQueue>(
+        logical_device,
+        transfer_queue,
+        transfer_family,
+        queue_family,
+        transfer_family == queue_family ? queue_mutex : transfer_mutex
+    );
+    auto mesh_stages = vk::PipelineStageFlagBits2::eComputeShader | vk::PipelineStageFlagBits2::eVertexShader;
+    if (mesh_shading) {
+        mesh_stages |= vk::PipelineStageFlagBits2::eTaskShaderEXT | vk::PipelineStageFlagBits2::eMeshShaderEXT;
+    }
+    mesh_loader = std::make_unique<MeshLoader>(logical_device, *allocator, *upload_queue, *scheduler, mesh_stages);
+    texture_loader = std::make_unique<TextureLoader>(
+        physical_device,
+        enabled_features,
+        logical_device,
+        *allocator,
+        *upload_queue,
+        *scheduler,
+        *bindless
+    );
+}
+
+std::vector<const char *> Renderer::requiredDeviceExtensions() const {
+    if (options.headless) return {};
+
+    return device_extensions;
 }
 
 void Renderer::createSwapChain() {
+    if (options.headless) {
+        createOffscreenTargets();
+        return;
+    }
+
     auto surface_cap = physical_device.getSurfaceCapabilitiesKHR(*surface);
     auto surface_fmt = physical_device.getSurfaceFormatsKHR(*surface);
     auto surface_pres = physical_device.getSurfacePresentModesKHR(*surface);
 
     swap_extent = pickSwapExtent(window, surface_cap);
     swap_format = pickSwapSurfaceFormat(surface_fmt);
-    auto swap_img_count = minSwapImgs(surface_cap);
-    auto swap_pres_mode = pickSwapPresentMode(surface_pres);
+    swap_present_mode = pickSwapPresentMode(surface_pres, options.present_mode);
+    auto swap_img_count = minSwapImgs(surface_cap, swap_present_mode, options.low_latency);
+
+    // the upscale writes the swap images with a blit
+    const auto filter = upscaleFilter(physical_device, swap_format.format);
+    auto usage = vk::ImageUsageFlags(vk::ImageUsageFlagBits::eColorAttachment);
+    can_upscale = filter && (surface_cap.supportedUsageFlags & vk::ImageUsageFlagBits::eTransferDst);
+    if (can_upscale) {
+        usage |= vk::ImageUsageFlagBits::eTransferDst;
+        upscale_filter = *filter;
+    }
+    render_extent = resolution_scaler && can_upscale ? resolution_scaler->apply(swap_extent) : swap_extent;
 
     vk::SwapchainCreateInfoKHR swap_info {
         .surface          = *surface,
@@ -395,16 +957,75 @@ void Renderer::createSwapChain() {
         .imageColorSpace  = swap_format.colorSpace,
         .imageExtent      = swap_extent,
         .imageArrayLayers = 1,
-        .imageUsage       = vk::ImageUsageFlagBits::eColorAttachment,
+        .imageUsage       = usage,
         .imageSharingMode = vk::SharingMode::eExclusive,
         .preTransform     = surface_cap.currentTransform,
         .compositeAlpha   = vk::CompositeAlphaFlagBitsKHR::eOpaque,
-        .presentMode      = swap_pres_mode,
-        .clipped          = true
+        .presentMode      = swap_present_mode,
+        .clipped          = true,
+        .oldSwapchain     = *swap_chain
     };
 
-	swap_chain = vk::raii::SwapchainKHR(logical_device, swap_info);
+    // images already acquired from the old chain can still be presented,
+    // it goes once the new chain has taken over the presents
+    auto next_chain = vk::raii::SwapchainKHR(logical_device, swap_info);
+    if (*swap_chain) deferUntilPresented(std::move(swap_chain));
+
+	swap_chain = std::move(next_chain);
 	swap_images = swap_chain.getImages();
+    swap_chain_first_present = present_id + 1;
+}
+
+void Renderer::createOffscreenTargets() {
+    // one target per frame in flight, so frame_idx doubles as the image index
+    swap_extent = options.extent;
+    swap_format = {OFFSCREEN_FORMAT, vk::ColorSpaceKHR::eSrgbNonlinear};
+
+    const auto filter = upscaleFilter(physical_device, swap_format.format);
+    can_upscale = filter.has_value();
+    if (can_upscale) upscale_filter = *filter;
+    render_extent = swap_extent;
+
+    auto usage = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc;
+    if (can_upscale) usage |= vk::ImageUsageFlagBits::eTransferDst;
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        offscreen_images.push_back(allocator->createImage({
+            .imageType     = vk::ImageType::e2D,
+            .format        = swap_format.format,
+            .extent        = {swap_extent.width, swap_extent.height, 1},
+            .mipLevels     = 1,
+            .arrayLayers   = 1,
+            .samples       = vk::SampleCountFlagBits::e1,
+            .tiling        = vk::ImageTiling::eOptimal,
+            .usage         = usage,
+            .sharingMode   = vk::SharingMode::eExclusive,
+            .initialLayout = vk::ImageLayout::eUndefined
+        }, MemoryUsage::eGpuOnly));
+
+        swap_images.push_back(*offscreen_images.back());
+    }
+
+    auto target = options.readback_target;
+    const bool can_export =
+        isDeviceExtensionEnabled(vk::KHRExternalMemoryFdExtensionName) &&
+        (target != ReadbackTarget::eDmaBuf || isDeviceExtensionEnabled(vk::EXTExternalMemoryDmaBufExtensionName)) &&
+        canExportReadback(physical_device, target);
+
+    if (target != ReadbackTarget::eHostMemory && !can_export) {
+        std::cerr << "Frame export not supported, reading back through host memory" << std::endl;
+        target = ReadbackTarget::eHostMemory;
+    }
+
+    readback = ReadbackPool(
+        *allocator,
+        logical_device,
+        swap_extent,
+        swap_format.format,
+        4,
+        static_cast<uint32_t>(frames.size()),
+        target
+    );
 }
 
 void Renderer::createImageView() {
@@ -422,13 +1043,988 @@ void Renderer::createImageView() {
 	}
 }
 
+bool Renderer::recreateSwapChain() {
+    // minimized, there is nothing to present to until it comes back
+    int width = 0, height = 0;
+    glfwGetFramebufferSize(window, &width, &height);
+    if (width == 0 || height == 0) return false;
+
+    CpuScope scope("recreate swap chain");
+    swap_chain_stale = false;
+
+    // frames in flight keep presenting the old images, everything tied to
+    // them is retired instead of waiting for the device to go idle
+    const auto old_format = swap_format.format;
+    const auto old_render_extent = render_extent;
+
+    deferDestroy(std::move(swap_image_views));
+    deferUntilPresented(std::move(render_finished));
+    swap_image_views.clear();
+    render_finished.clear();
+
+    createSwapChain();
+    createImageView();
+    createRenderFinished();
+
+    if (swap_format.format != old_format) {
+        deferDestroy(std::move(graphics_pipeline));
+        deferDestroy(std::move(mesh_pipeline));
+        buildScenePipelines();
+    }
+
+    // the render graph picks up the new extent for its transients by itself
+    if (render_extent != old_render_extent) scene->resize(render_extent);
+
+    if (ENABLE_VALIDATION) {
+        std::cerr
+            << "Swap chain recreated: " << swap_extent.width << "x" << swap_extent.height
+            << "\t" << swap_images.size() << " images"
+            << "\t" << vk::to_string(swap_present_mode)
+            << std::endl;
+    }
+
+    return true;
+}
+
+void Renderer::waitForPresent() {
+    if (!present_wait || present_id <= LOW_LATENCY_QUEUED_PRESENTS) return;
+
+    // ids from a retired chain can't be waited on through the new one
+    const auto target = present_id - LOW_LATENCY_QUEUED_PRESENTS;
+    if (target < swap_chain_first_present) return;
+
+    CpuScope scope("present wait");
+
+    // out of date and timeouts are left to the next acquire, this only
+    // throttles
+    const auto result = swap_chain.waitForPresent(target, PRESENT_WAIT_TIMEOUT);
+    if (result != vk::Result::eSuccess &&
+        result != vk::Result::eTimeout &&
+        result != vk::Result::eErrorOutOfDateKHR &&
+        result != vk::Result::eSuboptimalKHR
+    ) {
+        throw std::runtime_error("Failed to wait for present");
+    }
+}
+
+void Renderer::createPipelineCache() {
+    // read by startPrefetch, only the device checks are left
+    scheduler->wait(pipeline_cache_read);
+    auto blob = parsePipelineCache(pipeline_cache_file, device_properties);
+    pipeline_cache_file = {};
+
+    if (ENABLE_VALIDATION) {
+        std::cerr
+            << "Pipeline cache: "
+            << (blob.empty() ? "cold start" : std::to_string(blob.size()) + " bytes loaded")
+            << std::endl;
+    }
+
+    vk::PipelineCacheCreateInfo cache_info = {
+        .initialDataSize = blob.size(),
+        .pInitialData    = blob.data()
+    };
+
+    pipeline_cache = vk::raii::PipelineCache(logical_device, cache_info);
+}
+
+void Renderer::createPipelineBuilder() {
+    pipeline_builder = std::make_unique<PipelineBuilder>(logical_device, pipeline_cache, *scheduler, *shader_library);
+}
+
+void Renderer::createScene() {
+    // a replaced table or pyramid may still be in flight
+    scene = std::make_unique<GpuScene>(
+        logical_device,
+        *allocator,
+        *pipeline_builder,
+        [this](std::shared_ptr<void> resources) { deferDestroy(std::move(resources)); },
+        mesh_shading,
+        options.cpu_culling ? scheduler.get() : nullptr
+    );
+
+    std::map<std::filesystem::path, uint32_t> mesh_ids;
+    std::map<std::filesystem::path, uint32_t> texture_ids;
+    for (auto const &object : options.scene) {
+        auto [entry, inserted] = mesh_ids.try_emplace(object.mesh, 0);
+        if (inserted) entry->second = scene->addMesh(mesh_loader->load(object.mesh));
+
+        auto texture = NO_SCENE_TEXTURE;
+        if (!object.texture.empty()) {
+            auto [texture_entry, texture_inserted] = texture_ids.try_emplace(object.texture, 0);
+            if (texture_inserted) {
+                texture_entry->second = scene->addTexture(texture_loader->load(object.texture), default_sampler_slot);
+            }
+            texture = texture_entry->second;
+        }
+
+        scene->addInstance(entry->second, object.transform, texture);
+    }
+
+    scene->resize(render_extent);
+}
+
+void Renderer::createGraphicsPipeline() {
+    // the view projection is pushed, the instance tables come from the scene
+    const vk::PushConstantRange push_range = {
+        .stageFlags = vk::ShaderStageFlagBits::eVertex,
+        .offset     = 0,
+        .size       = sizeof(glm::mat4)
+    };
+    // set 0 is pushed per mesh, set 1 is the bindless table
+    const std::array<vk::DescriptorSetLayout, 2> scene_layouts = {scene->drawSetLayout(), bindless->setLayout()};
+
+    pipeline_layout = vk::raii::PipelineLayout(logical_device, {
+        .setLayoutCount         = static_cast<uint32_t>(scene_layouts.size()),
+        .pSetLayouts            = scene_layouts.data(),
+        .pushConstantRangeCount = 1,
+        .pPushConstantRanges    = &push_range
+    });
+
+    // the task shader gets the mesh whose draws it reads, the rest comes
+    // from the scene tables and the camera constants
+    if (mesh_shading) {
+        const vk::PushConstantRange mesh_push_range = {
+            .stageFlags = vk::ShaderStageFlagBits::eTaskEXT,
+            .offset     = 0,
+            .size       = sizeof(uint32_t)
+        };
+        const std::array<vk::DescriptorSetLayout, 2> mesh_layouts = {scene->meshSetLayout(), bindless->setLayout()};
+
+        mesh_pipeline_layout = vk::raii::PipelineLayout(logical_device, {
+            .setLayoutCount         = static_cast<uint32_t>(mesh_layouts.size()),
+            .pSetLayouts            = mesh_layouts.data(),
+            .pushConstantRangeCount = 1,
+            .pPushConstantRanges    = &mesh_push_range
+        });
+    }
+
+    // textures are known up front, a scene without any compiles the
+    // sampling out entirely
+    scene_textured = std::ranges::any_of(options.scene, [](auto const &object) {
+        return !object.texture.empty();
+    });
+
+    permutations = std::make_unique<PermutationCache>(
+        *pipeline_builder,
+        [this](ShaderPermutation const &permutation) {
+            const auto layout = permutation.has(ShaderFeature::eMeshlets) ? *mesh_pipeline_layout : *pipeline_layout;
+            return scenePipelineRecipe(permutation, layout, pipeline_builder->shaders());
+        }
+    );
+
+    buildScenePipelines();
+}
+
+void Renderer::buildScenePipelines() {
+    // these already use the newest SPIR-V and format, a switch in flight has
+    // nothing left to replace them with
+    next_graphics_pipeline = {};
+    next_mesh_pipeline = {};
+
+    // variants for the old format are never asked for again
+    for (auto &variant : permutations->clear()) deferDestroy(std::move(variant));
+
+    // compiled in the background, frames skip the draw until it is ready
+    graphics_pipeline = permutations->get(scenePermutation(false));
+    if (mesh_shading) {
+        mesh_pipeline = permutations->get(scenePermutation(true));
+    }
+}
+
+ShaderPermutation Renderer::scenePermutation(bool meshlets) const {
+    ShaderPermutation permutation = {.color_format = swap_format.format};
+
+    permutation
+        .set(ShaderFeature::eMeshlets, meshlets)
+        .set(ShaderFeature::eTextured, scene_textured)
+        .set(ShaderFeature::eAlphaTest, options.alpha_test)
+        .set(ShaderFeature::eLit, options.lighting == LightingModel::eLambert);
+
+    return permutation;
+}
+
+// frames keep the current variants until the new ones are ready, cached
+// variants swap in on the next frame
+void Renderer::switchScenePermutation() {
+    next_graphics_pipeline = permutations->get(scenePermutation(false));
+    if (mesh_shading) {
+        next_mesh_pipeline = permutations->get(scenePermutation(true));
+    }
+
+    pipelines_pending = true;
+}
+
+void Renderer::createShaderReloader() {
+    if (!options.hot_reload_shaders) return;
+
+#if defined(SHADER_SOURCE_DIR) && defined(SLANGC_PATH)
+    shader_reloader = std::make_unique<ShaderReloader>(
+        *shader_library,
+        SHADER_SOURCE_DIR,
+        std::filesystem::path(SCENE_SHADER_PATH).parent_path(),
+        SLANGC_PATH
+    );
+#else
+    std::cerr << "Shader hot reload needs a build with the Slang sources, it stays off" << std::endl;
+#endif
+}
+
+// the library has the new SPIR-V, build replacements for every pipeline
+// that uses it. Frames keep the old ones until all of them are ready
+void Renderer::reloadPipelines() {
+    scene->reloadPipelines(*pipeline_builder);
+
+    // every cached variant was built from the old SPIR-V
+    for (auto &variant : permutations->clear()) deferDestroy(std::move(variant));
+    switchScenePermutation();
+}
+
+// between frames, so no frame mixes pipelines from before and after
+void Renderer::swapPendingPipelines() {
+    if (!pipelines_pending) return;
+
+    auto done = [](PipelineHandle const &handle) { return handle.empty() || handle.ready(); };
+    if (!scene->reloadDone() || !done(next_graphics_pipeline) || !done(next_mesh_pipeline)) return;
+
+    pipelines_pending = false;
+
+    auto next_graphics = std::exchange(next_graphics_pipeline, {});
+    auto next_mesh = std::exchange(next_mesh_pipeline, {});
+
+    try {
+        // everything is checked before the scene swaps its own
+        next_graphics.get();
+        next_mesh.get();
+        scene->swapPipelines();
+    } catch (std::exception const &e) {
+        std::cerr << "Pipeline switch failed: " << e.what() << ", keeping the current pipelines" << std::endl;
+        return;
+    }
+
+    if (!next_graphics.empty()) deferDestroy(std::exchange(graphics_pipeline, std::move(next_graphics)));
+    if (!next_mesh.empty()) deferDestroy(std::exchange(mesh_pipeline, std::move(next_mesh)));
+}
+
+void Renderer::createCommandPool() {
+    vk::CommandPoolCreateInfo pool_info = {
+        .flags            = vk::CommandPoolCreateFlagBits::eResetCommandBuffer,
+        .queueFamilyIndex = queue_family
+    };
+
+    command_pool = vk::raii::CommandPool(logical_device, pool_info);
+}
+
+void Renderer::createCommandBuffers() {
+    vk::CommandBufferAllocateInfo alloc_info = {
+        .commandPool        = *command_pool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = static_cast<uint32_t>(frames.size())
+    };
+
+    auto command_buffers = logical_device.allocateCommandBuffers(alloc_info);
+
+    for (size_t i = 0; i < frames.size(); i++) {
+        frames[i].command_buffer = std::move(command_buffers[i]);
+    }
+}
+
+void Renderer::createCommandRecorder() {
+    command_recorder = std::make_unique<CommandRecorder>(
+        logical_device,
+        queue_family,
+        static_cast<uint32_t>(frames.size()),
+        *scheduler
+    );
+}
+
+void Renderer::createSyncObjects() {
+    assert(render_finished.empty());
+
+    vk::SemaphoreTypeCreateInfo timeline_info = {
+        .semaphoreType = vk::SemaphoreType::eTimeline,
+        .initialValue  = timeline_value
+    };
+    timeline = vk::raii::Semaphore(logical_device, {.pNext = &timeline_info});
+
+    for (auto &frame : frames) {
+        frame.image_available = vk::raii::Semaphore(logical_device, vk::SemaphoreCreateInfo());
+    }
+
+    createRenderFinished();
+}
+
+void Renderer::createRenderFinished() {
+    assert(render_finished.empty());
+
+    for (size_t i = 0; i < swap_images.size(); i++) {
+        render_finished.emplace_back(logical_device, vk::SemaphoreCreateInfo());
+    }
+}
+
+void Renderer::createFrameRing() {
+    frame_ring = FrameRingBuffer(
+        *allocator,
+        device_properties.limits,
+        static_cast<uint32_t>(frames.size()),
+        FRAME_RING_SIZE + scene->frameRingBytes()
+    );
+}
+
+void Renderer::createProfiler() {
+    const auto family_properties = physical_device.getQueueFamilyProperties();
+
+    gpu_profiler = GpuProfiler(
+        logical_device,
+        device_properties.limits,
+        family_properties[queue_family].timestampValidBits,
+        static_cast<uint32_t>(frames.size())
+    );
+}
+
+void Renderer::createResolutionScaler() {
+    if (options.target_gpu_ms <= 0.0) return;
+
+    if (!gpu_profiler.enabled() || !can_upscale) {
+        std::cerr << "Dynamic resolution needs timestamp queries and a blittable output, rendering at full resolution" << std::endl;
+        return;
+    }
+
+    // a frame's timing is read frames in flight later, by then the next
+    // frames were recorded at the old scale too
+    resolution_scaler = std::make_unique<ResolutionScaler>(
+        options.target_gpu_ms,
+        options.min_render_scale,
+        static_cast<uint32_t>(frames.size()) + 1
+    );
+}
+
+void Renderer::createRenderGraph() {
+    // a transient layout that no longer fits may still be in flight
+    render_graph = std::make_unique<RenderGraph>(
+        logical_device,
+        *allocator,
+        [this](std::shared_ptr<void> resources) { deferDestroy(std::move(resources)); }
+    );
+}
+
 void Renderer::mainLoop() {
-    while (!glfwWindowShouldClose(window)) {
-        glfwPollEvents();
+    cpuTraceThreadName("render");
+
+    auto running = [this] {
+        if (window && glfwWindowShouldClose(window)) return false;
+
+        return options.frame_count == 0 || frames_rendered < options.frame_count;
+    };
+
+    // glfw's clock is not available without a window
+    using clock = std::chrono::steady_clock;
+    auto last_report = clock::now();
+
+    while (running()) {
+        // input is only worth sampling once the frame it feeds can start
+        if (window) waitForPresent();
+
+        if (window) {
+            CpuScope scope("poll");
+            glfwPollEvents();
+        }
+
+        if (shader_reloader && shader_reloader->poll()) reloadPipelines();
+        swapPendingPipelines();
+
+        if (options.camera_path) options.camera_path(frames_rendered, options.camera_eye, options.camera_target);
+
+        // frames recorded before the scene pipeline compiled draw nothing
+        const bool draws_scene = graphics_pipeline.ready();
+        const auto frame_begin = clock::now();
+        const auto frames_before = frames_rendered;
+        const bool was_resident = scene_resident;
+        drawFrame();
+
+        // GPU samples arrive in frame order, every one still due from before
+        // this frame timed a scene that was streaming
+        if (scene_resident && !was_resident) {
+            run_stats.resident_ms = (cpuTraceNow() - startup_begin_ns) / 1e6;
+            stats_gpu_sample = timeline_value - 1;
+        }
+
+        if (draws_scene && !startup_reported) {
+            startup_reported = true;
+            run_stats.startup_ms = (startup_ready_ns - startup_begin_ns) / 1e6;
+            run_stats.first_frame_ms = (cpuTraceNow() - startup_begin_ns) / 1e6;
+            reportStartup();
+        }
+
+        // a frame that was skipped, e.g. while minimized, is not counted
+        if (options.collect_stats && frames_rendered != frames_before) {
+            run_stats.cpu_frame_ms.push_back(std::chrono::duration<double, std::milli>(clock::now() - frame_begin).count());
+
+            const auto gpu_sample = gpu_profiler.latest("frame");
+            if (gpu_sample && gpu_sample->sequence > stats_gpu_sample) {
+                stats_gpu_sample = gpu_sample->sequence;
+                run_stats.gpu_frame_ms.push_back(gpu_sample->ms);
+            }
+        }
+
+        if (std::chrono::duration<double>(clock::now() - last_report).count() >= PROFILER_REPORT_INTERVAL) {
+            last_report = clock::now();
+            reportGpuTimings();
+        }
     }
+
+    if (options.collect_stats) {
+        run_stats.device = device_properties.deviceName.data();
+        run_stats.heaps = allocator->getBudgets();
+    }
+
+    {
+        std::scoped_lock lock(queue_mutex, transfer_mutex);
+        logical_device.waitIdle();
+    }
+    deletion_queue.clear();
+    present_deletion_queue.clear();
+
+    // the last frames in flight never had their slot come back around
+    if (options.headless) readback.drain(options.readback_sink);
+}
+
+void Renderer::drawFrame() {
+    if (options.headless) {
+        drawOffscreenFrame();
+        return;
+    }
+
+    auto &frame = frames[frame_idx];
+    cpuTraceFrame(timeline_value + 1);
+
+    // only block if the GPU is still using this frame's resources
+    {
+        CpuScope scope("wait");
+        waitTimeline(frame.timeline_value);
+        collectGarbage();
+    }
+
+    // the GPU is done reading this frame's region
+    frame_ring.beginFrame(frame_idx);
+
+    if (swap_chain_stale && !recreateSwapChain()) {
+        glfwWaitEvents();
+        return;
+    }
+
+    vk::Result acquire_result;
+    uint32_t image_idx;
+    {
+        CpuScope scope("acquire");
+        std::tie(acquire_result, image_idx) = swap_chain.acquireNextImage(
+            UINT64_MAX,
+            *frame.image_available,
+            nullptr
+        );
+    }
+
+    // nothing was signaled, so the frame can be retried as is
+    if (acquire_result == vk::Result::eErrorOutOfDateKHR) {
+        swap_chain_stale = true;
+        return;
+    }
+
+    if (acquire_result != vk::Result::eSuccess &&
+        acquire_result != vk::Result::eSuboptimalKHR
+    ) {
+        throw std::runtime_error("Failed to acquire swap chain image");
+    }
+
+    {
+        CpuScope scope("record");
+        frame.command_buffer.reset();
+        recordCommandBuffer(frame.command_buffer, image_idx);
+    }
+
+    frame.timeline_value = ++timeline_value;
+
+    // uploads acquired while recording have to land before they are read
+    const vk::SemaphoreSubmitInfo wait_infos[] = {
+        {
+            .semaphore = *frame.image_available,
+            .stageMask = vk::PipelineStageFlagBits2::eColorAttachmentOutput
+        },
+        {
+            .semaphore = upload_queue->timeline(),
+            .value     = upload_wait_value,
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+        }
+    };
+    const vk::SemaphoreSubmitInfo signal_infos[] = {
+        {
+            .semaphore = *render_finished[image_idx],
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+        },
+        {
+            .semaphore = *timeline,
+            .value     = frame.timeline_value,
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+        }
+    };
+    const vk::CommandBufferSubmitInfo command_info = {
+        .commandBuffer = *frame.command_buffer
+    };
+    const vk::SubmitInfo2 submit_info = {
+        .waitSemaphoreInfoCount   = upload_wait_value ? 2u : 1u,
+        .pWaitSemaphoreInfos      = wait_infos,
+        .commandBufferInfoCount   = 1,
+        .pCommandBufferInfos      = &command_info,
+        .signalSemaphoreInfoCount = static_cast<uint32_t>(std::size(signal_infos)),
+        .pSignalSemaphoreInfos    = signal_infos
+    };
+
+    std::lock_guard lock(queue_mutex);
+
+    {
+        CpuScope scope("submit");
+        queue.submit2(submit_info);
+    }
+
+    // presentation only accepts binary semaphores
+    const uint64_t frame_present_id = ++present_id;
+    const vk::PresentIdKHR present_id_info = {
+        .swapchainCount = 1,
+        .pPresentIds    = &frame_present_id
+    };
+    const vk::PresentInfoKHR present_info = {
+        .pNext              = present_wait ? &present_id_info : nullptr,
+        .waitSemaphoreCount = 1,
+        .pWaitSemaphores    = &*render_finished[image_idx],
+        .swapchainCount     = 1,
+        .pSwapchains        = &*swap_chain,
+        .pImageIndices      = &image_idx
+    };
+
+    vk::Result present_result;
+    {
+        CpuScope scope("present");
+        present_result = queue.presentKHR(present_info);
+    }
+
+    if (present_result != vk::Result::eSuccess &&
+        present_result != vk::Result::eSuboptimalKHR &&
+        present_result != vk::Result::eErrorOutOfDateKHR
+    ) {
+        throw std::runtime_error("Failed to present swap chain image");
+    }
+
+    // the frame still went out, the next one gets the new chain
+    if (present_result != vk::Result::eSuccess || acquire_result == vk::Result::eSuboptimalKHR) {
+        swap_chain_stale = true;
+    }
+
+    if (scene_resident) frames_rendered++;
+    frame_idx = (frame_idx + 1) % frames.size();
+}
+
+void Renderer::drawOffscreenFrame() {
+    auto &frame = frames[frame_idx];
+    cpuTraceFrame(timeline_value + 1);
+
+    {
+        CpuScope scope("wait");
+        waitTimeline(frame.timeline_value);
+        collectGarbage();
+    }
+
+    frame_ring.beginFrame(frame_idx);
+
+    // the copy this slot recorded last time has landed in host memory
+    {
+        CpuScope scope("readback");
+        readback.collect(frame_idx, options.readback_sink);
+    }
+
+    {
+        CpuScope scope("record");
+        frame.command_buffer.reset();
+        recordCommandBuffer(frame.command_buffer, frame_idx);
+    }
+
+    frame.timeline_value = ++timeline_value;
+
+    // no acquire or present, the timeline is the only thing to signal
+    const vk::SemaphoreSubmitInfo wait_info = {
+        .semaphore = upload_queue->timeline(),
+        .value     = upload_wait_value,
+        .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+    };
+    const vk::SemaphoreSubmitInfo signal_info = {
+        .semaphore = *timeline,
+        .value     = frame.timeline_value,
+        .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+    };
+    const vk::CommandBufferSubmitInfo command_info = {
+        .commandBuffer = *frame.command_buffer
+    };
+    const vk::SubmitInfo2 submit_info = {
+        .waitSemaphoreInfoCount   = upload_wait_value ? 1u : 0u,
+        .pWaitSemaphoreInfos      = &wait_info,
+        .commandBufferInfoCount   = 1,
+        .pCommandBufferInfos      = &command_info,
+        .signalSemaphoreInfoCount = 1,
+        .pSignalSemaphoreInfos    = &signal_info
+    };
+
+    {
+        CpuScope scope("submit");
+        std::lock_guard lock(queue_mutex);
+        queue.submit2(submit_info);
+    }
+
+    if (scene_resident) frames_rendered++;
+    frame_idx = (frame_idx + 1) % frames.size();
+}
+
+void Renderer::reportGpuTimings() {
+    if (!gpu_profiler.enabled()) return;
+
+    const auto stats = gpu_profiler.stats();
+
+    // the title doubles as the overlay, the full breakdown goes to the log
+    std::string title = "Graphics";
+    for (auto const &pass : stats) {
+        title += std::format(" | {} {:.2f} ms", pass.name, pass.avg_ms);
+    }
+    if (resolution_scaler) title += std::format(" | scale {:.0f}%", resolution_scaler->scale() * 100.0f);
+    if (window) glfwSetWindowTitle(window, title.c_str());
+
+    if (ENABLE_VALIDATION) {
+        for (auto const &pass : stats) {
+            std::cerr << std::format(
+                "GPU {:<12} min {:6.3f} ms\tavg {:6.3f} ms\tp99 {:6.3f} ms",
+                pass.name, pass.min_ms, pass.avg_ms, pass.p99_ms
+            ) << std::endl;
+        }
+    }
+}
+
+void Renderer::updateRenderScale() {
+    if (!resolution_scaler) return;
+
+    // each frame's timing is fed once, the whole frame including the upscale
+    const auto sample = gpu_profiler.latest("frame");
+    if (!sample || sample->sequence == render_scale_sample) return;
+    render_scale_sample = sample->sequence;
+
+    if (!resolution_scaler->update(sample->ms)) return;
+
+    // the pyramid follows the depth buffer, the graph resizes its transients
+    const auto next_extent = can_upscale ? resolution_scaler->apply(swap_extent) : swap_extent;
+    if (next_extent == render_extent) return;
+
+    render_extent = next_extent;
+    scene->resize(render_extent);
+}
+
+void Renderer::reportStartup() {
+    if (!options.report_startup && !ENABLE_VALIDATION) return;
+
+    auto print = [](const char *name, uint64_t ns) {
+        std::cerr << std::format("Startup {:<20} {:8.2f} ms", name, ns / 1e6) << std::endl;
+    };
+
+    // stages on other threads overlap, so they add up to more than the total
+    std::lock_guard lock(startup_mutex);
+    for (auto const &[name, ns] : startup_stages) {
+        print(name, ns);
+    }
+    print("initialized", startup_ready_ns - startup_begin_ns);
+    print("first frame", cpuTraceNow() - startup_begin_ns);
+}
+
+void Renderer::waitTimeline(uint64_t value) {
+    if (value <= completed_value) return;
+
+    const vk::SemaphoreWaitInfo wait_info = {
+        .semaphoreCount = 1,
+        .pSemaphores    = &*timeline,
+        .pValues        = &value
+    };
+
+    if (logical_device.waitSemaphores(wait_info, UINT64_MAX) != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to wait for timeline semaphore");
+    }
+
+    completed_value = value;
+}
+
+void Renderer::collectGarbage() {
+    while (!present_deletion_queue.empty() && present_deletion_queue.front().first <= present_id) {
+        deletion_queue.emplace_back(timeline_value, std::move(present_deletion_queue.front().second));
+        present_deletion_queue.pop_front();
+    }
+
+    if (deletion_queue.empty()) return;
+
+    completed_value = std::max(completed_value, timeline.getCounterValue());
+
+    while (!deletion_queue.empty() && deletion_queue.front().first <= completed_value) {
+        deletion_queue.pop_front();
+    }
+}
+
+void Renderer::recordCommandBuffer(vk::raii::CommandBuffer const &cmd, uint32_t image_idx) {
+    cmd.begin({});
+
+    // this frame slot's previous results are complete, the timeline said so
+    gpu_profiler.beginFrame(cmd, frame_idx);
+    command_recorder->beginFrame(frame_idx);
+    const auto frame_scope = gpu_profiler.begin(cmd, "frame");
+
+    // the timings beginFrame just collected pick this frame's resolution
+    updateRenderScale();
+
+    // take ownership of anything the transfer queue finished releasing
+    upload_wait_value = upload_queue->acquire(cmd);
+
+    // slots released while the last frame recorded wait for it to finish
+    bindless->beginFrame();
+
+    // picks up meshes and texture mips that finished streaming since the
+    // last frame
+    const bool scene_ready = scene->update();
+    const auto view_proj = viewProjection();
+
+    std::vector<RecordJob> jobs;
+
+    const vk::Viewport viewport = {
+        .x        = 0.0f,
+        .y        = 0.0f,
+        .width    = static_cast<float>(render_extent.width),
+        .height   = static_cast<float>(render_extent.height),
+        .minDepth = 0.0f,
+        .maxDepth = 1.0f
+    };
+    const vk::Rect2D scissor = {.offset = {0, 0}, .extent = render_extent};
+
+    // meshlets once their pipeline compiled, the vertex path until then
+    auto meshlet_pipeline = mesh_shading ? mesh_pipeline.get() : vk::Pipeline{};
+    auto pipeline = graphics_pipeline.get();
+    const bool use_meshlets = static_cast<bool>(meshlet_pipeline);
+
+    // from here on every frame draws the scene as it will stay
+    if (!scene_resident) {
+        scene_resident = scene_ready && graphics_pipeline.ready() &&
+            (!mesh_shading || mesh_pipeline.ready()) && scene->resident();
+    }
+
+    // the draws below are recorded against what this writes
+    if (scene_ready) scene->cullOnCpu(frame_ring, view_proj, use_meshlets);
+
+    // the meshes are split into contiguous ranges, one secondary each, so
+    // every scheduler thread has one to record
+    const auto mesh_count = scene->meshCount();
+    const auto job_count = std::clamp(
+        (mesh_count + RECORD_JOB_MIN_MESHES - 1) / RECORD_JOB_MIN_MESHES,
+        1u,
+        scheduler->threadCount() + 1
+    );
+    const auto job_meshes = (mesh_count + job_count - 1) / job_count;
+
+    if (use_meshlets && scene_ready) {
+        const auto camera = GpuScene::meshletConstants(frame_ring, view_proj, options.camera_eye);
+
+        for (uint32_t first = 0; first < mesh_count; first += job_meshes) {
+            const auto end = std::min(first + job_meshes, mesh_count);
+            jobs.push_back([this, meshlet_pipeline, viewport, scissor, camera, first, end](vk::raii::CommandBuffer const &secondary) {
+                secondary.bindPipeline(vk::PipelineBindPoint::eGraphics, meshlet_pipeline);
+                secondary.setViewport(0, viewport);
+                secondary.setScissor(0, scissor);
+                bindless->bind(secondary, vk::PipelineBindPoint::eGraphics, *mesh_pipeline_layout, 1);
+                scene->drawMeshlets(secondary, *mesh_pipeline_layout, camera, first, end);
+            });
+        }
+    } else if (pipeline && scene_ready) {
+        for (uint32_t first = 0; first < mesh_count; first += job_meshes) {
+            const auto end = std::min(first + job_meshes, mesh_count);
+            jobs.push_back([this, pipeline, viewport, scissor, view_proj, first, end](vk::raii::CommandBuffer const &secondary) {
+                secondary.bindPipeline(vk::PipelineBindPoint::eGraphics, pipeline);
+                secondary.setViewport(0, viewport);
+                secondary.setScissor(0, scissor);
+                secondary.pushConstants<glm::mat4>(*pipeline_layout, vk::ShaderStageFlagBits::eVertex, 0, view_proj);
+                bindless->bind(secondary, vk::PipelineBindPoint::eGraphics, *pipeline_layout, 1);
+                scene->draw(secondary, *pipeline_layout, first, end);
+            });
+        }
+    }
+
+    const SecondaryTarget target = {
+        .color_formats = {swap_format.format},
+        .depth_format  = SCENE_DEPTH_FORMAT
+    };
+    const auto secondaries = command_recorder->record(target, jobs);
+
+    render_graph->reset();
+
+    // the previous use of the image finished before acquire signaled
+    const auto backbuffer = render_graph->importImage(
+        "backbuffer",
+        swap_images[image_idx],
+        *swap_image_views[image_idx],
+        swap_format.format,
+        swap_extent,
+        {vk::ImageLayout::eUndefined, vk::PipelineStageFlagBits2::eColorAttachmentOutput, {}},
+        options.headless ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR
+    );
+    const auto depth = render_graph->createImage("depth", {
+        .format = SCENE_DEPTH_FORMAT,
+        .extent = render_extent,
+        .usage  = vk::ImageUsageFlagBits::eDepthStencilAttachment | vk::ImageUsageFlagBits::eSampled
+    });
+
+    // below full resolution the scene renders into its own target and is
+    // blitted up into the backbuffer, otherwise straight into it
+    const bool upscale = render_extent != swap_extent;
+    const auto scene_color = upscale
+        ? render_graph->createImage("scene color", {
+            .format = swap_format.format,
+            .extent = render_extent,
+            .usage  = vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc
+        })
+        : backbuffer;
+
+    // culling tests against the pyramid built from last frame's depth
+    RenderImage hiz = 0;
+    if (scene_ready) {
+        hiz = scene->importHiZ(*render_graph);
+
+        render_graph->addPass(
+            "cull",
+            {{hiz, ImageUsage::eSampled}},
+            [&](vk::raii::CommandBuffer const &pass_cmd) { scene->cull(pass_cmd, frame_ring, view_proj, use_meshlets); },
+            true
+        );
+    }
+
+    render_graph->addPass(
+        "main pass",
+        {{scene_color, ImageUsage::eColorAttachment}, {depth, ImageUsage::eDepthAttachment}},
+        [&](vk::raii::CommandBuffer const &pass_cmd) {
+            vk::RenderingAttachmentInfo color_attachment = {
+                .imageView   = render_graph->view(scene_color),
+                .imageLayout = vk::ImageLayout::eColorAttachmentOptimal,
+                .loadOp      = vk::AttachmentLoadOp::eClear,
+                .storeOp     = vk::AttachmentStoreOp::eStore,
+                .clearValue  = vk::ClearColorValue(0.0f, 0.0f, 0.0f, 1.0f)
+            };
+            vk::RenderingAttachmentInfo depth_attachment = {
+                .imageView   = render_graph->view(depth),
+                .imageLayout = vk::ImageLayout::eDepthAttachmentOptimal,
+                .loadOp      = vk::AttachmentLoadOp::eClear,
+                .storeOp     = vk::AttachmentStoreOp::eStore,
+                .clearValue  = vk::ClearDepthStencilValue(1.0f, 0)
+            };
+            // the pass contents come from secondaries recorded on the workers
+            vk::RenderingInfo rendering_info = {
+                .flags                = vk::RenderingFlagBits::eContributingSecondaryCommandBuffers,
+                .renderArea           = {.offset = {0, 0}, .extent = render_extent},
+                .layerCount           = 1,
+                .colorAttachmentCount = 1,
+                .pColorAttachments    = &color_attachment,
+                .pDepthAttachment     = &depth_attachment
+            };
+
+            pass_cmd.beginRendering(rendering_info);
+
+            if (!secondaries.empty()) {
+                pass_cmd.executeCommands(secondaries);
+            }
+
+            pass_cmd.endRendering();
+        }
+    );
+
+    // bilinear, a sharpening upscaler would replace this pass
+    if (upscale) {
+        render_graph->addPass(
+            "upscale",
+            {{scene_color, ImageUsage::eTransferSrc}, {backbuffer, ImageUsage::eTransferDst}},
+            [&](vk::raii::CommandBuffer const &pass_cmd) {
+                auto corner = [](vk::Extent2D extent) {
+                    return vk::Offset3D{static_cast<int32_t>(extent.width), static_cast<int32_t>(extent.height), 1};
+                };
+                const vk::ImageBlit2 region = {
+                    .srcSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+                    .srcOffsets     = std::array<vk::Offset3D, 2>{vk::Offset3D{0, 0, 0}, corner(render_extent)},
+                    .dstSubresource = {vk::ImageAspectFlagBits::eColor, 0, 0, 1},
+                    .dstOffsets     = std::array<vk::Offset3D, 2>{vk::Offset3D{0, 0, 0}, corner(swap_extent)}
+                };
+
+                pass_cmd.blitImage2({
+                    .srcImage       = render_graph->image(scene_color),
+                    .srcImageLayout = vk::ImageLayout::eTransferSrcOptimal,
+                    .dstImage       = swap_images[image_idx],
+                    .dstImageLayout = vk::ImageLayout::eTransferDstOptimal,
+                    .regionCount    = 1,
+                    .pRegions       = &region,
+                    .filter         = upscale_filter
+                });
+            }
+        );
+    }
+
+    if (scene_ready) {
+        render_graph->addPass(
+            "hi-z",
+            {{depth, ImageUsage::eDepthRead}, {hiz, ImageUsage::eStorageWrite}},
+            [&](vk::raii::CommandBuffer const &pass_cmd) { scene->buildHiZ(pass_cmd, render_graph->view(depth)); }
+        );
+    }
+
+    // partially loaded frames are not handed to the sink
+    if (options.headless && scene_resident) {
+        render_graph->addPass(
+            "readback",
+            {{backbuffer, ImageUsage::eTransferSrc}},
+            [&](vk::raii::CommandBuffer const &pass_cmd) {
+                readback.record(
+                    pass_cmd,
+                    image_idx,
+                    swap_images[image_idx],
+                    options.frame_offset + frames_rendered * options.frame_stride
+                );
+            },
+            true
+        );
+    }
+
+    render_graph->execute(cmd, &gpu_profiler);
+
+    gpu_profiler.end(cmd, frame_scope);
+    cmd.end();
+}
+
+glm::mat4 Renderer::viewProjection() const {
+    const auto view = glm::lookAt(options.camera_eye, options.camera_target, glm::vec3(0.0f, 1.0f, 0.0f));
+    const float aspect = static_cast<float>(swap_extent.width) / static_cast<float>(swap_extent.height);
+
+    auto projection = glm::perspectiveRH_ZO(glm::radians(CAMERA_FOV_Y), aspect, CAMERA_NEAR, CAMERA_FAR);
+    // Vulkan's clip space y points down
+    projection[1][1] *= -1.0f;
+
+    return projection * view;
 }
 
 void Renderer::cleanup() {
+    // let in flight compiles land in the cache before it is written
+    pipeline_builder->waitIdle();
+
+    // a failed write only costs a cold start next launch
+    try {
+        savePipelineCache(perDevicePath(PIPELINE_CACHE_PATH, options.device_rank), physical_device.getProperties(), pipeline_cache);
+    } catch (const std::exception &e) {
+        std::cerr << "Failed to save pipeline cache: " << e.what() << std::endl;
+    }
+
+    if (options.headless) return;
+
     glfwDestroyWindow(window);
     glfwTerminate();
 }
@@ -0,0 +1,67 @@
+#include "RendererGroup.h"
+#include <exception>
+#include <mutex>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// ----- PUBLIC
+RendererGroup::RendererGroup(RendererOptions options, uint32_t device_count)
+  : options(std::move(options)), device_count(device_count) {
+    if (device_count == 0) {
+        throw std::invalid_argument("At least one device is required");
+    }
+    if (!this->options.headless) {
+        throw std::invalid_argument("Multi-GPU rendering is headless only");
+    }
+}
+
+void RendererGroup::run() {
+    // one worker per core for all of them, each render thread helps out
+    // with its own frame work while it waits
+    auto scheduler = options.scheduler ? options.scheduler : std::make_shared<TaskScheduler>();
+
+    std::mutex sink_mutex;
+    const auto sink = options.readback_sink;
+
+    std::vector<std::exception_ptr> errors(device_count);
+    std::vector<std::thread> threads;
+
+    for (uint32_t i = 0; i < device_count; i++) {
+        // more devices than frames, the extra ones would render forever
+        if (options.frame_count != 0 && i >= options.frame_count) break;
+
+        RendererOptions device_options = options;
+        device_options.device_rank = i;
+        device_options.frame_offset = options.frame_offset + i * options.frame_stride;
+        device_options.frame_stride = options.frame_stride * device_count;
+        if (options.frame_count != 0) {
+            device_options.frame_count = (options.frame_count - i + device_count - 1) / device_count;
+        }
+        device_options.scheduler = scheduler;
+
+        if (sink) {
+            device_options.readback_sink = [&sink_mutex, &sink](ReadbackFrame const &frame) {
+                std::lock_guard lock(sink_mutex);
+                sink(frame);
+            };
+        }
+
+        threads.emplace_back([&errors, i, device_options = std::move(device_options)]() mutable {
+            try {
+                Renderer renderer(std::move(device_options));
+                renderer.run();
+            } catch (...) {
+                errors[i] = std::current_exception();
+            }
+        });
+    }
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+
+    for (auto const &error : errors) {
+        if (error) std::rethrow_exception(error);
+    }
+}
@@ -0,0 +1,46 @@
+#include "ResolutionScaler.h"
+#include <algorithm>
+#include <cmath>
+
+// ----- PUBLIC
+ResolutionScaler::ResolutionScaler(double target_ms, float min_scale, uint32_t settle_frames)
+    : target_ms(target_ms),
+      min_scale(std::clamp(min_scale, RENDER_SCALE_STEP, 1.0f)),
+      settle_frames(settle_frames) {}
+
+bool ResolutionScaler::update(double gpu_ms) {
+    if (skip > 0) {
+        skip--;
+        return false;
+    }
+
+    filtered_ms = filtered_valid ? filtered_ms + RENDER_SCALE_SMOOTHING * (gpu_ms - filtered_ms) : gpu_ms;
+    filtered_valid = true;
+
+    // sharpening right at the target would only push it back over
+    if (filtered_ms <= target_ms && filtered_ms > target_ms * RENDER_SCALE_RAISE_HEADROOM) return false;
+
+    auto wanted = current * static_cast<float>(std::sqrt(target_ms / std::max(filtered_ms, 1e-3)));
+    wanted = std::clamp(wanted, min_scale, 1.0f);
+
+    // rounded down to a whole step, the small bias keeps exact steps
+    // from falling to the one below
+    auto next = std::floor(wanted / RENDER_SCALE_STEP + 1e-3f) * RENDER_SCALE_STEP;
+    next = std::clamp(next, min_scale, 1.0f);
+    if (next > current) next = std::min(next, current + RENDER_SCALE_STEP);
+
+    if (std::abs(next - current) < RENDER_SCALE_STEP * 0.5f) return false;
+
+    current = next;
+    skip = settle_frames;
+    filtered_valid = false;
+
+    return true;
+}
+
+vk::Extent2D ResolutionScaler::apply(vk::Extent2D full) const {
+    return {
+        std::max(static_cast<uint32_t>(std::lround(full.width * current)), 1u),
+        std::max(static_cast<uint32_t>(std::lround(full.height * current)), 1u)
+    };
+}
@@ -0,0 +1,68 @@
+#include "RingBuffer.h"
+#include <algorithm>
+#include <cassert>
+#include <cstring>
+
+// ----- PUBLIC
+FrameRingBuffer::FrameRingBuffer(
+    GpuAllocator &allocator,
+    vk::PhysicalDeviceLimits const &limits,
+    uint32_t frame_count,
+    vk::DeviceSize frame_size
+) {
+    // every slice can be bound as a uniform or storage buffer
+    min_alignment = std::max({
+        limits.minUniformBufferOffsetAlignment,
+        limits.minStorageBufferOffsetAlignment,
+        vk::DeviceSize(16)
+    });
+
+    // keep each region start aligned so slice offsets stay aligned too
+    this->frame_size = (frame_size + min_alignment - 1) / min_alignment * min_alignment;
+
+    vk::BufferCreateInfo buffer_info = {
+        .size        = this->frame_size * frame_count,
+        .usage       = vk::BufferUsageFlagBits::eUniformBuffer |
+                       vk::BufferUsageFlagBits::eStorageBuffer |
+                       vk::BufferUsageFlagBits::eVertexBuffer |
+                       vk::BufferUsageFlagBits::eIndexBuffer |
+                       vk::BufferUsageFlagBits::eIndirectBuffer |
+                       vk::BufferUsageFlagBits::eTransferSrc,
+        .sharingMode = vk::SharingMode::eExclusive
+    };
+
+    storage = allocator.createBuffer(buffer_info, MemoryUsage::eUpload);
+    assert(storage.allocation.mapped);
+}
+
+void FrameRingBuffer::beginFrame(uint32_t frame) {
+    frame_begin = frame * frame_size;
+    head = frame_begin;
+}
+
+std::optional<GpuBufferSlice> FrameRingBuffer::allocate(vk::DeviceSize size, vk::DeviceSize alignment) {
+    alignment = std::max(alignment, min_alignment);
+
+    const auto offset = (head + alignment - 1) / alignment * alignment;
+
+    if (offset + size > frame_begin + frame_size) return std::nullopt;
+
+    head = offset + size;
+
+    return GpuBufferSlice {
+        .buffer = *storage,
+        .offset = offset,
+        .size   = size,
+        .mapped = static_cast<char *>(storage.allocation.mapped) + offset
+    };
+}
+
+std::optional<GpuBufferSlice> FrameRingBuffer::write(const void *data, vk::DeviceSize size, vk::DeviceSize alignment) {
+    auto slice = allocate(size, alignment);
+
+    if (slice) {
+        memcpy(slice->mapped, data, size);
+    }
+
+    return slice;
+}
@@ -0,0 +1,84 @@
+#include "ShaderPermutation.h"
+#include <utility>
+
+// ----- SHADER PERMUTATION
+ShaderPermutation &ShaderPermutation::set(ShaderFeature feature, bool enabled) {
+    if (enabled) {
+        features |= static_cast<uint32_t>(feature);
+    } else {
+        features &= ~static_cast<uint32_t>(feature);
+    }
+    return *this;
+}
+
+uint64_t ShaderPermutation::hash() const {
+    // FNV-1a over the fields, the cache compares permutations on a match
+    const std::array<uint32_t, 2> fields = {features, static_cast<uint32_t>(color_format)};
+    uint64_t hash = 0xcbf29ce484222325ull;
+
+    for (auto field : fields) {
+        for (uint32_t i = 0; i < sizeof(field); i++) {
+            hash ^= (field >> (i * 8)) & 0xff;
+            hash *= 0x100000001b3ull;
+        }
+    }
+
+    return hash;
+}
+
+
+// ----- SPECIALIZATION CONSTANTS
+SpecializationConstants::SpecializationConstants(ShaderPermutation const &permutation) {
+    const std::array<std::pair<ShaderConstant, ShaderFeature>, 3> constants = {{
+        {ShaderConstant::eTextured,  ShaderFeature::eTextured},
+        {ShaderConstant::eAlphaTest, ShaderFeature::eAlphaTest},
+        {ShaderConstant::eLit,       ShaderFeature::eLit}
+    }};
+
+    for (uint32_t i = 0; i < constants.size(); i++) {
+        values[i] = permutation.has(constants[i].second) ? vk::True : vk::False;
+        entries[i] = {
+            .constantID = static_cast<uint32_t>(constants[i].first),
+            .offset     = static_cast<uint32_t>(i * sizeof(vk::Bool32)),
+            .size       = sizeof(vk::Bool32)
+        };
+    }
+
+    info = {
+        .mapEntryCount = static_cast<uint32_t>(entries.size()),
+        .pMapEntries   = entries.data(),
+        .dataSize      = sizeof(values),
+        .pData         = values.data()
+    };
+}
+
+
+// ----- PERMUTATION CACHE
+PermutationCache::PermutationCache(PipelineBuilder &pipeline_builder, PermutationRecipe make_recipe)
+  : pipeline_builder(pipeline_builder), make_recipe(std::move(make_recipe)) {}
+
+PipelineHandle PermutationCache::get(ShaderPermutation const &permutation) {
+    auto &variant = variants[permutation.hash()];
+
+    // a colliding permutation simply takes the slot over
+    if (variant.pipeline.empty() || variant.pipeline.failed() || variant.permutation != permutation) {
+        variant = {
+            .permutation = permutation,
+            .pipeline    = pipeline_builder.build(make_recipe(permutation))
+        };
+    }
+
+    return variant.pipeline;
+}
+
+std::vector<PipelineHandle> PermutationCache::clear() {
+    std::vector<PipelineHandle> retired;
+    retired.reserve(variants.size());
+
+    for (auto &[hash, variant] : variants) {
+        retired.push_back(std::move(variant.pipeline));
+    }
+    variants.clear();
+
+    return retired;
+}
@@ -0,0 +1,216 @@
+#include "ShaderReloader.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cerrno>
+#include <fstream>
+#include <iostream>
+#include <regex>
+#include <system_error>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <spawn.h>
+#include <sys/wait.h>
+extern char **environ;
+#endif
+
+// ----- HELPER FUNCTIONS
+// entry points follow the <name>Main convention, collected like CMake does
+std::vector<std::string> findEntryPoints(std::filesystem::path const &source) {
+    static const std::regex pattern("([A-Za-z0-9_]+Main)[ \t]*\\(");
+
+    std::ifstream file(source);
+    std::vector<std::string> entry_points;
+    std::string line;
+    std::smatch match;
+
+    while (std::getline(file, line)) {
+        if (!std::regex_search(line, match, pattern)) continue;
+
+        auto name = match[1].str();
+        if (std::ranges::find(entry_points, name) == entry_points.end()) {
+            entry_points.push_back(std::move(name));
+        }
+    }
+
+    return entry_points;
+}
+
+// runs `args[0]` with `args` and waits for it, true when it exited with 0.
+// No shell is involved, so paths need no quoting and signal handling of the
+// rest of the process is left alone
+bool runProcess(std::vector<std::string> const &args) {
+    std::vector<char *> argv;
+    for (auto const &arg : args) argv.push_back(const_cast<char *>(arg.c_str()));
+    argv.push_back(nullptr);
+
+#ifdef _WIN32
+    return _spawnv(_P_WAIT, argv[0], argv.data()) == 0;
+#else
+    pid_t pid;
+    if (posix_spawn(&pid, argv[0], nullptr, nullptr, argv.data(), environ) != 0) return false;
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0) {
+        if (errno != EINTR) return false;
+    }
+
+    return WIFEXITED(status) && WEXITSTATUS(status) == 0;
+#endif
+}
+
+std::filesystem::path tmpPath(std::filesystem::path path) {
+    path += ".tmp";
+    return path;
+}
+
+
+// ----- PUBLIC
+ShaderReloader::ShaderReloader(
+    ShaderLibrary &library,
+    std::filesystem::path source_dir,
+    std::filesystem::path output_dir,
+    std::string compiler
+) : library(library),
+    source_dir(std::move(source_dir)),
+    output_dir(std::move(output_dir)),
+    compiler(std::move(compiler)),
+    last_scan(std::chrono::steady_clock::now()) {
+    // the build compiled whatever is there now
+    compiled_from = newestSource();
+}
+
+ShaderReloader::~ShaderReloader() {
+    if (compile_thread.joinable()) compile_thread.join();
+}
+
+bool ShaderReloader::poll() {
+    if (reloaded.exchange(false, std::memory_order_acquire)) return true;
+
+    const auto now = std::chrono::steady_clock::now();
+    if (std::chrono::duration<double>(now - last_scan).count() < SHADER_RELOAD_INTERVAL) return false;
+    last_scan = now;
+
+    // edits made during a compile are picked up by the next scan
+    if (compiling.load(std::memory_order_acquire)) return false;
+
+    const auto newest = newestSource();
+    if (newest <= compiled_from) return false;
+
+    // a failed compile is not retried until the sources change again
+    compiled_from = newest;
+    if (compile_thread.joinable()) compile_thread.join();
+
+    compiling.store(true, std::memory_order_relaxed);
+    compile_thread = std::thread([this] {
+        cpuTraceThreadName("shader compile");
+        compile();
+        compiling.store(false, std::memory_order_release);
+    });
+
+    return false;
+}
+
+
+// ----- PRIVATE
+std::filesystem::file_time_type ShaderReloader::newestSource() const {
+    auto newest = std::filesystem::file_time_type::min();
+
+    // editors replace files while saving, anything that vanishes mid scan
+    // is caught on the next one
+    std::error_code error;
+    for (auto const &entry : std::filesystem::directory_iterator(source_dir, error)) {
+        if (entry.path().extension() != ".slang") continue;
+
+        const auto write_time = entry.last_write_time(error);
+        if (!error) newest = std::max(newest, write_time);
+    }
+
+    return newest;
+}
+
+std::vector<ShaderReloader::Module> ShaderReloader::findModules() const {
+    std::vector<Module> modules;
+
+    std::error_code error;
+    for (auto const &entry : std::filesystem::directory_iterator(source_dir, error)) {
+        if (entry.path().extension() != ".slang") continue;
+
+        auto entry_points = findEntryPoints(entry.path());
+        if (entry_points.empty()) continue;
+
+        auto output = output_dir / entry.path().stem();
+        output += ".spv";
+
+        modules.push_back({
+            .source       = entry.path(),
+            .output       = std::move(output),
+            .entry_points = std::move(entry_points)
+        });
+    }
+
+    return modules;
+}
+
+void ShaderReloader::compile() {
+    CpuScope scope("compile shaders");
+
+    std::vector<Module> modules;
+
+    // outputs of a set that did not make it in are never left behind
+    auto remove_outputs = [&modules] {
+        std::error_code error;
+        for (auto const &module : modules) std::filesystem::remove(tmpPath(module.output), error);
+    };
+
+    try {
+        modules = findModules();
+
+        // same flags as add_slang_shader_target, slangc prints its own
+        // errors to our stderr
+        for (auto const &module : modules) {
+            std::vector<std::string> args = {
+                compiler,
+                module.source.string(),
+                "-target", "spirv",
+                "-profile", "spirv_1_4+spvRayQueryKHR",
+                "-emit-spirv-directly",
+                "-fvk-use-entrypoint-name"
+            };
+            for (auto const &entry_point : module.entry_points) {
+                args.push_back("-entry");
+                args.push_back(entry_point);
+            }
+            args.push_back("-o");
+            args.push_back(tmpPath(module.output).string());
+
+            if (!runProcess(args)) {
+                std::cerr
+                    << "Shader reload: " << module.source.filename().string()
+                    << " failed to compile, keeping the current shaders" << std::endl;
+                remove_outputs();
+                return;
+            }
+        }
+
+        // everything compiled, swap the whole set in. The build output is
+        // replaced as well so the next launch starts from the edit
+        for (auto const &module : modules) {
+            const auto tmp_path = tmpPath(module.output);
+
+            auto code = std::make_shared<const std::vector<char>>(readFile(tmp_path.string()));
+
+            std::error_code error;
+            std::filesystem::rename(tmp_path, module.output, error);
+
+            library.replace(module.output.generic_string(), std::move(code));
+        }
+
+        std::cerr << "Shader reload: " << modules.size() << " modules compiled" << std::endl;
+        reloaded.store(true, std::memory_order_release);
+    } catch (std::exception const &e) {
+        std::cerr << "Shader reload failed: " << e.what() << std::endl;
+        remove_outputs();
+    }
+}
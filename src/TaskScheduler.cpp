@@ -0,0 +1,207 @@
+#include "TaskScheduler.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+
+// ----- HELPER FUNCTIONS
+// set on worker threads only, identifies both the scheduler and the worker
+struct WorkerIdentity {
+    TaskScheduler const *scheduler = nullptr;
+    uint32_t index = 0;
+};
+
+thread_local WorkerIdentity worker_identity;
+
+
+// ----- PUBLIC
+TaskScheduler::TaskScheduler(uint32_t thread_count) {
+    if (thread_count == 0) {
+        thread_count = std::max(std::thread::hardware_concurrency(), 2u) - 1;
+    }
+
+    for (uint32_t i = 0; i <= thread_count; i++) {
+        queues.push_back(std::make_unique<Queue>());
+    }
+
+    for (uint32_t i = 0; i < thread_count; i++) {
+        threads.emplace_back(&TaskScheduler::workerLoop, this, i);
+    }
+}
+
+TaskScheduler::~TaskScheduler() {
+    {
+        std::lock_guard lock(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+
+    for (auto &thread : threads) {
+        thread.join();
+    }
+}
+
+void TaskScheduler::submit(
+    Task task,
+    TaskCounterPtr signal,
+    TaskPriority priority,
+    TaskCounterPtr after
+) {
+    // counted straight away so waiting on `signal` covers held back tasks
+    if (signal) signal->pending.fetch_add(1, std::memory_order_relaxed);
+
+    if (after) {
+        std::lock_guard lock(after->mutex);
+
+        // the finishing task drains continuations under the same lock, so
+        // anything appended before it gets there still runs
+        if (!after->done()) {
+            after->continuations.push_back({std::move(task), std::move(signal), priority});
+            return;
+        }
+    }
+
+    push({std::move(task), std::move(signal), priority});
+}
+
+void TaskScheduler::wait(TaskCounterPtr const &counter) {
+    const auto self = workerIndex();
+    const bool take_low = self != threadCount();
+
+    while (!counter->done()) {
+        if (auto job = pop(self, take_low)) {
+            run(*job);
+            continue;
+        }
+
+        // other threads park until the counter finishes, the workers run
+        // what is left. Workers keep polling, if they all parked nothing
+        // would run the tasks they wait on
+        if (take_low) {
+            std::this_thread::yield();
+            continue;
+        }
+
+        const auto pending = counter->pending.load(std::memory_order_acquire);
+        if (pending != 0) counter->pending.wait(pending, std::memory_order_acquire);
+    }
+}
+
+void TaskScheduler::parallelFor(
+    uint32_t count,
+    uint32_t grain,
+    std::function<void(uint32_t, uint32_t)> const &body
+) {
+    grain = std::max(grain, 1u);
+
+    // a single range is not worth a round trip through the queues
+    if (count <= grain) {
+        if (count > 0) body(0, count);
+        return;
+    }
+
+    auto done = std::make_shared<TaskCounter>();
+    for (uint32_t begin = grain; begin < count; begin += grain) {
+        const auto end = std::min(begin + grain, count);
+        submit([&body, begin, end] { body(begin, end); }, done, TaskPriority::eHigh);
+    }
+
+    // the first range runs here while the workers pick up the rest
+    body(0, grain);
+    wait(done);
+}
+
+uint32_t TaskScheduler::workerIndex() const {
+    return worker_identity.scheduler == this ? worker_identity.index : threadCount();
+}
+
+
+// ----- PRIVATE
+void TaskScheduler::push(Job job) {
+    // counted before it can be popped, or a thief could take it first and
+    // wrap the count
+    {
+        std::lock_guard lock(sleep_mutex);
+        queued.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    {
+        auto &queue = *queues[workerIndex()];
+        std::lock_guard lock(queue.mutex);
+
+        auto &deque = job.priority == TaskPriority::eHigh ? queue.high : queue.low;
+        deque.push_back(std::move(job));
+    }
+    sleep_cv.notify_one();
+}
+
+std::optional<TaskScheduler::Job> TaskScheduler::pop(uint32_t self, bool take_low) {
+    const auto count = static_cast<uint32_t>(queues.size());
+
+    auto take = [&](std::deque<Job> &deque, bool own) -> std::optional<Job> {
+        if (deque.empty()) return std::nullopt;
+
+        // owners work oldest first, thieves take the newest so they contend
+        // with the owner as little as possible
+        Job job = own ? std::move(deque.front()) : std::move(deque.back());
+        own ? deque.pop_front() : deque.pop_back();
+
+        queued.fetch_sub(1, std::memory_order_relaxed);
+        return job;
+    };
+
+    // every high priority task anywhere comes before any low priority one
+    for (bool high : {true, false}) {
+        if (!high && !take_low) break;
+
+        for (uint32_t i = 0; i < count; i++) {
+            const auto victim = (self + i) % count;
+            auto &queue = *queues[victim];
+
+            std::lock_guard lock(queue.mutex);
+            if (auto job = take(high ? queue.high : queue.low, victim == self)) {
+                return job;
+            }
+        }
+    }
+
+    return std::nullopt;
+}
+
+void TaskScheduler::run(Job &job) {
+    job.task();
+    job.task = nullptr;
+
+    if (!job.signal) return;
+
+    if (job.signal->pending.fetch_sub(1, std::memory_order_acq_rel) != 1) return;
+    job.signal->pending.notify_all();
+
+    std::vector<TaskCounter::Continuation> ready;
+    {
+        std::lock_guard lock(job.signal->mutex);
+        ready.swap(job.signal->continuations);
+    }
+
+    for (auto &continuation : ready) {
+        push({std::move(continuation.task), std::move(continuation.signal), continuation.priority});
+    }
+}
+
+void TaskScheduler::workerLoop(uint32_t index) {
+    worker_identity = {this, index};
+    cpuTraceThreadName("worker");
+
+    while (true) {
+        if (auto job = pop(index, true)) {
+            run(*job);
+            continue;
+        }
+
+        std::unique_lock lock(sleep_mutex);
+        sleep_cv.wait(lock, [this] {
+            return stopping || queued.load(std::memory_order_relaxed) > 0;
+        });
+
+        // queued work is finished before shutting down
+        if (stopping && queued.load(std::memory_order_relaxed) == 0) return;
+    }
+}
@@ -0,0 +1,354 @@
+#include "TextureLoader.h"
+#include "CpuProfiler.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <ktx.h>
+
+// ----- HELPER FUNCTIONS
+bool canSample(vk::raii::PhysicalDevice const &physical_device, vk::Format format) {
+    const auto features = physical_device.getFormatProperties(format).optimalTilingFeatures;
+    const auto required = vk::FormatFeatureFlagBits::eSampledImage | vk::FormatFeatureFlagBits::eTransferDst;
+
+    return (features & required) == required;
+}
+
+ktx_transcode_fmt_e transcodeFormat(TextureTarget target) {
+    switch (target) {
+        case TextureTarget::eBC7:     return KTX_TTF_BC7_RGBA;
+        case TextureTarget::eASTC4x4: return KTX_TTF_ASTC_4x4_RGBA;
+        case TextureTarget::eETC2:    return KTX_TTF_ETC2_RGBA;
+        default:                      return KTX_TTF_RGBA32;
+    }
+}
+
+vk::ImageViewType viewType(ktxTexture2 const *ktx) {
+    if (ktx->numDimensions == 3) return vk::ImageViewType::e3D;
+    if (ktx->isCubemap) return ktx->isArray ? vk::ImageViewType::eCubeArray : vk::ImageViewType::eCube;
+    if (ktx->numDimensions == 1) return ktx->isArray ? vk::ImageViewType::e1DArray : vk::ImageViewType::e1D;
+
+    return ktx->isArray ? vk::ImageViewType::e2DArray : vk::ImageViewType::e2D;
+}
+
+vk::Extent3D mipExtent(vk::Extent3D extent, uint32_t level) {
+    return {
+        std::max(extent.width >> level, 1u),
+        std::max(extent.height >> level, 1u),
+        std::max(extent.depth >> level, 1u)
+    };
+}
+
+// owns a libktx texture for the length of a scope
+struct KtxTexture {
+    ktxTexture2 *ktx = nullptr;
+
+    ~KtxTexture() {
+        if (ktx) ktxTexture_Destroy(ktxTexture(ktx));
+    }
+};
+
+
+// ----- TEXTURE
+Texture::~Texture() {
+    if (!bindless) return;
+
+    for (auto slot : bindless_slots) {
+        bindless->release(BindlessKind::eImage, slot);
+    }
+}
+
+vk::ImageView Texture::view() const {
+    const auto mip = resident_mip.load(std::memory_order_acquire);
+
+    return mip == TEXTURE_NOT_RESIDENT ? vk::ImageView{} : *views[mip];
+}
+
+uint32_t Texture::bindlessIndex() const {
+    const auto mip = resident_mip.load(std::memory_order_acquire);
+
+    return mip == TEXTURE_NOT_RESIDENT ? BINDLESS_NONE : bindless_slots[mip];
+}
+
+
+// ----- PUBLIC
+TextureLoader::TextureLoader(
+    vk::raii::PhysicalDevice const &physical_device,
+    vk::PhysicalDeviceFeatures const &enabled_features,
+    vk::raii::Device const &device,
+    GpuAllocator &allocator,
+    UploadQueue &upload_queue,
+    TaskScheduler &scheduler,
+    BindlessTable &bindless
+) : device(device),
+    allocator(allocator),
+    upload_queue(upload_queue),
+    scheduler(scheduler),
+    bindless(bindless),
+    contexts(device, upload_queue) {
+    // smallest block format first, both colour spaces have to sample since
+    // the file decides which one it wants
+    auto supported = [&](vk::Format unorm, vk::Format srgb) {
+        return canSample(physical_device, unorm) && canSample(physical_device, srgb);
+    };
+
+    if (enabled_features.textureCompressionBC &&
+        supported(vk::Format::eBc7UnormBlock, vk::Format::eBc7SrgbBlock)) {
+        transcode_target = TextureTarget::eBC7;
+    } else if (enabled_features.textureCompressionASTC_LDR &&
+        supported(vk::Format::eAstc4x4UnormBlock, vk::Format::eAstc4x4SrgbBlock)) {
+        transcode_target = TextureTarget::eASTC4x4;
+    } else if (enabled_features.textureCompressionETC2 &&
+        supported(vk::Format::eEtc2R8G8B8A8UnormBlock, vk::Format::eEtc2R8G8B8A8SrgbBlock)) {
+        transcode_target = TextureTarget::eETC2;
+    }
+}
+
+TextureLoader::~TextureLoader() {
+    stopping.store(true, std::memory_order_relaxed);
+    scheduler.wait(outstanding);
+}
+
+TextureHandle TextureLoader::load(std::filesystem::path path) {
+    auto texture = std::make_shared<Texture>();
+    texture->path = std::move(path);
+
+    {
+        std::lock_guard lock(mutex);
+        pending.push_back(texture);
+    }
+    scheduler.submit([this] { runStep(); }, outstanding);
+
+    return texture;
+}
+
+
+// ----- PRIVATE
+void TextureLoader::runStep() {
+    TextureHandle texture;
+    StreamJob job;
+
+    {
+        std::lock_guard lock(mutex);
+
+        // new textures go first so their coarse mips are not stuck
+        // behind the fine mips of older ones
+        if (!pending.empty()) {
+            texture = std::move(pending.front());
+            pending.pop_front();
+        } else {
+            job = std::move(streaming.front());
+            streaming.pop_front();
+            texture = job.texture;
+        }
+    }
+
+    if (stopping.load(std::memory_order_relaxed)) {
+        texture->error = "Texture loader shut down before streaming finished";
+        texture->state.store(TextureState::eFailed, std::memory_order_release);
+        return;
+    }
+
+    auto context = contexts.acquire();
+
+    try {
+        CpuScope scope("stream texture");
+        if (!job.texture) {
+            job = prepare(texture);
+        }
+
+        streamStep(job, *context);
+    } catch (const std::exception &e) {
+        texture->error = e.what();
+        texture->state.store(TextureState::eFailed, std::memory_order_release);
+        job.next_mip = 0;
+    }
+
+    contexts.release(std::move(context));
+
+    // back of the line, every other texture gets a step before this one
+    if (job.next_mip > 0) {
+        {
+            std::lock_guard lock(mutex);
+            streaming.push_back(std::move(job));
+        }
+        scheduler.submit([this] { runStep(); }, outstanding);
+    }
+}
+
+TextureLoader::StreamJob TextureLoader::prepare(TextureHandle const &texture) {
+    KtxTexture file;
+    auto result = ktxTexture2_CreateFromNamedFile(
+        texture->path.string().c_str(),
+        KTX_TEXTURE_CREATE_LOAD_IMAGE_DATA_BIT,
+        &file.ktx
+    );
+    if (result != KTX_SUCCESS) {
+        throw std::runtime_error("Failed to open texture " + texture->path.string() + ": " + ktxErrorString(result));
+    }
+
+    auto *ktx = file.ktx;
+
+    if (ktxTexture2_NeedsTranscoding(ktx)) {
+        result = ktxTexture2_TranscodeBasis(ktx, transcodeFormat(transcode_target), 0);
+        if (result != KTX_SUCCESS) {
+            throw std::runtime_error("Failed to transcode texture " + texture->path.string() + ": " + ktxErrorString(result));
+        }
+    }
+
+    const auto format = static_cast<vk::Format>(ktxTexture2_GetVkFormat(ktx));
+    if (format == vk::Format::eUndefined) {
+        throw std::runtime_error("Texture has no Vulkan format: " + texture->path.string());
+    }
+
+    const uint32_t layers = ktx->numLayers * ktx->numFaces;
+
+    texture->format = format;
+    texture->extent = vk::Extent3D{ktx->baseWidth, ktx->baseHeight, ktx->baseDepth};
+    texture->mip_levels = ktx->numLevels;
+    texture->layers = layers;
+
+    texture->image = allocator.createImage({
+        .flags         = ktx->isCubemap ? vk::ImageCreateFlagBits::eCubeCompatible : vk::ImageCreateFlags{},
+        .imageType     = ktx->numDimensions == 3 ? vk::ImageType::e3D :
+                         ktx->numDimensions == 1 ? vk::ImageType::e1D : vk::ImageType::e2D,
+        .format        = format,
+        .extent        = texture->extent,
+        .mipLevels     = texture->mip_levels,
+        .arrayLayers   = layers,
+        .samples       = vk::SampleCountFlagBits::e1,
+        .tiling        = vk::ImageTiling::eOptimal,
+        .usage         = vk::ImageUsageFlagBits::eSampled | vk::ImageUsageFlagBits::eTransferDst,
+        .sharingMode   = vk::SharingMode::eExclusive,
+        .initialLayout = vk::ImageLayout::eUndefined
+    }, MemoryUsage::eGpuOnly);
+
+    // the view set is fixed up front, streaming only moves resident_mip
+    const auto view_type = viewType(ktx);
+    texture->views.reserve(texture->mip_levels);
+    for (uint32_t mip = 0; mip < texture->mip_levels; mip++) {
+        texture->views.emplace_back(device, vk::ImageViewCreateInfo{
+            .image            = *texture->image,
+            .viewType         = view_type,
+            .format           = format,
+            .subresourceRange = {vk::ImageAspectFlagBits::eColor, mip, vk::RemainingMipLevels, 0, layers}
+        });
+    }
+
+    // published along with resident_mip, the render thread only reads the
+    // slot of a mip that has arrived
+    texture->bindless = &bindless;
+    texture->bindless_slots.reserve(texture->mip_levels);
+    for (auto const &view : texture->views) {
+        const auto slot = bindless.addImage(*view);
+        if (slot == BINDLESS_NONE) {
+            throw std::runtime_error("Bindless table is out of image slots");
+        }
+        texture->bindless_slots.push_back(slot);
+    }
+
+    // the whole payload goes to staging once, then libktx can let go of it
+    const auto data_size = ktxTexture_GetDataSize(ktxTexture(ktx));
+    auto staging = std::make_shared<GpuBuffer>(allocator.createBuffer({
+        .size        = data_size,
+        .usage       = vk::BufferUsageFlagBits::eTransferSrc,
+        .sharingMode = vk::SharingMode::eExclusive
+    }, MemoryUsage::eUpload));
+    memcpy(staging->allocation.mapped, ktxTexture_GetData(ktxTexture(ktx)), data_size);
+
+    StreamJob job = {
+        .texture  = texture,
+        .staging  = std::move(staging),
+        .next_mip = texture->mip_levels
+    };
+
+    // every layer and face of a level sit back to back from layer 0
+    job.mips.reserve(texture->mip_levels);
+    for (uint32_t mip = 0; mip < texture->mip_levels; mip++) {
+        ktx_size_t offset = 0;
+        ktxTexture_GetImageOffset(ktxTexture(ktx), mip, 0, 0, &offset);
+
+        job.mips.push_back({offset, mipExtent(texture->extent, mip)});
+    }
+
+    return job;
+}
+
+void TextureLoader::streamStep(StreamJob &job, UploadContext &context) {
+    auto &texture = job.texture;
+
+    // the first step takes the whole mip tail, the rest go one level at a time
+    uint32_t first = job.next_mip - 1;
+    if (job.next_mip == texture->mip_levels) {
+        while (first > 0) {
+            const auto extent = job.mips[first - 1].extent;
+            if (std::max(extent.width, extent.height) > TEXTURE_TAIL_SIZE) break;
+            first--;
+        }
+    }
+    const uint32_t count = job.next_mip - first;
+
+    const vk::ImageSubresourceRange range = {
+        vk::ImageAspectFlagBits::eColor, first, count, 0, texture->layers
+    };
+
+    auto cmd = context.begin(device);
+
+    const vk::ImageMemoryBarrier2 to_transfer = {
+        .srcStageMask        = vk::PipelineStageFlagBits2::eNone,
+        .srcAccessMask       = vk::AccessFlagBits2::eNone,
+        .dstStageMask        = vk::PipelineStageFlagBits2::eCopy,
+        .dstAccessMask       = vk::AccessFlagBits2::eTransferWrite,
+        .oldLayout           = vk::ImageLayout::eUndefined,
+        .newLayout           = vk::ImageLayout::eTransferDstOptimal,
+        .srcQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .dstQueueFamilyIndex = vk::QueueFamilyIgnored,
+        .image               = *texture->image,
+        .subresourceRange    = range
+    };
+    cmd.pipelineBarrier2({
+        .imageMemoryBarrierCount = 1,
+        .pImageMemoryBarriers    = &to_transfer
+    });
+
+    std::vector<vk::BufferImageCopy> regions;
+    regions.reserve(count);
+    for (uint32_t mip = first; mip < job.next_mip; mip++) {
+        regions.push_back({
+            .bufferOffset      = job.mips[mip].offset,
+            .bufferRowLength   = 0,
+            .bufferImageHeight = 0,
+            .imageSubresource  = {vk::ImageAspectFlagBits::eColor, mip, 0, texture->layers},
+            .imageOffset       = {0, 0, 0},
+            .imageExtent       = job.mips[mip].extent
+        });
+    }
+    cmd.copyBufferToImage(*job.staging, *texture->image, vk::ImageLayout::eTransferDstOptimal, regions);
+
+    UploadRelease release = {
+        .images = {
+            ImageOwnershipTransfer {
+                .image      = *texture->image,
+                .range      = range,
+                .old_layout = vk::ImageLayout::eTransferDstOptimal,
+                .new_layout = vk::ImageLayout::eShaderReadOnlyOptimal,
+                .src_stage  = vk::PipelineStageFlagBits2::eCopy,
+                .src_access = vk::AccessFlagBits2::eTransferWrite,
+                .dst_stage  = vk::PipelineStageFlagBits2::eFragmentShader |
+                              vk::PipelineStageFlagBits2::eComputeShader,
+                .dst_access = vk::AccessFlagBits2::eShaderSampledRead
+            }
+        },
+        .on_acquired = [texture, first] {
+            texture->resident_mip.store(first, std::memory_order_release);
+            texture->state.store(
+                first == 0 ? TextureState::eReady : TextureState::eStreaming,
+                std::memory_order_release
+            );
+        }
+    };
+
+    auto value = upload_queue.submit(cmd, std::move(release));
+    job.next_mip = first;
+
+    context.in_flight.push_back({std::move(cmd), job.staging, value});
+}
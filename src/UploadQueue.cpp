@@ -0,0 +1,166 @@
+#include "UploadQueue.h"
+#include <algorithm>
+#include <stdexcept>
+
+// ----- PUBLIC
+UploadQueue::UploadQueue(
+    vk::raii::Device const &device,
+    vk::raii::Queue const &queue,
+    uint32_t family,
+    uint32_t graphics_family,
+    std::mutex &queue_mutex
+) : device(device),
+    queue(queue),
+    transfer_family(family),
+    graphics_family(graphics_family),
+    queue_mutex(queue_mutex) {
+    vk::SemaphoreTypeCreateInfo timeline_info = {
+        .semaphoreType = vk::SemaphoreType::eTimeline,
+        .initialValue  = 0
+    };
+
+    upload_timeline = vk::raii::Semaphore(device, {.pNext = &timeline_info});
+}
+
+uint64_t UploadQueue::submit(vk::raii::CommandBuffer const &cmd, UploadRelease release) {
+    for (auto &buffer : release.buffers) {
+        buffer.src_family = transfer_family;
+        buffer.dst_family = graphics_family;
+        releaseOwnership(cmd, buffer);
+    }
+    for (auto &image : release.images) {
+        image.src_family = transfer_family;
+        image.dst_family = graphics_family;
+        releaseOwnership(cmd, image);
+    }
+
+    cmd.end();
+
+    uint64_t value;
+    {
+        // values are handed out under the lock so they signal in order
+        std::lock_guard lock(queue_mutex);
+        value = ++timeline_value;
+
+        const vk::SemaphoreSubmitInfo signal_info = {
+            .semaphore = *upload_timeline,
+            .value     = value,
+            .stageMask = vk::PipelineStageFlagBits2::eAllCommands
+        };
+        const vk::CommandBufferSubmitInfo command_info = {
+            .commandBuffer = *cmd
+        };
+        const vk::SubmitInfo2 submit_info = {
+            .commandBufferInfoCount   = 1,
+            .pCommandBufferInfos      = &command_info,
+            .signalSemaphoreInfoCount = 1,
+            .pSignalSemaphoreInfos    = &signal_info
+        };
+
+        queue.submit2(submit_info);
+    }
+
+    {
+        std::lock_guard lock(released_mutex);
+        released.push_back({value, std::move(release)});
+    }
+
+    return value;
+}
+
+uint64_t UploadQueue::acquire(vk::raii::CommandBuffer const &cmd) {
+    std::vector<Released> ready;
+    {
+        std::lock_guard lock(released_mutex);
+        ready.swap(released);
+    }
+
+    uint64_t wait_value = 0;
+
+    for (auto &[value, release] : ready) {
+        for (auto const &buffer : release.buffers) acquireOwnership(cmd, buffer);
+        for (auto const &image : release.images) acquireOwnership(cmd, image);
+
+        if (release.on_acquired) release.on_acquired();
+
+        wait_value = std::max(wait_value, value);
+    }
+
+    return wait_value;
+}
+
+uint64_t UploadQueue::completedValue() const {
+    return upload_timeline.getCounterValue();
+}
+
+void UploadQueue::wait(uint64_t value) const {
+    const vk::SemaphoreWaitInfo wait_info = {
+        .semaphoreCount = 1,
+        .pSemaphores    = &*upload_timeline,
+        .pValues        = &value
+    };
+
+    if (device.waitSemaphores(wait_info, UINT64_MAX) != vk::Result::eSuccess) {
+        throw std::runtime_error("Failed to wait for upload timeline");
+    }
+}
+
+
+// ----- UPLOAD CONTEXT
+vk::raii::CommandBuffer UploadContext::begin(vk::raii::Device const &device) const {
+    auto command_buffers = device.allocateCommandBuffers({
+        .commandPool        = *pool,
+        .level              = vk::CommandBufferLevel::ePrimary,
+        .commandBufferCount = 1
+    });
+    auto cmd = std::move(command_buffers.front());
+
+    cmd.begin({.flags = vk::CommandBufferUsageFlagBits::eOneTimeSubmit});
+
+    return cmd;
+}
+
+UploadContextPool::UploadContextPool(vk::raii::Device const &device, UploadQueue &upload_queue)
+    : device(device), upload_queue(upload_queue) {}
+
+UploadContextPool::~UploadContextPool() {
+    uint64_t last = 0;
+    for (auto const &context : contexts) {
+        if (!context->in_flight.empty()) {
+            last = std::max(last, context->in_flight.back().value);
+        }
+    }
+
+    if (last) upload_queue.wait(last);
+}
+
+std::unique_ptr<UploadContext> UploadContextPool::acquire() {
+    std::unique_ptr<UploadContext> context;
+    {
+        std::lock_guard lock(mutex);
+        if (!contexts.empty()) {
+            context = std::move(contexts.back());
+            contexts.pop_back();
+        }
+    }
+
+    if (!context) {
+        context = std::make_unique<UploadContext>();
+        context->pool = vk::raii::CommandPool(device, {
+            .flags            = vk::CommandPoolCreateFlagBits::eTransient,
+            .queueFamilyIndex = upload_queue.family()
+        });
+    }
+
+    const auto completed = upload_queue.completedValue();
+    while (!context->in_flight.empty() && context->in_flight.front().value <= completed) {
+        context->in_flight.pop_front();
+    }
+
+    return context;
+}
+
+void UploadContextPool::release(std::unique_ptr<UploadContext> context) {
+    std::lock_guard lock(mutex);
+    contexts.push_back(std::move(context));
+}
@@ -0,0 +1,402 @@
+#include "Renderer.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <stdexcept>
+#include <string>
+#include <vector>
+#include <glm/gtc/matrix_transform.hpp>
+#include <ktx.h>
+#include <nlohmann/json.hpp>
+
+// ----- CONSTANTS
+constexpr const char *BENCH_ASSET_DIR = "bench_assets";
+constexpr uint32_t BENCH_TEXTURE_SIZE = 64;
+constexpr double BENCH_PI = 3.14159265358979323846;
+
+// ----- HELPER FUNCTIONS
+enum class BenchScene {
+    eTriangles, // one mesh of N triangles
+    eInstances, // N copies of a cube
+    eTextures   // N quads, each with its own texture
+};
+
+const char *sceneName(BenchScene scene) {
+    switch (scene) {
+        case BenchScene::eTriangles: return "triangles";
+        case BenchScene::eInstances: return "instances";
+        case BenchScene::eTextures:  return "textures";
+    }
+    return "unknown";
+}
+
+// the generated assets are kept between runs, written under a temporary name
+// so an interrupted run never leaves half a file behind
+template <typename Write>
+std::filesystem::path cachedAsset(std::string const &name, Write write) {
+    const auto path = std::filesystem::path(BENCH_ASSET_DIR) / name;
+    if (std::filesystem::exists(path)) return path;
+
+    std::filesystem::create_directories(path.parent_path());
+
+    auto partial = path;
+    partial += ".partial";
+    write(partial);
+    std::filesystem::rename(partial, path);
+
+    return path;
+}
+
+std::ofstream openAsset(std::filesystem::path const &path) {
+    std::ofstream file(path, std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Failed to open bench asset: " + path.string());
+    }
+    return file;
+}
+
+// exactly `triangles` triangles in a flat square on the XZ plane facing up,
+// `size` units across
+std::filesystem::path triangleGrid(uint32_t triangles, float size) {
+    return cachedAsset("grid_" + std::to_string(triangles) + ".obj", [&](auto const &path) {
+        const uint32_t quads = (triangles + 1) / 2;
+        const auto side = std::max(static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(quads)))), 1u);
+        const uint32_t rows = (quads + side - 1) / side;
+
+        auto file = openAsset(path);
+
+        for (uint32_t z = 0; z <= rows; z++) {
+            for (uint32_t x = 0; x <= side; x++) {
+                const float u = static_cast<float>(x) / side;
+                const float v = static_cast<float>(z) / std::max(rows, 1u);
+
+                file << "v " << (u - 0.5f) * size << " 0 " << (v - 0.5f) * size * rows / side << "\n";
+                file << "vt " << u << " " << v << "\n";
+            }
+        }
+        file << "vn 0 1 0\n";
+
+        // OBJ counts from one, the positions and uvs share indices
+        auto corner = [&](uint32_t x, uint32_t z) {
+            const auto index = std::to_string(z * (side + 1) + x + 1);
+            return index + "/" + index + "/1";
+        };
+
+        uint32_t written = 0;
+        for (uint32_t quad = 0; quad < quads; quad++) {
+            const uint32_t x = quad % side, z = quad / side;
+
+            file << "f " << corner(x, z) << " " << corner(x, z + 1) << " " << corner(x + 1, z) << "\n";
+            if (++written == triangles) break;
+            file << "f " << corner(x + 1, z) << " " << corner(x, z + 1) << " " << corner(x + 1, z + 1) << "\n";
+            written++;
+        }
+    });
+}
+
+// unit cube, four vertices per face so every face keeps its own normal
+std::filesystem::path cube() {
+    return cachedAsset("cube.obj", [](auto const &path) {
+        // normal and two edges with u x v = normal, so the faces wind
+        // counter clockwise seen from outside like any other OBJ
+        const glm::vec3 faces[6][3] = {
+            {{ 1,  0,  0}, {0, 1, 0}, {0, 0, 1}},
+            {{-1,  0,  0}, {0, 0, 1}, {0, 1, 0}},
+            {{ 0,  1,  0}, {0, 0, 1}, {1, 0, 0}},
+            {{ 0, -1,  0}, {1, 0, 0}, {0, 0, 1}},
+            {{ 0,  0,  1}, {1, 0, 0}, {0, 1, 0}},
+            {{ 0,  0, -1}, {0, 1, 0}, {1, 0, 0}}
+        };
+
+        auto file = openAsset(path);
+        file << "vt 0 0\nvt 1 0\nvt 1 1\nvt 0 1\n";
+
+        for (auto const &[normal, u, v] : faces) {
+            for (auto const &corner : {-u - v, u - v, u + v, v - u}) {
+                const auto position = 0.5f * (normal + corner);
+                file << "v " << position.x << " " << position.y << " " << position.z << "\n";
+            }
+            file << "vn " << normal.x << " " << normal.y << " " << normal.z << "\n";
+        }
+
+        for (uint32_t face = 0; face < 6; face++) {
+            auto corner = [&](uint32_t i) {
+                return std::to_string(face * 4 + i + 1) + "/" + std::to_string(i + 1) + "/" + std::to_string(face + 1);
+            };
+
+            file << "f " << corner(0) << " " << corner(1) << " " << corner(2) << "\n";
+            file << "f " << corner(0) << " " << corner(2) << " " << corner(3) << "\n";
+        }
+    });
+}
+
+// unit square on the XZ plane facing up
+std::filesystem::path quad() {
+    return cachedAsset("quad.obj", [](auto const &path) {
+        auto file = openAsset(path);
+
+        file << "v -0.5 0 -0.5\nv -0.5 0 0.5\nv 0.5 0 -0.5\nv 0.5 0 0.5\n";
+        file << "vt 0 0\nvt 0 1\nvt 1 0\nvt 1 1\n";
+        file << "vn 0 1 0\n";
+        file << "f 1/1/1 2/2/1 3/3/1\n";
+        file << "f 3/3/1 2/2/1 4/4/1\n";
+    });
+}
+
+// RGBA8 checkerboard with a full mip chain, the tint differs per index so
+// no two textures are the same image
+std::filesystem::path checkerTexture(uint32_t index) {
+    return cachedAsset("texture_" + std::to_string(index) + ".ktx2", [&](auto const &path) {
+        ktxTextureCreateInfo info = {};
+        info.vkFormat = static_cast<uint32_t>(vk::Format::eR8G8B8A8Srgb);
+        info.baseWidth = BENCH_TEXTURE_SIZE;
+        info.baseHeight = BENCH_TEXTURE_SIZE;
+        info.baseDepth = 1;
+        info.numDimensions = 2;
+        info.numLevels = static_cast<uint32_t>(std::log2(BENCH_TEXTURE_SIZE)) + 1;
+        info.numLayers = 1;
+        info.numFaces = 1;
+        info.isArray = KTX_FALSE;
+        info.generateMipmaps = KTX_FALSE;
+
+        ktxTexture2 *texture = nullptr;
+        auto result = ktxTexture2_Create(&info, KTX_TEXTURE_CREATE_ALLOC_STORAGE, &texture);
+        if (result != KTX_SUCCESS) {
+            throw std::runtime_error(std::string("Failed to create bench texture: ") + ktxErrorString(result));
+        }
+
+        const auto hue = static_cast<float>(index) * 0.618034f;
+        const uint8_t tint[3] = {
+            static_cast<uint8_t>(127.5f + 127.5f * std::cos(2.0f * BENCH_PI * hue)),
+            static_cast<uint8_t>(127.5f + 127.5f * std::cos(2.0f * BENCH_PI * (hue + 1.0f / 3.0f))),
+            static_cast<uint8_t>(127.5f + 127.5f * std::cos(2.0f * BENCH_PI * (hue + 2.0f / 3.0f)))
+        };
+
+        // every level is drawn at its own size instead of filtered down, the
+        // squares stay eight to a side
+        std::vector<uint8_t> texels;
+        for (uint32_t level = 0; level < info.numLevels && result == KTX_SUCCESS; level++) {
+            const uint32_t size = std::max(BENCH_TEXTURE_SIZE >> level, 1u);
+            const uint32_t square = std::max(size / 8, 1u);
+            texels.resize(size_t(size) * size * 4);
+
+            for (uint32_t y = 0; y < size; y++) {
+                for (uint32_t x = 0; x < size; x++) {
+                    const bool dark = ((x / square) + (y / square)) % 2 == 1;
+                    auto *texel = &texels[(size_t(y) * size + x) * 4];
+
+                    for (int c = 0; c < 3; c++) texel[c] = dark ? tint[c] / 4 : tint[c];
+                    texel[3] = 255;
+                }
+            }
+
+            result = ktxTexture_SetImageFromMemory(ktxTexture(texture), level, 0, 0, texels.data(), texels.size());
+        }
+
+        if (result == KTX_SUCCESS) result = ktxTexture_WriteToNamedFile(ktxTexture(texture), path.string().c_str());
+        ktxTexture_Destroy(ktxTexture(texture));
+
+        if (result != KTX_SUCCESS) {
+            throw std::runtime_error("Failed to write " + path.string() + ": " + ktxErrorString(result));
+        }
+    });
+}
+
+// square grid of `count` objects on the XZ plane, returns how far it reaches
+// from the center
+float placeGrid(RendererOptions &options, std::filesystem::path const &mesh, uint32_t count, float spacing, bool textured) {
+    const auto side = std::max(static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count)))), 1u);
+    const float half = 0.5f * spacing * static_cast<float>(side - 1);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const glm::vec3 position = {
+            static_cast<float>(i % side) * spacing - half,
+            0.0f,
+            static_cast<float>(i / side) * spacing - half
+        };
+        options.scene.push_back({
+            .mesh      = mesh,
+            .transform = glm::translate(glm::mat4(1.0f), position),
+            .texture   = textured ? checkerTexture(i) : std::filesystem::path()
+        });
+    }
+
+    return half + spacing;
+}
+
+// the scene's objects, and the radius the camera orbits them at
+float buildScene(RendererOptions &options, BenchScene scene, uint32_t count) {
+    switch (scene) {
+        case BenchScene::eTriangles:
+            options.scene.push_back({.mesh = triangleGrid(count, 8.0f), .transform = glm::mat4(1.0f)});
+            return 4.0f;
+        case BenchScene::eInstances:
+            return placeGrid(options, cube(), count, 3.0f, false);
+        case BenchScene::eTextures:
+            return placeGrid(options, quad(), count, 1.5f, true);
+    }
+    return 1.0f;
+}
+
+// one full turn over the run, frame `frame` always sees the same view
+CameraPath orbit(float radius, uint64_t frames) {
+    return [radius, frames](uint64_t frame, glm::vec3 &eye, glm::vec3 &target) {
+        const auto angle = 2.0 * BENCH_PI * static_cast<double>(frame) / static_cast<double>(std::max<uint64_t>(frames, 1));
+        const float distance = 1.5f * radius;
+
+        eye = {
+            distance * static_cast<float>(std::sin(angle)),
+            0.75f * radius,
+            distance * static_cast<float>(std::cos(angle))
+        };
+        target = glm::vec3(0.0f);
+    };
+}
+
+// nearest rank percentiles of the samples after the warmup
+nlohmann::json percentiles(std::vector<double> samples, uint64_t warmup) {
+    samples.erase(samples.begin(), samples.begin() + static_cast<ptrdiff_t>(std::min<uint64_t>(warmup, samples.size())));
+    if (samples.empty()) return nullptr;
+
+    std::ranges::sort(samples);
+
+    auto rank = [&](double p) {
+        const auto index = static_cast<size_t>(std::ceil(p / 100.0 * static_cast<double>(samples.size())));
+        return samples[std::clamp<size_t>(index, 1, samples.size()) - 1];
+    };
+
+    double sum = 0.0;
+    for (auto sample : samples) sum += sample;
+
+    return {
+        {"samples", samples.size()},
+        {"avg",     sum / static_cast<double>(samples.size())},
+        {"p50",     rank(50.0)},
+        {"p90",     rank(90.0)},
+        {"p99",     rank(99.0)},
+        {"max",     samples.back()}
+    };
+}
+
+nlohmann::json heapsJson(std::vector<HeapBudget> const &heaps) {
+    auto result = nlohmann::json::array();
+
+    for (auto const &heap : heaps) {
+        result.push_back({
+            {"heap_size",       heap.heap_size},
+            {"budget",          heap.budget},
+            {"usage",           heap.usage},
+            {"block_bytes",     heap.block_bytes},
+            {"allocated_bytes", heap.allocated_bytes}
+        });
+    }
+
+    return result;
+}
+
+// one fresh renderer per scene, so startup is measured every time
+nlohmann::json runScene(RendererOptions options, BenchScene scene, uint32_t count, uint64_t frames, uint64_t warmup) {
+    const auto radius = buildScene(options, scene, count);
+
+    options.frame_count = warmup + frames;
+    options.camera_path = orbit(radius, warmup + frames);
+    options.collect_stats = true;
+
+    const bool headless = options.headless;
+    const auto extent = options.extent;
+
+    Renderer renderer(std::move(options));
+    renderer.run();
+
+    auto const &stats = renderer.stats();
+    std::cerr << sceneName(scene) << " x " << count << ": " << stats.cpu_frame_ms.size() << " frames" << std::endl;
+
+    return {
+        {"scene",          sceneName(scene)},
+        {"count",          count},
+        {"device",         stats.device},
+        {"headless",       headless},
+        {"extent",         {extent.width, extent.height}},
+        {"frames",         frames},
+        {"warmup",         warmup},
+        {"startup_ms",     stats.startup_ms},
+        {"first_frame_ms", stats.first_frame_ms},
+        {"resident_ms",    stats.resident_ms},
+        {"cpu_frame_ms",   percentiles(stats.cpu_frame_ms, warmup)},
+        {"gpu_frame_ms",   percentiles(stats.gpu_frame_ms, warmup)},
+        {"heaps",          heapsJson(stats.heaps)}
+    };
+}
+
+int main (int argc, char *argv[]) {
+    RendererOptions options;
+    options.headless = true;
+
+    // --scene <triangles|instances|textures> runs just that one, all by default
+    // --count <n> triangles, instances or textures per scene
+    // --frames <n> measured frames, after --warmup <n> that are not
+    // --windowed presents to a window instead of rendering offscreen
+    // --mesh-shaders and --cpu-culling as in Graphics
+    // --output <file> writes the JSON there instead of stdout
+    std::vector<BenchScene> scenes = {BenchScene::eTriangles, BenchScene::eInstances, BenchScene::eTextures};
+    uint32_t count = 1000;
+    uint64_t frames = 600;
+    uint64_t warmup = 60;
+    const char *output_path = nullptr;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--windowed") == 0) options.headless = false;
+        if (strcmp(argv[i], "--mesh-shaders") == 0) options.mesh_shaders = true;
+        if (strcmp(argv[i], "--cpu-culling") == 0) options.cpu_culling = true;
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--output") == 0) output_path = argv[i + 1];
+        if (strcmp(argv[i], "--count") == 0) {
+            count = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        }
+        if (strcmp(argv[i], "--frames") == 0) frames = std::strtoull(argv[i + 1], nullptr, 10);
+        if (strcmp(argv[i], "--warmup") == 0) warmup = std::strtoull(argv[i + 1], nullptr, 10);
+        if (strcmp(argv[i], "--scene") == 0) {
+            const auto found = std::ranges::find_if(scenes, [&](BenchScene scene) {
+                return strcmp(argv[i + 1], sceneName(scene)) == 0;
+            });
+            if (found == scenes.end()) {
+                std::cerr << "Unknown scene " << argv[i + 1] << std::endl;
+                return EXIT_FAILURE;
+            }
+            scenes = {*found};
+        }
+    }
+
+    // vsync would only measure the display
+    if (!options.headless) options.present_mode = vk::PresentModeKHR::eImmediate;
+
+    try {
+        auto runs = nlohmann::json::array();
+        for (auto scene : scenes) {
+            runs.push_back(runScene(options, scene, std::max(count, 1u), frames, warmup));
+        }
+
+        const nlohmann::json report = {{"runs", std::move(runs)}};
+
+        if (output_path) {
+            std::ofstream file(output_path, std::ios::trunc);
+            if (!file) {
+                throw std::runtime_error(std::string("Failed to open bench output: ") + output_path);
+            }
+            file << report.dump(2) << std::endl;
+        } else {
+            std::cout << report.dump(2) << std::endl;
+        }
+    } catch (const std::exception& e) {
+        std::cerr << e.what() << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,13 +1,164 @@
 #include "Renderer.h"
+#include "RendererGroup.h"
 #include <iostream>
 #include <cstdlib>
+#include <cstring>
+#include <cmath>
 #include <exception>
+#include <fstream>
+#include <stdexcept>
+#include <string>
+#include <glm/gtc/matrix_transform.hpp>
+
+// writes an RGBA8 frame as a binary PPM, alpha is dropped
+void writePpm(std::string const &path, ReadbackFrame const &frame) {
+    std::ofstream file(path, std::ios::binary | std::ios::trunc);
+    if (!file) {
+        throw std::runtime_error("Failed to open frame output: " + path);
+    }
+
+    file << "P6\n" << frame.extent.width << " " << frame.extent.height << "\n255\n";
+
+    std::string row(frame.extent.width * 3, '\0');
+    for (uint32_t y = 0; y < frame.extent.height; y++) {
+        const auto *texels = static_cast<const char *>(frame.data) + size_t(y) * frame.row_pitch;
+
+        for (uint32_t x = 0; x < frame.extent.width; x++) {
+            memcpy(&row[x * 3], texels + x * 4, 3);
+        }
+        file.write(row.data(), static_cast<std::streamsize>(row.size()));
+    }
+}
+
+// fifo, relaxed, mailbox or immediate, anything else keeps the default
+vk::PresentModeKHR parsePresentMode(const char *name, vk::PresentModeKHR fallback) {
+    if (strcmp(name, "fifo") == 0) return vk::PresentModeKHR::eFifo;
+    if (strcmp(name, "relaxed") == 0) return vk::PresentModeKHR::eFifoRelaxed;
+    if (strcmp(name, "mailbox") == 0) return vk::PresentModeKHR::eMailbox;
+    if (strcmp(name, "immediate") == 0) return vk::PresentModeKHR::eImmediate;
+
+    std::cerr << "Unknown present mode " << name << ", using " << vk::to_string(fallback) << std::endl;
+    return fallback;
+}
+
+// opaque-fd or dma-buf, anything else reads back through host memory
+ReadbackTarget parseReadbackTarget(const char *name) {
+    if (strcmp(name, "opaque-fd") == 0) return ReadbackTarget::eOpaqueFd;
+    if (strcmp(name, "dma-buf") == 0) return ReadbackTarget::eDmaBuf;
+
+    std::cerr << "Unknown export target " << name << ", reading back through host memory" << std::endl;
+    return ReadbackTarget::eHostMemory;
+}
+
+// square grid of copies on the XZ plane, camera pulled back to see it all
+void buildGrid(RendererOptions &options, const char *mesh, const char *texture, uint32_t count) {
+    constexpr float spacing = 3.0f;
+    const auto side = static_cast<uint32_t>(std::ceil(std::sqrt(static_cast<double>(count))));
+    const float half = 0.5f * spacing * static_cast<float>(side - 1);
+
+    for (uint32_t i = 0; i < count; i++) {
+        const glm::vec3 position = {
+            static_cast<float>(i % side) * spacing - half,
+            0.0f,
+            static_cast<float>(i / side) * spacing - half
+        };
+        options.scene.push_back({
+            .mesh      = mesh,
+            .transform = glm::translate(glm::mat4(1.0f), position),
+            .texture   = texture ? texture : ""
+        });
+    }
+
+    options.camera_eye = glm::vec3(0.0f, half + spacing, 2.0f * half + spacing);
+}
 
 int main (int argc, char *argv[]) {
-    Renderer renderer;
+    RendererOptions options;
+
+    // --trace <file> dumps the CPU frame phases as Chrome trace JSON on exit
+    // --headless <frames> renders offscreen, --output <prefix> saves each frame
+    // --export <opaque-fd|dma-buf> hands headless frames out as exported
+    // memory instead, falling back to host memory when the device can't
+    // --mesh <file> draws --instances <count> copies of it, one by default,
+    // textured with --texture <file>
+    // --mesh-shaders draws them as meshlets when the device supports it
+    // --cpu-culling culls the instances on the workers instead of the GPU
+    // --present-mode <mode> picks the starting present mode, --low-latency
+    // throttles frames to the display
+    // --gpus <count> splits headless frames across that many devices
+    // --startup-timings prints where the time to the first frame went
+    // --hot-reload recompiles the shaders whenever a source is saved
+    // --lit starts with lambert lighting, --alpha-test cuts out texels
+    // --target-gpu-ms <ms> lowers the render resolution to hold that GPU time
+    const char *trace_path = nullptr;
+    const char *output_prefix = nullptr;
+    const char *mesh_path = nullptr;
+    const char *texture_path = nullptr;
+    uint32_t instance_count = 1;
+    uint32_t gpu_count = 1;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--mesh-shaders") == 0) options.mesh_shaders = true;
+        if (strcmp(argv[i], "--cpu-culling") == 0) options.cpu_culling = true;
+        if (strcmp(argv[i], "--low-latency") == 0) options.low_latency = true;
+        if (strcmp(argv[i], "--startup-timings") == 0) options.report_startup = true;
+        if (strcmp(argv[i], "--hot-reload") == 0) options.hot_reload_shaders = true;
+        if (strcmp(argv[i], "--lit") == 0) options.lighting = LightingModel::eLambert;
+        if (strcmp(argv[i], "--alpha-test") == 0) options.alpha_test = true;
+    }
+    for (int i = 1; i + 1 < argc; i++) {
+        if (strcmp(argv[i], "--trace") == 0) trace_path = argv[i + 1];
+        if (strcmp(argv[i], "--output") == 0) output_prefix = argv[i + 1];
+        if (strcmp(argv[i], "--mesh") == 0) mesh_path = argv[i + 1];
+        if (strcmp(argv[i], "--texture") == 0) texture_path = argv[i + 1];
+        if (strcmp(argv[i], "--export") == 0) {
+            options.readback_target = parseReadbackTarget(argv[i + 1]);
+        }
+        if (strcmp(argv[i], "--present-mode") == 0) {
+            options.present_mode = parsePresentMode(argv[i + 1], options.present_mode);
+        }
+        if (strcmp(argv[i], "--gpus") == 0) {
+            gpu_count = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        }
+        if (strcmp(argv[i], "--target-gpu-ms") == 0) {
+            options.target_gpu_ms = std::strtod(argv[i + 1], nullptr);
+        }
+        if (strcmp(argv[i], "--instances") == 0) {
+            instance_count = static_cast<uint32_t>(std::strtoul(argv[i + 1], nullptr, 10));
+        }
+        if (strcmp(argv[i], "--headless") == 0) {
+            options.headless = true;
+            options.frame_count = std::strtoull(argv[i + 1], nullptr, 10);
+        }
+    }
+
+    if (!mesh_path || instance_count == 0) {
+        std::cerr << "Nothing to draw, pass --mesh <file> with an OBJ, glTF or GLB mesh" << std::endl;
+        return EXIT_FAILURE;
+    }
+    buildGrid(options, mesh_path, texture_path, instance_count);
+
+    // exported frames carry an fd, their pixels never reach the CPU
+    if (output_prefix && options.readback_target != ReadbackTarget::eHostMemory) {
+        std::cerr << "--output reads frames from host memory, it can't be combined with --export" << std::endl;
+        return EXIT_FAILURE;
+    }
+
+    if (output_prefix) {
+        options.readback_sink = [output_prefix](ReadbackFrame const &frame) {
+            writePpm(std::string(output_prefix) + std::to_string(frame.frame) + ".ppm", frame);
+        };
+    }
 
     try {
-        renderer.run();
+        if (gpu_count > 1) {
+            RendererGroup group(std::move(options), gpu_count);
+            group.run();
+        } else {
+            Renderer renderer(std::move(options));
+            renderer.run();
+        }
+
+        if (trace_path) writeChromeTrace(trace_path);
     } catch (const std::exception& e) {
         std::cerr << e.what() << std::endl;
         return EXIT_FAILURE;